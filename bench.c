@@ -0,0 +1,373 @@
+// Bancada de medição do encoder: cronometra separadamente cada etapa do
+// pipeline (decodificação, símbolos, síntese por motor e modo, gravação) sobre
+// imagens sintéticas e reais e imprime o resultado em JSON.
+//
+// As alocações são contadas interceptando malloc/calloc/realloc no link
+// (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc); ver o README.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "sstvenc_internal.h"
+
+#define BENCH_DEFAULT_SEED 12345u
+#define BENCH_DEFAULT_REPEAT 3
+#define BENCH_COVER_FILENAME "input1.png"
+#define BENCH_FLAG_FILENAME "input2.png"
+#define BENCH_SYNTH_PPM "sstv_bench_sintetica.ppm"
+#define BENCH_LARGE_PPM "sstv_bench_grande.ppm"
+#define BENCH_LARGE_WIDTH 3000 // foto de 6 MP, reduzida por área para cada modo
+#define BENCH_LARGE_HEIGHT 2000
+#define BENCH_OUTPUT_WAV "sstv_bench_saida.wav"
+#define BENCH_SCHEDULE_FILE "sstv_bench_cronograma.ssts"
+
+// Contadores de alocação (a bancada roda numa thread só).
+static long long alloc_count;
+static long long alloc_bytes;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += (long long)size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    alloc_count++;
+    alloc_bytes += (long long)(n * size);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    alloc_count++;
+    alloc_bytes += (long long)size;
+    return __real_realloc(ptr, size);
+}
+
+// Pico de memória residente do processo inteiro, em KB. O ru_maxrss só cresce,
+// então não separa etapas: sai uma vez, no fim do JSON.
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) < 0) return -1;
+    return ru.ru_maxrss;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// xorshift32: mesma semente, mesmos pixels em qualquer máquina.
+static uint32_t bench_rand(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Acumula as repetições de uma etapa. "units" diz o que foi contado em "count"
+// (amostras de áudio, pixels), para que o JSON seja comparável entre etapas.
+typedef struct {
+    int runs;
+    double best;
+    double sum;
+    long long allocs;
+    long long alloc_bytes;
+    long long alloc_mark;
+    long long bytes_mark;
+    double t0;
+} StageTimer;
+
+static void stage_begin(StageTimer* st) {
+    st->alloc_mark = alloc_count;
+    st->bytes_mark = alloc_bytes;
+    st->t0 = now_seconds();
+}
+
+static void stage_end(StageTimer* st) {
+    double elapsed = now_seconds() - st->t0;
+    if (st->runs == 0 || elapsed < st->best) st->best = elapsed;
+    st->sum += elapsed;
+    // As alocações são iguais a cada repetição; guarda as da última.
+    st->allocs = alloc_count - st->alloc_mark;
+    st->alloc_bytes = alloc_bytes - st->bytes_mark;
+    st->runs++;
+}
+
+typedef struct {
+    FILE* out;
+    int records;
+} JsonReport;
+
+static void report_stage(JsonReport* rep, const char* stage, const char* mode, const char* engine,
+                         const char* image, const char* units, long long count, const StageTimer* st) {
+    if (st->runs == 0) return;
+    double per_s = st->best > 0.0 ? (double)count / st->best : 0.0;
+    double ns_per_unit = count > 0 ? st->best * 1e9 / (double)count : 0.0;
+    fprintf(rep->out, "%s\n    {\"stage\": \"%s\", \"mode\": %s%s%s, \"engine\": %s%s%s, \"image\": \"%s\",",
+            rep->records ? "," : "", stage,
+            mode ? "\"" : "", mode ? mode : "null", mode ? "\"" : "",
+            engine ? "\"" : "", engine ? engine : "null", engine ? "\"" : "", image);
+    fprintf(rep->out, " \"units\": \"%s\", \"count\": %lld, \"runs\": %d, \"best_s\": %.6f, \"mean_s\": %.6f,",
+            units, count, st->runs, st->best, st->sum / st->runs);
+    fprintf(rep->out, " \"%s_per_s\": %.1f, \"ns_per_%s\": %.3f, \"allocs\": %lld, \"alloc_bytes\": %lld}",
+            units, per_s, strcmp(units, "samples") == 0 ? "sample" : "pixel", ns_per_unit,
+            st->allocs, st->alloc_bytes);
+    rep->records++;
+}
+
+// Imagens sintéticas no tamanho exato do modo (capa RGB, flag em cinza).
+static int make_synthetic_images(const SstvMode* mode, uint32_t seed, SstvImages* img) {
+    uint32_t state = seed;
+    img->cover_w = mode->width;
+    img->cover_h = mode->height;
+    img->cover_channels = 3;
+    img->ycbcr = NULL;
+    img->ycbcr_mode = NULL;
+    img->flag_w = FLAG_IMG_WIDTH;
+    img->flag_h = FLAG_IMG_HEIGHT;
+    img->cover = (uint8_t*)malloc((size_t)img->cover_w * img->cover_h * 3);
+    img->flag = (uint8_t*)malloc((size_t)img->flag_w * img->flag_h);
+    if (!img->cover || !img->flag) {
+        perror("malloc imagem sintética");
+        free(img->cover);
+        free(img->flag);
+        return -1;
+    }
+    for (size_t i = 0; i < (size_t)img->cover_w * img->cover_h * 3; ++i) img->cover[i] = (uint8_t)bench_rand(&state);
+    for (size_t i = 0; i < (size_t)img->flag_w * img->flag_h; ++i) img->flag[i] = (uint8_t)bench_rand(&state);
+    return 0;
+}
+
+static void free_synthetic_images(SstvImages* img) {
+    free(img->cover);
+    free(img->flag);
+    img->cover = NULL;
+    img->flag = NULL;
+}
+
+// PPM binário com os mesmos pixels sintéticos, para medir a decodificação
+// sem depender de um PNG externo.
+static int write_synthetic_ppm(const char* path, const SstvImages* img) {
+    FILE* f = fopen(path, "wb");
+    if (!f) { perror(path); return -1; }
+    fprintf(f, "P6\n%d %d\n255\n", img->cover_w, img->cover_h);
+    size_t n = (size_t)img->cover_w * img->cover_h * 3;
+    int status = fwrite(img->cover, 1, n, f) == n ? 0 : -1;
+    if (fclose(f) != 0) status = -1;
+    return status;
+}
+
+// PPM grande gravado linha a linha com a mesma sequência pseudoaleatória.
+static int write_large_ppm(const char* path, uint32_t seed) {
+    FILE* f = fopen(path, "wb");
+    if (!f) { perror(path); return -1; }
+    uint8_t row[BENCH_LARGE_WIDTH * 3];
+    uint32_t state = seed;
+    int status = 0;
+    fprintf(f, "P6\n%d %d\n255\n", BENCH_LARGE_WIDTH, BENCH_LARGE_HEIGHT);
+    for (int y = 0; y < BENCH_LARGE_HEIGHT && status == 0; ++y) {
+        for (size_t i = 0; i < sizeof(row); ++i) row[i] = (uint8_t)bench_rand(&state);
+        if (fwrite(row, 1, sizeof(row), f) != sizeof(row)) status = -1;
+    }
+    if (fclose(f) != 0) status = -1;
+    return status;
+}
+
+// Decodificação e ingestão (reamostragem e conversão de cor) até a resolução
+// do modo; "pixels" conta os da origem.
+static void bench_decode(JsonReport* rep, const char* image, const char* path, const SstvMode* mode,
+                         long long src_pixels, int repeat) {
+    StageTimer st = { 0 };
+    for (int r = 0; r < repeat; ++r) {
+        SstvImages img;
+        stage_begin(&st);
+        int ok = load_cover_image(path, mode, &img) == 0;
+        stage_end(&st);
+        if (!ok) return;
+        free_cover_image(&img);
+    }
+    report_stage(rep, "decode", mode->name, NULL, image, "pixels", src_pixels, &st);
+}
+
+static void bench_mode(JsonReport* rep, const SstvMode* mode, const SstvImages* img, const char* image,
+                       int samplerate, int repeat, int with_output) {
+    // Símbolos da imagem: mesmo cronograma que build_sstv_schedule monta.
+    StageTimer st = { 0 };
+    for (int r = 0; r < repeat; ++r) {
+        SymbolSchedule sched;
+        if (schedule_init(&sched, image_data_symbol_count(mode), samplerate) < 0) return;
+        stage_begin(&st);
+        int ok = generate_image_data_symbols(mode, img, &sched) >= 0;
+        stage_end(&st);
+        schedule_free(&sched);
+        if (!ok) return;
+    }
+    report_stage(rep, "symbols", mode->name, NULL, image, "samples",
+                 image_data_total_samples(mode, samplerate), &st);
+
+    SymbolSchedule sched;
+    if (build_sstv_schedule(mode, img, &sched, samplerate, NULL) < 0) return;
+    static const char* const engines[] = { "libm", "nco", "simd" };
+    int16_t* reference = NULL;
+    int reference_len = 0;
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e) {
+        SynthEngine engine;
+        SynthConfig cfg;
+        parse_synth_engine(engines[e], &engine);
+        synth_config_init(&cfg, engine, samplerate);
+        StageTimer synth = { 0 };
+        int len = 0;
+        for (int r = 0; r < repeat; ++r) {
+            stage_begin(&synth);
+            int16_t* wav = generate_wav(&sched, &cfg, &len);
+            stage_end(&synth);
+            if (!wav) break;
+            if (!reference) {
+                reference = wav;
+                reference_len = len;
+            } else {
+                free(wav);
+            }
+        }
+        report_stage(rep, "synth", mode->name, engines[e], image, "samples", len, &synth);
+    }
+
+    if (with_output && reference) {
+        StageTimer out = { 0 };
+        for (int r = 0; r < repeat; ++r) {
+            stage_begin(&out);
+            int ok = save_wav_file(BENCH_OUTPUT_WAV, samplerate, SAMPLE_FORMAT_INT16, 1, reference, reference_len) == 0;
+            stage_end(&out);
+            if (!ok) break;
+        }
+        report_stage(rep, "output", mode->name, NULL, image, "samples", reference_len, &out);
+        unlink(BENCH_OUTPUT_WAV);
+    }
+    free(reference);
+    schedule_free(&sched);
+}
+
+// Cronograma compilado: gravação do .ssts, abertura (mmap + conferência do
+// cabeçalho) e síntese direto dos registros mapeados.
+static void bench_packed(JsonReport* rep, const SstvMode* mode, const SstvImages* img, const char* image,
+                         int samplerate, int repeat) {
+    StageTimer compile = { 0 }, open_st = { 0 }, synth = { 0 };
+    long long total = 0;
+    for (int r = 0; r < repeat; ++r) {
+        stage_begin(&compile);
+        total = compile_frame_schedule(mode, img, samplerate, BENCH_SCHEDULE_FILE, NULL, NULL, NULL);
+        stage_end(&compile);
+        if (total <= 0) return;
+    }
+    report_stage(rep, "compile", mode->name, NULL, image, "samples", total, &compile);
+
+    SynthConfig cfg;
+    synth_config_init(&cfg, SYNTH_ENGINE_SIMD, samplerate);
+    int16_t* wav = (int16_t*)malloc((size_t)total * sizeof(int16_t));
+    for (int r = 0; wav && r < repeat; ++r) {
+        PackedSchedule ps;
+        stage_begin(&open_st);
+        int ok = map_packed_schedule(BENCH_SCHEDULE_FILE, &ps) == 0;
+        stage_end(&open_st);
+        if (!ok) break;
+        PackedScheduleSource pss;
+        SynthCursor cursor;
+        stage_begin(&synth);
+        synth_cursor_init_source(&cursor, packed_schedule_source(&pss, &ps), &cfg);
+        synth_render(&cursor, wav, (int)total);
+        stage_end(&synth);
+        unmap_packed_schedule(&ps);
+    }
+    report_stage(rep, "packed_open", mode->name, NULL, image, "samples", total, &open_st);
+    report_stage(rep, "packed_synth", mode->name, "simd", image, "samples", total, &synth);
+    free(wav);
+    unlink(BENCH_SCHEDULE_FILE);
+}
+
+int main(int argc, char** argv) {
+    uint32_t seed = BENCH_DEFAULT_SEED;
+    int repeat = BENCH_DEFAULT_REPEAT;
+    int samplerate = SAMPLERATE;
+    const char* only_mode = NULL;
+    const char* cover_path = BENCH_COVER_FILENAME;
+    const char* flag_path = BENCH_FLAG_FILENAME;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) samplerate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) only_mode = argv[++i];
+        else if (strcmp(argv[i], "--cover") == 0 && i + 1 < argc) cover_path = argv[++i];
+        else if (strcmp(argv[i], "--flag") == 0 && i + 1 < argc) flag_path = argv[++i];
+        else {
+            fprintf(stderr, "Uso: %s [--seed N] [--repeat N] [--rate Hz] [--mode nome] [--cover arquivo] [--flag arquivo]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (seed == 0) seed = BENCH_DEFAULT_SEED; // xorshift não sai do zero
+    if (repeat < 1) repeat = 1;
+    if (only_mode && !find_sstv_mode(only_mode)) {
+        fprintf(stderr, "ERRO: Modo SSTV desconhecido: %s. Modos disponíveis:\n", only_mode);
+        print_sstv_modes(stderr);
+        return 1;
+    }
+
+    JsonReport rep = { stdout, 0 };
+
+    SstvImages real = { 0 };
+    int real_w = 0, real_h = 0;
+    int have_real = probe_image_size(cover_path, &real_w, &real_h) == 0 &&
+                    load_cover_image(cover_path, find_sstv_mode("classico"), &real) == 0 &&
+                    load_flag_image(flag_path, &real) == 0;
+    if (!have_real) fprintf(stderr, "Aviso: sem imagens reais, medindo só as sintéticas.\n");
+
+    fprintf(rep.out, "{\n  \"bench\": \"sstvenc\",\n  \"seed\": %u,\n  \"repeat\": %d,\n  \"samplerate\": %d,\n"
+                     "  \"results\": [", seed, repeat, samplerate);
+
+    SstvImages synthetic;
+    if (make_synthetic_images(find_sstv_mode("classico"), seed, &synthetic) == 0) {
+        if (write_synthetic_ppm(BENCH_SYNTH_PPM, &synthetic) == 0) {
+            bench_decode(&rep, "synthetic", BENCH_SYNTH_PPM, find_sstv_mode("classico"),
+                         (long long)synthetic.cover_w * synthetic.cover_h, repeat);
+            unlink(BENCH_SYNTH_PPM);
+        }
+        free_synthetic_images(&synthetic);
+    }
+    if (have_real) {
+        bench_decode(&rep, "real", cover_path, find_sstv_mode("classico"), (long long)real_w * real_h, repeat);
+    }
+    if (write_large_ppm(BENCH_LARGE_PPM, seed) == 0) {
+        long long large = (long long)BENCH_LARGE_WIDTH * BENCH_LARGE_HEIGHT;
+        bench_decode(&rep, "synthetic-6mp", BENCH_LARGE_PPM, find_sstv_mode("classico"), large, repeat);
+        bench_decode(&rep, "synthetic-6mp", BENCH_LARGE_PPM, find_sstv_mode("pd120"), large, repeat);
+        unlink(BENCH_LARGE_PPM);
+    }
+
+    const SstvMode* mode;
+    for (int m = 0; (mode = sstv_mode_at(m)) != NULL; ++m) {
+        if (only_mode && strcmp(mode->name, only_mode) != 0) continue;
+        fprintf(stderr, "Medindo modo %s...\n", mode->name);
+        if (make_synthetic_images(mode, seed, &synthetic) == 0) {
+            bench_mode(&rep, mode, &synthetic, "synthetic", samplerate, repeat, 1);
+            bench_packed(&rep, mode, &synthetic, "synthetic", samplerate, repeat);
+            free_synthetic_images(&synthetic);
+        }
+        if (have_real) bench_mode(&rep, mode, &real, "real", samplerate, repeat, 0);
+    }
+
+    fprintf(rep.out, "\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+    fflush(rep.out);
+    if (real.cover) free_cover_image(&real);
+    if (real.flag) free_flag_image(&real);
+    return 0;
+}
@@ -2,560 +2,808 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <math.h>
-#include <assert.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "sstvenc_internal.h"
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#define SAMPLERATE 96000
 #define OUTPUT_FILENAME "output_aprimorado.wav"
+#define OUTPUT_CHANNEL_PATTERN "output_aprimorado_%d.wav" // --multi --split: um arquivo por capa
 #define COVER_IMG_FILENAME "input1.png"
 #define FLAG_IMG_FILENAME "input2.png"
 
-#define COVER_IMG_WIDTH 320
-#define COVER_IMG_HEIGHT 256
-
-#define FLAG_IMG_WIDTH 16 
-#define FLAG_IMG_HEIGHT 16
-#define FLAG_IMG_POS_Y 44 
-#define SSTV_COLOR_SCANLINE_DURATION 0.13974
-#define SSTV_FLAG_SEGMENT_TOTAL_DURATION 0.0464
-
-#define SSTV_HSYNC_FREQ 1200.0
-#define SSTV_HSYNC_DURATION 0.009
-
-#define SSTV_PORCH_FREQ 1500.0
-#define SSTV_PIXEL_FREQ_MIN 1500.0
-#define SSTV_PIXEL_FREQ_MAX 2300.0
-#define SSTV_PIXEL_FREQ_RANGE (SSTV_PIXEL_FREQ_MAX - SSTV_PIXEL_FREQ_MIN)
-
-#define SSTV_FLAG_PAD_SYNC_FREQ 2300.0
-#define SSTV_FLAG_PIXEL_FREQ_MIN 1550.0
-#define SSTV_FLAG_PIXEL_FREQ_MAX 2250.0
-#define SSTV_FLAG_PIXEL_FREQ_RANGE (SSTV_FLAG_PIXEL_FREQ_MAX - SSTV_FLAG_PIXEL_FREQ_MIN)
-
-#define SSTV_VOX_TONE_DURATION 0.1
-#define SSTV_VIS_HEADER_TONE_DURATION_SHORT 0.01
-#define SSTV_VIS_HEADER_TONE_DURATION_LONG 0.03 
-#define SSTV_EOF_TONE_DURATION 0.1
-#define SSTV_SILENCE_DURATION 0.1
-
-typedef enum {
-    SILENCE_SYMBOL,
-    TONE_SYMBOL,
-    LINEAR_SWEEP_SYMBOL
-} AudioSymbolType;
+#define BATCH_PATH_MAX 1024
+#define VERIFY_DEFAULT_MIN_PSNR 30.0 // contra a referência libm: caminhos corretos dão 36 dB ou mais (u8, cache)
 
 typedef struct {
-    double duration;
-    AudioSymbolType type;
-} AudioSymbol;
-
+    char cover[BATCH_PATH_MAX];
+    char flag[BATCH_PATH_MAX];
+    char output[BATCH_PATH_MAX];
+} BatchJob;
+
+// Estado que cada worker mantém entre tarefas: cache de PCM dos trechos
+// constantes, cache de linhas (--incremental) e a última flag decodificada
+// (em geral a mesma em todo o lote).
 typedef struct {
-    AudioSymbol base;
-} Silence;
+    PcmCache cache;
+    int use_cache;
+    LineCache lines;
+    int use_lines;
+    char flag_path[BATCH_PATH_MAX];
+    SstvImages flag;
+    long long frames;
+    long long failed;
+    long long samples;
+    long long mismatched;
+} BatchWorker;
 
 typedef struct {
-    AudioSymbol base;
-    double frequency;
-    double amplitude;
-    double phase_offset;
-} Tone;
+    const BatchJob* jobs;
+    const SstvMode* mode;
+    const SynthConfig* cfg;
+    BatchWorker* workers;
+    FILE* info;
+    double min_psnr;    // < 0: sem verificação
+} BatchCtx;
+
+static double elapsed_seconds(const struct timespec* t0, const struct timespec* t1) {
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
+}
 
-typedef struct {
-    AudioSymbol base;
-    double freqstart;
-    double freqend;
-    double amplitude;
-    double phase_offset;
-} LinearSweep;
-
-void free_audio_symbols_array(AudioSymbol** syms, int sym_count);
-AudioSymbol* create_silence_symbol(double duration);
-AudioSymbol* create_tone_symbol(double duration, double freq, double amp, double phase_offset_rad);
-AudioSymbol* create_sweep_symbol(double duration, double f_start, double f_end, double amp, double phase_offset_rad);
-
-
-int16_t* generate_wav(AudioSymbol** syms, int sym_count, int samplerate_local, int* wav_length) {
-    long long total_samples_long = 0;
-    for (int i = 0; i < sym_count; ++i) {
-        if (syms[i]) {
-            total_samples_long += (long long)(syms[i]->duration * samplerate_local);
-        }
+// Decodifica um canal do WAV gerado e a renderização de referência (libm, sem
+// cache) das mesmas imagens, e compara as duas: a aprovação mede só o caminho de
+// síntese. A PSNR contra a entrada sai junto, informativa: nela entram também as
+// perdas próprias do modo. Retorna 0 quando a PSNR contra a referência fica em
+// pelo menos min_psnr.
+static int verify_output(const char* path, int channel, const SstvMode* mode, const SstvImages* img,
+                         double min_psnr, FILE* info, const char* label) {
+    int samplerate_local = 0;
+    long long count = 0;
+    int16_t* pcm = read_wav_samples(path, channel, &samplerate_local, &count);
+    if (!pcm) return -1;
+    SstvDecoded dec, ref;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int status = sstv_decode(pcm, count, samplerate_local, mode, &dec);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(pcm);
+    if (status < 0) return -1;
+    if (dec.mode != mode) {
+        fprintf(stderr, "ERRO: %s%s decodificado como %s.\n", label, path, dec.mode->name);
+        sstv_decoded_free(&dec);
+        return -1;
     }
-
-    if (total_samples_long == 0) {
-        fprintf(stderr, "ERRO: Nenhum símbolo para gerar áudio ou duração total zero.\n");
-        *wav_length = 0;
-        return NULL;
+    long long ref_count = 0;
+    int16_t* ref_pcm = render_frame_reference(mode, img, samplerate_local, &ref_count);
+    status = ref_pcm ? sstv_decode(ref_pcm, ref_count, samplerate_local, mode, &ref) : -1;
+    free(ref_pcm);
+    if (status < 0) {
+        fprintf(stderr, "ERRO: %sReferência libm não pôde ser gerada.\n", label);
+        sstv_decoded_free(&dec);
+        return -1;
     }
-    if (total_samples_long > INT32_MAX) {
-        fprintf(stderr, "ERRO: Número total de amostras excede o limite de int32_t!\n");
-        *wav_length = 0;
-        return NULL;
+    SstvDecodeScore score, input;
+    sstv_decode_compare(&dec, &ref, &score);
+    sstv_decode_score(&dec, img, &input);
+    fprintf(info, "%sVerificação: %s, %d/%d sincronismos, PSNR %.2f dB contra a referência", label,
+            dec.vis_found ? "VIS ok" : "sem VIS", dec.syncs_found, dec.syncs_expected, score.psnr);
+    if (mode->has_flag) fprintf(info, " (flag %.2f dB)", score.flag_psnr);
+    fprintf(info, ", erro médio %.2f, máx. %d; %.2f dB contra a entrada; decodificado em %.1f ms\n",
+            score.mean_abs_err, score.max_err, input.psnr, elapsed_seconds(&t0, &t1) * 1000.0);
+    sstv_decoded_free(&dec);
+    sstv_decoded_free(&ref);
+    if (score.psnr < min_psnr) {
+        fprintf(stderr, "ERRO: %sPSNR %.2f dB abaixo do mínimo %.2f dB.\n", label, score.psnr, min_psnr);
+        return -1;
     }
-    int total_samples = (int)total_samples_long;
+    return 0;
+}
 
-    int16_t* wav = (int16_t*)malloc(total_samples * sizeof(int16_t));
-    if (!wav) {
-        perror("malloc para buffer WAV falhou");
-        *wav_length = 0;
-        return NULL;
+// --decode: decodifica um WAV qualquer deste encoder e mede a vazão.
+static int run_decode(const char* path, const SstvMode* mode_hint, const char* ppm_path, FILE* info) {
+    int samplerate_local = 0;
+    long long count = 0;
+    int16_t* pcm = read_wav_samples(path, 0, &samplerate_local, &count);
+    if (!pcm) return 1;
+    SstvDecoded dec;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int status = sstv_decode(pcm, count, samplerate_local, mode_hint, &dec);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(pcm);
+    if (status < 0) return 1;
+    double elapsed = elapsed_seconds(&t0, &t1);
+    if (elapsed <= 0.0) elapsed = 1e-9;
+    fprintf(info, "Decodificado: %s (%dx%d), %s, %d/%d sincronismos, inclinação %.5f\n", dec.mode->description,
+            dec.mode->width, dec.mode->height, dec.vis_found ? "VIS ok" : "modo informado",
+            dec.syncs_found, dec.syncs_expected, dec.slant);
+    fprintf(info, "Vazão: %lld amostras em %.1f ms (%.3e amostras/s, %.0fx tempo real)\n", count,
+            elapsed * 1000.0, count / elapsed, (double)count / samplerate_local / elapsed);
+    if (ppm_path) {
+        if (write_decoded_ppm(ppm_path, &dec) < 0) status = -1;
+        else fprintf(info, "Imagem decodificada salva em: %s\n", ppm_path);
     }
+    sstv_decoded_free(&dec);
+    return status < 0 ? 1 : 0;
+}
 
-    int current_sample_idx = 0;
-    double current_main_phase = 0.0;
+static void batch_run_job(void* arg, int job_idx, int worker_idx) {
+    BatchCtx* ctx = (BatchCtx*)arg;
+    const BatchJob* job = &ctx->jobs[job_idx];
+    BatchWorker* w = &ctx->workers[worker_idx];
+
+    if (ctx->mode->has_flag && (!w->flag.flag || strcmp(w->flag_path, job->flag) != 0)) {
+        free_flag_image(&w->flag);
+        w->flag_path[0] = '\0';
+        if (load_flag_image(job->flag, &w->flag) < 0) {
+            fprintf(stderr, "ERRO: [%d] %s: falha ao carregar a flag; tarefa ignorada.\n", job_idx, job->output);
+            w->failed++;
+            return;
+        }
+        snprintf(w->flag_path, sizeof(w->flag_path), "%s", job->flag);
+    }
 
-    for (int i = 0; i < sym_count; ++i) {
-        if (!syms[i]) continue;
-        int sample_count_for_symbol = (int)(syms[i]->duration * samplerate_local);
-        if (current_sample_idx + sample_count_for_symbol > total_samples) {
-             sample_count_for_symbol = total_samples - current_sample_idx;
-             if (sample_count_for_symbol <= 0 && i < sym_count -1) {
-                fprintf(stderr, "Aviso: Buffer WAV cheio antes do símbolo %d. Símbolos restantes ignorados.\n", i);
-                break; 
-             }
+    SstvImages images = w->flag;
+    StatsMark mark;
+    STATS_BEGIN(ctx->cfg->stats, mark);
+    int loaded = load_cover_image(job->cover, ctx->mode, &images);
+    STATS_END(ctx->cfg->stats, STATS_LOAD, mark);
+    if (loaded < 0) {
+        fprintf(stderr, "ERRO: [%d] %s: falha ao carregar a imagem; tarefa ignorada.\n", job_idx, job->output);
+        w->failed++;
+        return;
+    }
+    PcmCache* cache = w->use_cache ? &w->cache : NULL;
+    long long written = w->use_lines ?
+        encode_frame_incremental(ctx->mode, &images, ctx->cfg, cache, &w->lines, job->output) :
+        encode_frame(ctx->mode, &images, ctx->cfg, cache, job->output);
+
+    if (written > 0) {
+        w->frames++;
+        w->samples += written;
+        fprintf(ctx->info, "[%d] %s (%lld amostras)\n", job_idx, job->output, written);
+        char label[32];
+        snprintf(label, sizeof(label), "[%d] ", job_idx);
+        if (ctx->min_psnr >= 0.0 && verify_output(job->output, 0, ctx->mode, &images, ctx->min_psnr, ctx->info, label) < 0) {
+            w->mismatched++;
         }
-        if (sample_count_for_symbol < 0) sample_count_for_symbol = 0;
+    } else {
+        fprintf(stderr, "ERRO: [%d] %s: falha ao gerar o WAV.\n", job_idx, job->output);
+        w->failed++;
+    }
+    free_cover_image(&images);
+}
 
+static int batch_add_job(BatchJob** jobs, int* count, int* capacity,
+                         const char* cover, const char* flag, const char* output) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        BatchJob* grown = (BatchJob*)realloc(*jobs, (size_t)new_capacity * sizeof(BatchJob));
+        if (!grown) { perror("realloc BatchJob"); return -1; }
+        *jobs = grown;
+        *capacity = new_capacity;
+    }
+    BatchJob* job = &(*jobs)[(*count)++];
+    snprintf(job->cover, sizeof(job->cover), "%s", cover);
+    snprintf(job->flag, sizeof(job->flag), "%s", flag);
+    snprintf(job->output, sizeof(job->output), "%s", output);
+    return 0;
+}
 
-        switch (syms[i]->type) {
-        case SILENCE_SYMBOL:
-            if (sample_count_for_symbol > 0) {
-                memset(&wav[current_sample_idx], 0, sample_count_for_symbol * sizeof(int16_t));
-            }
-            break;
-        case TONE_SYMBOL: {
-            Tone* tone = (Tone*)syms[i];
-            double rfreq = 2.0 * M_PI * tone->frequency / samplerate_local;
-            double symbol_start_phase = fmod(current_main_phase + tone->phase_offset, 2.0 * M_PI);
-            for (int j = 0; j < sample_count_for_symbol; ++j) {
-                wav[current_sample_idx + j] = (int16_t)(tone->amplitude * sin(j * rfreq + symbol_start_phase) * 32767.0);
-            }
-            if (sample_count_for_symbol > 0) {
-                 current_main_phase = fmod(symbol_start_phase + sample_count_for_symbol * rfreq, 2.0 * M_PI);
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Lista de tarefas a partir de um manifesto ("capa [flag] saída" por linha, # comenta)
+// ou de um diretório (cada imagem vira <nome>.wav ao lado, com a flag padrão).
+int load_batch_jobs(const char* path, BatchJob** jobs_out, int* count_out) {
+    BatchJob* jobs = NULL;
+    int count = 0, capacity = 0;
+    int status = 0;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "ERRO: Não foi possível acessar %s.\n", path);
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path);
+        if (!dir) { perror("opendir"); return -1; }
+        char** names = NULL;
+        int n = 0, cap = 0;
+        struct dirent* ent;
+        while (status == 0 && (ent = readdir(dir)) != NULL) {
+            const char* dot = strrchr(ent->d_name, '.');
+            if (ent->d_name[0] == '.' || !dot || strcmp(dot, ".wav") == 0) continue;
+            if (n == cap) {
+                int new_cap = cap ? cap * 2 : 64;
+                char** grown = (char**)realloc(names, new_cap * sizeof(char*));
+                if (!grown) { perror("realloc"); status = -1; break; }
+                names = grown;
+                cap = new_cap;
             }
-            break;
+            names[n] = strdup(ent->d_name);
+            if (!names[n]) { perror("strdup"); status = -1; break; }
+            n++;
         }
-        case LINEAR_SWEEP_SYMBOL: {
-            LinearSweep* sweep = (LinearSweep*)syms[i];
-            double phase_for_sweep = fmod(current_main_phase + sweep->phase_offset, 2.0 * M_PI);
-            double freq_diff = sweep->freqend - sweep->freqstart;
-
-            for (int j = 0; j < sample_count_for_symbol; ++j) {
-                double instantaneous_freq = sweep->freqstart + (freq_diff * (double)j / sample_count_for_symbol);
-                double rfreq_step = 2.0 * M_PI * instantaneous_freq / samplerate_local;
-                wav[current_sample_idx + j] = (int16_t)(sweep->amplitude * sin(phase_for_sweep) * 32767.0);
-                phase_for_sweep = fmod(phase_for_sweep + rfreq_step, 2.0 * M_PI);
-            }
-            if (sample_count_for_symbol > 0) {
-                current_main_phase = phase_for_sweep;
+        closedir(dir);
+        if (status == 0) qsort(names, n, sizeof(char*), compare_names);
+        for (int i = 0; i < n; ++i) {
+            char cover[BATCH_PATH_MAX], output[BATCH_PATH_MAX];
+            snprintf(cover, sizeof(cover), "%s/%s", path, names[i]);
+            snprintf(output, sizeof(output), "%s/%.*s.wav", path,
+                     (int)(strrchr(names[i], '.') - names[i]), names[i]);
+            if (status == 0 && batch_add_job(&jobs, &count, &capacity, cover, FLAG_IMG_FILENAME, output) < 0) {
+                status = -1;
             }
-            break;
+            free(names[i]);
         }
-        default:
-             if (sample_count_for_symbol > 0) {
-                memset(&wav[current_sample_idx], 0, sample_count_for_symbol * sizeof(int16_t));
-            }
-            break;
+        free(names);
+    } else {
+        FILE* manifest = fopen(path, "r");
+        if (!manifest) {
+            fprintf(stderr, "ERRO: Não foi possível abrir o manifesto %s.\n", path);
+            return -1;
         }
-        current_sample_idx += sample_count_for_symbol;
+        char line[3 * BATCH_PATH_MAX];
+        int line_no = 0;
+        while (status == 0 && fgets(line, sizeof(line), manifest)) {
+            char a[BATCH_PATH_MAX], b[BATCH_PATH_MAX], c[BATCH_PATH_MAX];
+            line_no++;
+            int fields = sscanf(line, "%1023s %1023s %1023s", a, b, c);
+            if (fields <= 0 || a[0] == '#') continue;
+            if (fields == 3) status = batch_add_job(&jobs, &count, &capacity, a, b, c);
+            else if (fields == 2) status = batch_add_job(&jobs, &count, &capacity, a, FLAG_IMG_FILENAME, b);
+            else fprintf(stderr, "Aviso: %s:%d ignorada (esperado: capa [flag] saída).\n", path, line_no);
+        }
+        fclose(manifest);
     }
-
-    *wav_length = current_sample_idx;
-    return wav;
-}
-
-
-AudioSymbol** generate_vox_signal(int* sym_count_out) {
-    int freqs[] = { 1900, 1500, 1900, 1500, 2300, 1500, 2300, 1500 };
-    *sym_count_out = sizeof(freqs) / sizeof(freqs[0]);
-    AudioSymbol** syms = (AudioSymbol**)malloc(*sym_count_out * sizeof(AudioSymbol*));
-    if (!syms) { *sym_count_out = 0; perror("malloc vox_syms"); return NULL; }
-
-    for (int i = 0; i < *sym_count_out; ++i) {
-        syms[i] = create_tone_symbol(SSTV_VOX_TONE_DURATION, freqs[i], 1.0, 0.0);
-        if (!syms[i]) { free_audio_symbols_array(syms, i); *sym_count_out = 0; return NULL; }
+    if (status < 0) {
+        fprintf(stderr, "ERRO: Não foi possível montar o lote de %s.\n", path);
+        free(jobs);
+        return -1;
     }
-    return syms;
-}
 
-AudioSymbol** generate_vis_signal(int* sym_count_out) {
-    int freqs[] = {
-        1900, 1200, 1900, 1200, 1100, 1300, 1100, 1300, 1100, 1300, 1100, 1300, 1100, 1300, 1200
-    };
-    *sym_count_out = sizeof(freqs) / sizeof(freqs[0]);
-    AudioSymbol** syms = (AudioSymbol**)malloc(*sym_count_out * sizeof(AudioSymbol*));
-    if (!syms) { *sym_count_out = 0; perror("malloc vis_syms"); return NULL; }
-
-    for (int i = 0; i < *sym_count_out; ++i) {
-        double duration = (i == 1 || i == *sym_count_out - 1) ?
-                           SSTV_VIS_HEADER_TONE_DURATION_SHORT : SSTV_VIS_HEADER_TONE_DURATION_LONG;
-        syms[i] = create_tone_symbol(duration, freqs[i], 1.0, 0.0);
-        if (!syms[i]) { free_audio_symbols_array(syms, i); *sym_count_out = 0; return NULL; }
-    }
-    return syms;
+    *jobs_out = jobs;
+    *count_out = count;
+    return 0;
 }
 
-AudioSymbol** generate_eof_signal(int* sym_count_out) {
-    int freqs[] = { 1900, 1500, 1900, 1500 };
-    *sym_count_out = sizeof(freqs) / sizeof(freqs[0]);
-    AudioSymbol** syms = (AudioSymbol**)malloc(*sym_count_out * sizeof(AudioSymbol*));
-    if (!syms) { *sym_count_out = 0; perror("malloc eof_syms"); return NULL; }
+// Codifica todas as tarefas num pool de workers; falhas individuais não
+// interrompem o lote. Ao final imprime a vazão agregada.
+int run_batch(const char* path, const SstvMode* mode, const SynthConfig* cfg, int nthreads, int use_cache,
+              int incremental, double min_psnr, FILE* info) {
+    BatchJob* jobs;
+    int njobs;
+    if (load_batch_jobs(path, &jobs, &njobs) < 0) return 1;
+    if (njobs == 0) {
+        fprintf(stderr, "ERRO: Nenhuma tarefa em %s.\n", path);
+        free(jobs);
+        return 1;
+    }
+    if (nthreads > njobs) nthreads = njobs;
+    if (nthreads > MAX_WORKER_THREADS) nthreads = MAX_WORKER_THREADS;
+
+    BatchWorker* workers = (BatchWorker*)calloc(nthreads, sizeof(BatchWorker));
+    if (!workers) { perror("calloc BatchWorker"); free(jobs); return 1; }
+    for (int w = 0; w < nthreads; ++w) {
+        workers[w].use_cache = use_cache && pcm_cache_init(&workers[w].cache, cfg) == 0;
+        workers[w].use_lines = incremental && line_cache_init(&workers[w].lines, mode, cfg) == 0;
+    }
 
-    for (int i = 0; i < *sym_count_out; ++i) {
-        syms[i] = create_tone_symbol(SSTV_EOF_TONE_DURATION, freqs[i], 1.0, 0.0);
-        if (!syms[i]) { free_audio_symbols_array(syms, i); *sym_count_out = 0; return NULL; }
+    fprintf(info, "Lote: %d quadros, %d workers\n", njobs, nthreads);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    BatchCtx ctx = { jobs, mode, cfg, workers, info, min_psnr };
+    run_parallel_jobs(njobs, nthreads, batch_run_job, &ctx);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    long long frames = 0, failed = 0, mismatched = 0, samples = 0, line_hits = 0, line_misses = 0;
+    for (int w = 0; w < nthreads; ++w) {
+        frames += workers[w].frames;
+        failed += workers[w].failed;
+        mismatched += workers[w].mismatched;
+        samples += workers[w].samples;
+        if (workers[w].use_cache) pcm_cache_free(&workers[w].cache);
+        if (workers[w].use_lines) {
+            line_hits += workers[w].lines.hits;
+            line_misses += workers[w].lines.misses;
+            line_cache_free(&workers[w].lines);
+        }
+        free_flag_image(&workers[w].flag);
     }
-    return syms;
-}
+    double elapsed = elapsed_seconds(&t0, &t1);
+    if (elapsed <= 0.0) elapsed = 1e-9;
+    fprintf(info, "Lote concluído: %lld ok, %lld falhas em %.3f s (%.2f quadros/s, %.3e amostras/s)\n",
+            frames, failed, elapsed, frames / elapsed, samples / elapsed);
+    if (incremental) {
+        fprintf(info, "Cache de linhas: %lld reaproveitadas, %lld sintetizadas\n", line_hits, line_misses);
+    }
+    if (min_psnr >= 0.0) fprintf(info, "Verificação: %lld quadros reprovados\n", mismatched);
 
-AudioSymbol** convert_flag_row_to_symbols(
-    uint8_t* flag_pixel_row_data,
-    int num_flag_pixels_in_row,
-    double total_time_for_this_flag_segment,
-    int* generated_sym_count
-) {
-    if (num_flag_pixels_in_row <= 0) {
-        fprintf(stderr, "ERRO: num_flag_pixels_in_row deve ser positivo em convert_flag_row_to_symbols.\n");
-        *generated_sym_count = 0;
-        return NULL;
-    }
-
-    *generated_sym_count = num_flag_pixels_in_row + 2; // +2 para tons de padding/sync
-    AudioSymbol** syms = (AudioSymbol**)malloc(*generated_sym_count * sizeof(AudioSymbol*));
-    if (!syms) { *generated_sym_count = 0; perror("malloc flag_row_syms"); return NULL; }
-    int current_sym_idx = 0;
-
-    double time_for_initial_padding = total_time_for_this_flag_segment * 0.15;
-    double time_for_flag_pixels_block = total_time_for_this_flag_segment * 0.70;
-    double time_for_final_padding = total_time_for_this_flag_segment * 0.15;
-    double single_flag_pixel_tone_duration = time_for_flag_pixels_block / num_flag_pixels_in_row;
-
-    syms[current_sym_idx] = create_tone_symbol(time_for_initial_padding, SSTV_FLAG_PAD_SYNC_FREQ, 1.0, 0.0);
-    if (!syms[current_sym_idx++]) goto cleanup_flag_row_error;
-
-    for (int i = 0; i < num_flag_pixels_in_row; ++i) {
-        double freq = SSTV_FLAG_PIXEL_FREQ_MIN + SSTV_FLAG_PIXEL_FREQ_RANGE * flag_pixel_row_data[i] / 255.0;
-        syms[current_sym_idx] = create_tone_symbol(single_flag_pixel_tone_duration, freq, 1.0, 0.0);
-        if (!syms[current_sym_idx++]) goto cleanup_flag_row_error;
-    }
-
-    syms[current_sym_idx] = create_tone_symbol(time_for_final_padding, SSTV_FLAG_PAD_SYNC_FREQ, 1.0, 0.0);
-    if (!syms[current_sym_idx++]) goto cleanup_flag_row_error;
-    
-    assert(current_sym_idx == *generated_sym_count);
-    return syms;
-
-cleanup_flag_row_error:
-    free_audio_symbols_array(syms, current_sym_idx);
-    *generated_sym_count = 0;
-    return NULL;
+    free(workers);
+    free(jobs);
+    return failed || mismatched ? 1 : 0;
 }
 
-
-AudioSymbol** generate_image_data_symbols(
-    const char* cover_image_filename,
-    const char* flag_image_filename,
-    int* total_image_symbols_count
-) {
-    int cover_w, cover_h, cover_channels_file;
-    uint8_t* cover_img_data = stbi_load(cover_image_filename, &cover_w, &cover_h, &cover_channels_file, 0);
-    if (!cover_img_data) {
-        fprintf(stderr, "ERRO: %s não foi encontrado ou não pôde ser carregado.\n", cover_image_filename);
-        *total_image_symbols_count = 0;
-        return NULL;
-    }
-    if (cover_w != COVER_IMG_WIDTH || cover_h != COVER_IMG_HEIGHT) {
-        fprintf(stderr, "Aviso: Dimensões de %s (%dx%d) diferem do esperado (%dx%d).\n",
-                cover_image_filename, cover_w, cover_h, COVER_IMG_WIDTH, COVER_IMG_HEIGHT);
-    }
-    int actual_cover_channels_to_use = (cover_channels_file >= 3) ? 3 : cover_channels_file;
-
-
-    int flag_w_file, flag_h_file, flag_channels_file;
-    uint8_t* flag_img_data = stbi_load(flag_image_filename, &flag_w_file, &flag_h_file, &flag_channels_file, 1); // (grayscale)
-    if (!flag_img_data) {
-        fprintf(stderr, "ERRO: %s não foi encontrado ou não pôde ser carregado.\n", flag_image_filename);
-        stbi_image_free(cover_img_data);
-        *total_image_symbols_count = 0;
-        return NULL;
-    }
-    if (flag_w_file != FLAG_IMG_WIDTH || flag_h_file != FLAG_IMG_HEIGHT) {
-         fprintf(stderr, "Aviso: Dimensões de %s (%dx%d) diferem do esperado (%dx%d) para a flag.\n",
-                flag_image_filename, flag_w_file, flag_h_file, FLAG_IMG_WIDTH, FLAG_IMG_HEIGHT);
-    }
-
-    int max_symbols_needed = 0;
-    for (int y_coord = 0; y_coord < COVER_IMG_HEIGHT; ++y_coord) {
-        for (int chan_idx = 0; chan_idx < 3; ++chan_idx) { // R, G, B
-            max_symbols_needed++;
-            max_symbols_needed++;
-            max_symbols_needed += (COVER_IMG_WIDTH - 1);
-            max_symbols_needed++;
-            if (y_coord >= FLAG_IMG_POS_Y && y_coord < FLAG_IMG_POS_Y + FLAG_IMG_HEIGHT) {
-                max_symbols_needed += (FLAG_IMG_WIDTH + 2); // (pixels + 2 sync)
+// --multi: várias capas (separadas por vírgula) do mesmo modo e com a mesma flag,
+// codificadas num passo só. Sem split sai um WAV com um canal por capa; com split,
+// um arquivo mono por capa.
+static int run_multichannel(const char* list, const SstvMode* mode, const SynthConfig* cfg, int use_cache,
+                            int split, int to_stdout, double min_psnr, FILE* info) {
+    char paths[MULTICHANNEL_MAX][BATCH_PATH_MAX];
+    char outputs[MULTICHANNEL_MAX][BATCH_PATH_MAX];
+    const char* targets[MULTICHANNEL_MAX];
+    SstvImages imgs[MULTICHANNEL_MAX];
+    SstvImages flag = { 0 };
+    int count = 0;
+    for (const char* p = list; *p; ) {
+        const char* comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len > 0) {
+            if (count == MULTICHANNEL_MAX || len >= BATCH_PATH_MAX) {
+                fprintf(stderr, "ERRO: --multi aceita até %d capas com caminhos de até %d caracteres.\n",
+                        MULTICHANNEL_MAX, BATCH_PATH_MAX - 1);
+                return 1;
             }
+            memcpy(paths[count], p, len);
+            paths[count++][len] = '\0';
         }
+        p += comma ? len + 1 : len;
     }
-
-    AudioSymbol** image_syms_array = (AudioSymbol**)malloc(max_symbols_needed * sizeof(AudioSymbol*));
-    if (!image_syms_array) {
-        perror("malloc image_syms_array");
-        stbi_image_free(cover_img_data); stbi_image_free(flag_img_data);
-        *total_image_symbols_count = 0; return NULL;
+    if (count == 0) {
+        fprintf(stderr, "ERRO: --multi sem capas.\n");
+        return 1;
+    }
+    if (split && to_stdout) {
+        fprintf(stderr, "ERRO: --split grava um arquivo por canal; não combina com --stdout.\n");
+        return 1;
     }
 
-    int current_sym_idx = 0;
-    double time_per_cover_pixel = SSTV_COLOR_SCANLINE_DURATION / COVER_IMG_WIDTH;
-
-    for (int y = 0; y < COVER_IMG_HEIGHT; ++y) {
-        for (int chan_map_idx = 0; chan_map_idx < 3; ++chan_map_idx) { // 0=R, 1=G, 2=B
-            image_syms_array[current_sym_idx] = create_tone_symbol(SSTV_HSYNC_DURATION, SSTV_HSYNC_FREQ, 1.0, 0.0);
-            if (!image_syms_array[current_sym_idx++]) goto cleanup_img_data_error;
-
-            image_syms_array[current_sym_idx] = create_tone_symbol(time_per_cover_pixel / 2.0, SSTV_PORCH_FREQ, 1.0, 0.0);
-            if (!image_syms_array[current_sym_idx++]) goto cleanup_img_data_error;
-
-            for (int x = 0; x < COVER_IMG_WIDTH - 1; ++x) {
-                int current_pixel_offset = (y * cover_w + x) * cover_channels_file;
-                int next_pixel_offset = (y * cover_w + x + 1) * cover_channels_file;
-                
-                int actual_chan_idx_for_cover = chan_map_idx;
-                if (actual_chan_idx_for_cover >= cover_channels_file) {
-                    actual_chan_idx_for_cover = cover_channels_file - 1;
-                }
-                if (actual_chan_idx_for_cover < 0) actual_chan_idx_for_cover = 0;
-
-                uint8_t val1 = cover_img_data[current_pixel_offset + actual_chan_idx_for_cover];
-                uint8_t val2 = cover_img_data[next_pixel_offset + actual_chan_idx_for_cover];
-
-                double freq_start = SSTV_PIXEL_FREQ_MIN + SSTV_PIXEL_FREQ_RANGE * val1 / 255.0;
-                double freq_end = SSTV_PIXEL_FREQ_MIN + SSTV_PIXEL_FREQ_RANGE * val2 / 255.0;
-                image_syms_array[current_sym_idx] = create_sweep_symbol(time_per_cover_pixel, freq_start, freq_end, 1.0, 0.0);
-                if (!image_syms_array[current_sym_idx++]) goto cleanup_img_data_error;
-            }
+    StatsMark mark;
+    STATS_BEGIN(cfg->stats, mark);
+    int loaded = 0;
+    int status = mode->has_flag && load_flag_image(FLAG_IMG_FILENAME, &flag) < 0 ? 1 : 0;
+    for (; status == 0 && loaded < count; ++loaded) {
+        memset(&imgs[loaded], 0, sizeof(SstvImages));
+        if (load_cover_image(paths[loaded], mode, &imgs[loaded]) < 0) { status = 1; break; }
+        imgs[loaded].flag = flag.flag;
+        imgs[loaded].flag_w = flag.flag_w;
+        imgs[loaded].flag_h = flag.flag_h;
+        if (split) snprintf(outputs[loaded], sizeof(outputs[loaded]), OUTPUT_CHANNEL_PATTERN, loaded + 1);
+        targets[loaded] = split ? outputs[loaded] : to_stdout ? NULL : OUTPUT_FILENAME;
+    }
+    STATS_END(cfg->stats, STATS_LOAD, mark);
+
+    PcmCache cache;
+    if (use_cache && pcm_cache_init(&cache, cfg) < 0) use_cache = 0;
+    if (status == 0) {
+        fprintf(info, "Gerando %d canais num passo só (%s)...\n", count, split ? "um arquivo por canal" : "intercalados");
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        long long frames = encode_frames_multichannel(mode, imgs, count, cfg, use_cache ? &cache : NULL,
+                                                      targets, split);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (frames > 0) {
+            double elapsed = elapsed_seconds(&t0, &t1);
+            if (elapsed <= 0.0) elapsed = 1e-9;
+            for (int c = 0; c < count && split; ++c) fprintf(info, "Arquivo WAV salvo em: %s\n", outputs[c]);
+            if (!split) fprintf(info, "Arquivo WAV salvo em: %s\n", to_stdout ? "<stdout>" : OUTPUT_FILENAME);
+            fprintf(info, "%d canais x %lld amostras em %.3f s (%.3e amostras/s)\n", count, frames, elapsed,
+                    (double)frames * count / elapsed);
+        } else {
+            fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
+            status = 1;
+        }
+    }
+    if (use_cache) {
+        fprintf(info, "Cache de PCM: %lld acertos, %lld trechos gerados (%zu KB)\n",
+                cache.hits, cache.misses, cache.bytes / 1024);
+        pcm_cache_free(&cache);
+    }
 
-            image_syms_array[current_sym_idx] = create_tone_symbol(time_per_cover_pixel / 2.0, SSTV_PORCH_FREQ, 1.0, 0.0);
-            if (!image_syms_array[current_sym_idx++]) goto cleanup_img_data_error;
-
-            if (y >= FLAG_IMG_POS_Y && y < FLAG_IMG_POS_Y + FLAG_IMG_HEIGHT) {
-                int flag_row_y_idx = y - FLAG_IMG_POS_Y;
-                uint8_t* current_flag_row_ptr = &flag_img_data[flag_row_y_idx * flag_w_file];
-
-                int flag_segment_sym_count;
-                AudioSymbol** flag_syms_for_row = convert_flag_row_to_symbols(
-                    current_flag_row_ptr, FLAG_IMG_WIDTH, SSTV_FLAG_SEGMENT_TOTAL_DURATION, &flag_segment_sym_count
-                );
-
-                if (flag_syms_for_row) {
-                    for (int k = 0; k < flag_segment_sym_count; ++k) {
-                        if (current_sym_idx >= max_symbols_needed) {
-                            fprintf(stderr, "ERRO: Tentativa de exceder max_symbols_needed ao adicionar flag.\n");
-                            free_audio_symbols_array(flag_syms_for_row, flag_segment_sym_count);
-                            goto cleanup_img_data_error;
-                        }
-                        image_syms_array[current_sym_idx++] = flag_syms_for_row[k];
-                    }
-                    free(flag_syms_for_row);
-                } else {
-                    fprintf(stderr, "Falha ao gerar símbolos para a linha da flag y=%d. Pulando inserção da flag.\n", y);
-                }
+    if (status == 0 && min_psnr >= 0.0) {
+        if (to_stdout) fprintf(stderr, "Aviso: --verify precisa de saída em arquivo; verificação ignorada.\n");
+        for (int c = 0; c < count && !to_stdout; ++c) {
+            char label[BATCH_PATH_MAX + 16];
+            snprintf(label, sizeof(label), "[canal %d] %s: ", c + 1, paths[c]);
+            if (verify_output(split ? outputs[c] : OUTPUT_FILENAME, split ? 0 : c, mode, &imgs[c], min_psnr,
+                              info, label) < 0) {
+                status = 1;
             }
         }
     }
 
-    stbi_image_free(cover_img_data);
-    stbi_image_free(flag_img_data);
-    *total_image_symbols_count = current_sym_idx;
-    assert(current_sym_idx <= max_symbols_needed);
-    return image_syms_array;
-
-cleanup_img_data_error:
-    fprintf(stderr, "ERRO: Falha de alocação em generate_image_data_symbols. Limpando...\n");
-    free_audio_symbols_array(image_syms_array, current_sym_idx);
-    stbi_image_free(cover_img_data);
-    stbi_image_free(flag_img_data);
-    *total_image_symbols_count = 0;
-    return NULL;
-}
-
-AudioSymbol* create_silence_symbol(double duration) {
-    Silence* s = (Silence*)malloc(sizeof(Silence));
-    if (!s) { perror("malloc Silence"); return NULL; }
-    s->base.duration = duration;
-    s->base.type = SILENCE_SYMBOL;
-    return (AudioSymbol*)s;
-}
-
-AudioSymbol* create_tone_symbol(double duration, double freq, double amp, double phase_offset_rad) {
-    Tone* t = (Tone*)malloc(sizeof(Tone));
-    if (!t) { perror("malloc Tone"); return NULL; }
-    t->base.duration = duration;
-    t->base.type = TONE_SYMBOL;
-    t->frequency = freq;
-    t->amplitude = amp;
-    t->phase_offset = phase_offset_rad;
-    return (AudioSymbol*)t;
+    for (int c = 0; c < loaded; ++c) free_cover_image(&imgs[c]);
+    free_flag_image(&flag);
+    return status;
 }
 
-AudioSymbol* create_sweep_symbol(double duration, double f_start, double f_end, double amp, double phase_offset_rad) {
-    LinearSweep* sw = (LinearSweep*)malloc(sizeof(LinearSweep));
-    if (!sw) { perror("malloc LinearSweep"); return NULL; }
-    sw->base.duration = duration;
-    sw->base.type = LINEAR_SWEEP_SYMBOL;
-    sw->freqstart = f_start;
-    sw->freqend = f_end;
-    sw->amplitude = amp;
-    sw->phase_offset = phase_offset_rad;
-    return (AudioSymbol*)sw;
-}
-
-void save_wav_file(const char* filename, int samplerate_local, int16_t* data, int length) {
-    if (!data || length == 0) {
-        fprintf(stderr, "Dados de áudio inválidos para salvar.\n");
-        return;
+// A tabela sai junto com as mensagens; o JSON vai para stderr (ou para
+// --stats-out) para não se misturar às linhas de progresso em stdout.
+static int write_stats(const SstvStats* st, int json, const char* path, FILE* info) {
+    if (!path) {
+        print_stats(json ? stderr : info, st, json);
+        return 0;
     }
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        fprintf(stderr, "Não foi possível abrir o arquivo %s para escrita.\n", filename);
-        return;
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
     }
-    char riff_id[4] = {'R', 'I', 'F', 'F'};
-    int32_t chunk_size = 36 + length * sizeof(int16_t);
-    char wave_id[4] = {'W', 'A', 'V', 'E'};
-    char fmt_id[4] = {'f', 'm', 't', ' '};
-    int32_t subchunk1_size = 16; int16_t audio_format = 1; int16_t num_channels = 1;
-    int32_t local_samplerate_val = samplerate_local;
-    int32_t byte_rate = local_samplerate_val * num_channels * sizeof(int16_t);
-    int16_t block_align = num_channels * sizeof(int16_t);
-    int16_t bits_per_sample = sizeof(int16_t) * 8;
-    char data_id[4] = {'d', 'a', 't', 'a'};
-    int32_t subchunk2_size = length * sizeof(int16_t);
-
-    fwrite(riff_id, 1, 4, file); fwrite(&chunk_size, sizeof(chunk_size), 1, file);
-    fwrite(wave_id, 1, 4, file); fwrite(fmt_id, 1, 4, file);
-    fwrite(&subchunk1_size, sizeof(subchunk1_size), 1, file);
-    fwrite(&audio_format, sizeof(audio_format), 1, file);
-    fwrite(&num_channels, sizeof(num_channels), 1, file);
-    fwrite(&local_samplerate_val, sizeof(local_samplerate_val), 1, file);
-    fwrite(&byte_rate, sizeof(byte_rate), 1, file);
-    fwrite(&block_align, sizeof(block_align), 1, file);
-    fwrite(&bits_per_sample, sizeof(bits_per_sample), 1, file);
-    fwrite(data_id, 1, 4, file); fwrite(&subchunk2_size, sizeof(subchunk2_size), 1, file);
-    fwrite(data, sizeof(int16_t), length, file);
-    fclose(file);
-    printf("Arquivo WAV salvo em: %s (%d amostras)\n", filename, length);
-}
-
-void free_audio_symbols_array(AudioSymbol** syms, int sym_count) {
-    if (!syms) return;
-    for (int i = 0; i < sym_count; ++i) {
-        free(syms[i]);
+    print_stats(f, st, json);
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
     }
-    free(syms);
+    return 0;
 }
 
-int main() {
-    printf("Iniciando geração de sinal SSTV (versão aprimorada)...\n");
-
-    AudioSymbol* initial_silence = create_silence_symbol(SSTV_SILENCE_DURATION);
-    if (!initial_silence) return 1;
-
-    int vox_sym_count = 0;
-    AudioSymbol** vox_syms = generate_vox_signal(&vox_sym_count);
-    if (!vox_syms) {
-        free(initial_silence);
+// --render: sintetiza um cronograma compilado (--compile) já mapeado.
+static int run_render(const PackedSchedule* ps, const char* path, const SynthConfig* cfg, int use_cache,
+                      int to_stdout, FILE* info) {
+    PcmCache cache;
+    const char* target = to_stdout ? NULL : OUTPUT_FILENAME;
+    if (use_cache && pcm_cache_init(&cache, cfg) < 0) use_cache = 0;
+    fprintf(info, "Sintetizando %s (%llu registros, %llu amostras)...\n", path,
+            (unsigned long long)ps->header->count, (unsigned long long)ps->header->total_samples);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long long written = render_packed_schedule(ps, cfg, use_cache ? &cache : NULL, target);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (use_cache) pcm_cache_free(&cache);
+    if (written <= 0) {
+        fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
         return 1;
     }
+    double elapsed = elapsed_seconds(&t0, &t1);
+    if (elapsed <= 0.0) elapsed = 1e-9;
+    fprintf(info, "Arquivo WAV salvo em: %s (%lld amostras em %.1f ms, %.3e amostras/s)\n",
+            to_stdout ? "<stdout>" : target, written, elapsed * 1000.0, written / elapsed);
+    return 0;
+}
 
-    int vis_sym_count = 0;
-    AudioSymbol** vis_syms = generate_vis_signal(&vis_sym_count);
-    if (!vis_syms) {
-        free(initial_silence);
-        free_audio_symbols_array(vox_syms, vox_sym_count);
-        return 1;
+static int encode_from_schedule(const SymbolSchedule* sstv_schedule, const SynthConfig* synth_cfg, FILE* info,
+                                int to_stdout, int buffered, int threads, int engine_check) {
+    if (engine_check) {
+        double snr_db;
+        int max_abs_err;
+        if (measure_engine_error(sstv_schedule, synth_cfg, &snr_db, &max_abs_err) < 0) return 1;
+        fprintf(info, "Motor vs. libm: SNR %.2f dB, erro máximo %d LSB\n", snr_db, max_abs_err);
+        return 0;
     }
 
-    int image_data_sym_count = 0;
-    AudioSymbol** image_data_syms = generate_image_data_symbols(COVER_IMG_FILENAME, FLAG_IMG_FILENAME, &image_data_sym_count);
-    if (!image_data_syms) {
-        free(initial_silence);
-        free_audio_symbols_array(vox_syms, vox_sym_count);
-        free_audio_symbols_array(vis_syms, vis_sym_count);
-        return 1;
+    int status = 0;
+    fprintf(info, "Gerando amostras WAV (%d símbolos totais)...\n", sstv_schedule->count);
+    if ((buffered || threads > 1) && !to_stdout) {
+        // O cronograma inteiro é sintetizado direto no arquivo mapeado quando possível;
+        // senão, num buffer que vai para o disco numa única escrita.
+        long long total = schedule_total_samples(sstv_schedule);
+        WavFileSink wfs;
+        SampleSink sink;
+        if (total <= 0 || total > INT32_MAX) {
+            fprintf(stderr, "ERRO: Número de amostras inválido para o modo buffered: %lld\n", total);
+            return 1;
+        }
+        if (open_wav_file_sink(&wfs, &sink, OUTPUT_FILENAME, synth_cfg->samplerate, synth_cfg->format, 1, total) < 0) {
+            return 1;
+        }
+        int16_t* dst = sink.direct(sink.ctx, 0, total);
+        int16_t* owned = NULL;
+        if (!dst) {
+            dst = owned = (int16_t*)malloc(total * sizeof(int16_t));
+            STATS_ALLOC(synth_cfg->stats, total * sizeof(int16_t));
+        }
+        StatsMark mark;
+        if (!dst) {
+            perror("malloc para buffer WAV falhou");
+            status = 1;
+        } else if (threads > 1) {
+            if (render_schedule_parallel(sstv_schedule, synth_cfg, threads, dst) < 0) status = 1;
+        } else {
+            STATS_BEGIN(synth_cfg->stats, mark);
+            SynthCursor cursor;
+            synth_cursor_init(&cursor, sstv_schedule, synth_cfg);
+            synth_render(&cursor, dst, (int)total);
+            STATS_END(synth_cfg->stats, STATS_SYNTH, mark);
+        }
+        STATS_BEGIN(synth_cfg->stats, mark);
+        if (status == 0 && sink.write(sink.ctx, dst, (int)total) < 0) status = 1;
+        if (sink.close(sink.ctx, status == 0 ? total : 0) < 0) status = 1;
+        STATS_END(synth_cfg->stats, STATS_OUTPUT, mark);
+        if (status == 0) STATS_SAMPLES(synth_cfg->stats, total);
+        free(owned);
+        if (status == 0) {
+            fprintf(info, "Arquivo WAV salvo em: %s (%lld amostras)\n", OUTPUT_FILENAME, total);
+        } else {
+            fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
+        }
+    } else {
+        WavFileSink wfs;
+        SampleSink sink;
+        const char* target = to_stdout ? NULL : OUTPUT_FILENAME;
+        long long expected = schedule_total_samples(sstv_schedule);
+        long long written = -1;
+        if (open_wav_file_sink(&wfs, &sink, target, synth_cfg->samplerate, synth_cfg->format, 1, expected) == 0) {
+            written = stream_wav(sstv_schedule, synth_cfg, &sink);
+        }
+        if (written > 0) {
+            fprintf(info, "Arquivo WAV salvo em: %s (%lld amostras)\n", to_stdout ? "<stdout>" : target, written);
+        } else {
+            fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
+            status = 1;
+        }
     }
+    return status;
+}
 
-    int eof_sym_count = 0;
-    AudioSymbol** eof_syms = generate_eof_signal(&eof_sym_count);
-    if (!eof_syms) {
-        free(initial_silence);
-        free_audio_symbols_array(vox_syms, vox_sym_count);
-        free_audio_symbols_array(vis_syms, vis_sym_count);
-        free_audio_symbols_array(image_data_syms, image_data_sym_count);
-        return 1;
+int main(int argc, char** argv) {
+    int to_stdout = 0;
+    int buffered = 0;
+    int engine_check = 0;
+    int use_symbol_array = 0;
+    int incremental = 0;
+    int use_pcm_cache = 0; // o cache muda as amostras; só com --pcm-cache, em qualquer caminho
+    const char* isa = NULL;
+    const char* batch_path = NULL;
+    const char* multi_list = NULL;
+    int split = 0;
+    const char* compile_path = NULL;
+    const char* render_path = NULL;
+    const SstvMode* mode = find_sstv_mode("classico");
+    int threads = 1;
+    int threads_set = 0;
+    int realtime = 0;
+    int verify = 0;
+    double min_psnr = VERIFY_DEFAULT_MIN_PSNR;
+    const char* decode_path = NULL;
+    const char* decode_out = NULL;
+    int mode_set = 0;
+    int stats_mode = 0; // 1: tabela, 2: JSON
+    const char* stats_out = NULL;
+    SstvStats stats;
+    stats_init(&stats);
+    RealtimeOptions rt = { 0 };
+    double block_ms = 10.0;
+    double lead_ms = 50.0;
+    clock_gettime(CLOCK_MONOTONIC, &rt.origin);
+    SynthEngine engine = SYNTH_ENGINE_LIBM;
+    int engine_set = 0;
+    int samplerate = SAMPLERATE;
+    int rate_set = 0;
+    SampleFormat format = SAMPLE_FORMAT_INT16;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stdout") == 0) to_stdout = 1;
+        else if (strcmp(argv[i], "--buffered") == 0) buffered = 1;
+        else if (strcmp(argv[i], "--engine-check") == 0) engine_check = 1;
+        else if (strcmp(argv[i], "--symbol-array") == 0) use_symbol_array = 1;
+        else if (strcmp(argv[i], "--pcm-cache") == 0) use_pcm_cache = 1;
+        else if (strcmp(argv[i], "--no-pcm-cache") == 0) use_pcm_cache = 0;
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batch_path = argv[++i];
+        else if (strcmp(argv[i], "--incremental") == 0) incremental = 1;
+        else if (strcmp(argv[i], "--multi") == 0 && i + 1 < argc) multi_list = argv[++i];
+        else if (strcmp(argv[i], "--split") == 0) split = 1;
+        else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) compile_path = argv[++i];
+        else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) render_path = argv[++i];
+        else if (strcmp(argv[i], "--realtime") == 0) realtime = 1;
+        else if (strcmp(argv[i], "--verify") == 0) verify = 1;
+        else if (strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc) {
+            min_psnr = atof(argv[++i]);
+            verify = 1;
+        } else if (strcmp(argv[i], "--decode") == 0 && i + 1 < argc) {
+            decode_path = argv[++i];
+        } else if (strcmp(argv[i], "--decode-out") == 0 && i + 1 < argc) {
+            decode_out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats") == 0) stats_mode = 1;
+        else if (strcmp(argv[i], "--stats=json") == 0) stats_mode = 2;
+        else if (strcmp(argv[i], "--stats-out") == 0 && i + 1 < argc) stats_out = argv[++i];
+        else if (strcmp(argv[i], "--raw") == 0) rt.raw = 1;
+        else if (strcmp(argv[i], "--pace") == 0) rt.pace = 1;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) rt.target = argv[++i];
+        else if (strcmp(argv[i], "--block-ms") == 0 && i + 1 < argc) {
+            block_ms = atof(argv[++i]);
+            if (block_ms < 1.0 || block_ms > 1000.0) {
+                fprintf(stderr, "ERRO: Tamanho de bloco fora do intervalo 1-1000 ms: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--lead-ms") == 0 && i + 1 < argc) {
+            lead_ms = atof(argv[++i]);
+            if (lead_ms < 0.0) lead_ms = 0.0;
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            if (parse_synth_engine(argv[++i], &engine) < 0) return 1;
+            engine_set = 1;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            samplerate = atoi(argv[++i]);
+            rate_set = 1;
+            if (samplerate < 8000 || samplerate > 384000) {
+                fprintf(stderr, "ERRO: Taxa de amostragem fora do intervalo 8000-384000 Hz: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (parse_sample_format(argv[++i], &format) < 0) {
+                fprintf(stderr, "ERRO: Formato de amostra desconhecido: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            mode = find_sstv_mode(argv[++i]);
+            mode_set = 1;
+            if (!mode) {
+                fprintf(stderr, "ERRO: Modo SSTV desconhecido: %s. Modos disponíveis:\n", argv[i]);
+                print_sstv_modes(stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            isa = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads <= 0) threads = default_thread_count();
+            threads_set = 1;
+        } else {
+            fprintf(stderr, "Uso: %s [--stdout] [--buffered] [--engine libm|nco|simd] [--isa scalar|sse4.2|avx2|avx512]"
+                            " [--threads N (0 = todos os núcleos)] [--symbol-array] [--pcm-cache|--no-pcm-cache]"
+                            " [--engine-check] [--batch manifesto|diretório [--incremental]]"
+                            " [--multi capa1,capa2,... [--split]] [--compile arquivo.ssts] [--render arquivo.ssts]"
+                            " [--mode nome] [--rate Hz]"
+                            " [--format int16|float32|u8|mulaw] [--realtime [--raw] [--pace] [--block-ms N]"
+                            " [--lead-ms N] [--output arquivo|FIFO]] [--stats[=json] [--stats-out arquivo]] [--verify [--min-psnr dB]]"
+                            " [--decode arquivo.wav [--decode-out imagem.ppm]]\n", argv[0]);
+            fprintf(stderr, "Modos:\n");
+            print_sstv_modes(stderr);
+            return 1;
+        }
     }
-
-    AudioSymbol* final_silence = create_silence_symbol(SSTV_SILENCE_DURATION);
-    if (!final_silence) {
-        perror("malloc final_silence");
-        free(initial_silence);
-        free_audio_symbols_array(vox_syms, vox_sym_count);
-        free_audio_symbols_array(vis_syms, vis_sym_count);
-        free_audio_symbols_array(image_data_syms, image_data_sym_count);
-        free_audio_symbols_array(eof_syms, eof_sym_count);
-        return 1;
+    // Com --stdout o áudio sai pela saída padrão; mensagens vão para stderr.
+    if (realtime && !rt.target) to_stdout = 1;
+    FILE* info = to_stdout ? stderr : stdout;
+
+    if (decode_path) return run_decode(decode_path, mode_set ? mode : NULL, decode_out, info);
+
+    // O cronograma compilado já traz modo e taxa.
+    PackedSchedule packed;
+    if (render_path) {
+        if (map_packed_schedule(render_path, &packed) < 0) return 1;
+        if ((rate_set && (uint32_t)samplerate != packed.header->samplerate) || (mode_set && mode != packed.mode)) {
+            fprintf(stderr, "ERRO: %s foi compilado para %s a %u Hz.\n", render_path, packed.mode->name,
+                    packed.header->samplerate);
+            unmap_packed_schedule(&packed);
+            return 1;
+        }
+        samplerate = (int)packed.header->samplerate;
+        mode = packed.mode;
     }
 
-
-    int total_sstv_symbols = 1 + vox_sym_count + vis_sym_count + image_data_sym_count + eof_sym_count + 1;
-    AudioSymbol** sstv_signal_array = (AudioSymbol**)malloc(total_sstv_symbols * sizeof(AudioSymbol*));
-    if (!sstv_signal_array) {
-        perror("malloc sstv_signal_array");
-        free(initial_silence);
-        free_audio_symbols_array(vox_syms, vox_sym_count);
-        free_audio_symbols_array(vis_syms, vis_sym_count);
-        free_audio_symbols_array(image_data_syms, image_data_sym_count);
-        free_audio_symbols_array(eof_syms, eof_sym_count);
-        free(final_silence);
-        return 1;
+    fprintf(info, "Iniciando geração de sinal SSTV (versão aprimorada)...\n");
+
+    // A renderização paralela parte da fase de início de cada tarefa. No libm ela
+    // não tem forma fechada e a passada de prefixo serial custa quase uma síntese,
+    // então --threads vai para o SIMD, a menos que o libm seja pedido.
+    int parallel_render = threads > 1 && !batch_path && !multi_list && !render_path && !compile_path && !realtime;
+    if (parallel_render && engine == SYNTH_ENGINE_LIBM) {
+        if (!engine_set) {
+            engine = SYNTH_ENGINE_SIMD;
+            fprintf(info, "--threads: motor simd (o libm não escala; --engine libm o mantém)\n");
+        } else {
+            fprintf(stderr, "Aviso: com --engine libm a passada de prefixo é serial e limita o ganho de --threads.\n");
+        }
     }
 
-    int current_sstv_idx = 0;
-    sstv_signal_array[current_sstv_idx++] = initial_silence;
-    for (int i = 0; i < vox_sym_count; ++i) sstv_signal_array[current_sstv_idx++] = vox_syms[i];
-    for (int i = 0; i < vis_sym_count; ++i) sstv_signal_array[current_sstv_idx++] = vis_syms[i];
-    for (int i = 0; i < image_data_sym_count; ++i) sstv_signal_array[current_sstv_idx++] = image_data_syms[i];
-    for (int i = 0; i < eof_sym_count; ++i) sstv_signal_array[current_sstv_idx++] = eof_syms[i];
-    sstv_signal_array[current_sstv_idx++] = final_silence;
-    assert(current_sstv_idx == total_sstv_symbols);
-
-    printf("Gerando amostras WAV (%d símbolos totais)...\n", total_sstv_symbols);
-    int wav_output_length;
-    int16_t* wav_data_output = generate_wav(sstv_signal_array, total_sstv_symbols, SAMPLERATE, &wav_output_length);
+    SynthConfig synth_cfg;
+    synth_config_init(&synth_cfg, engine, samplerate);
+    synth_cfg.format = format;
+    if (isa && synth_config_force_isa(&synth_cfg, isa) < 0) return 1;
+    if (stats_out && !stats_mode) stats_mode = 2;
+    if (stats_mode && !STATS_ENABLED) {
+        fprintf(stderr, "Aviso: --stats ignorado; compilado com -DSSTV_NO_STATS.\n");
+        stats_mode = 0;
+    }
+    if (stats_mode) synth_cfg.stats = &stats;
+    if (engine == SYNTH_ENGINE_SIMD) fprintf(info, "Motor de síntese: simd (kernel %s)\n", synth_cfg.poly_isa);
+    else fprintf(info, "Motor de síntese: %s\n", synth_engine_name(engine));
+    fprintf(info, "Modo: %s (%dx%d), %d Hz, %s\n", mode->description, mode->width, mode->height,
+            samplerate, sample_format_info(format)->name);
+
+    if (render_path) {
+        int render_status = run_render(&packed, render_path, &synth_cfg, use_pcm_cache, to_stdout, info);
+        unmap_packed_schedule(&packed);
+        if (stats_mode && write_stats(&stats, stats_mode == 2, stats_out, info) < 0) render_status = 1;
+        fprintf(info, "Concluído.\n");
+        return render_status;
+    }
+    if (batch_path) {
+        int batch_status = run_batch(batch_path, mode, &synth_cfg, threads_set ? threads : default_thread_count(),
+                                     use_pcm_cache, incremental, verify ? min_psnr : -1.0, info);
+        if (stats_mode && write_stats(&stats, stats_mode == 2, stats_out, info) < 0) batch_status = 1;
+        return batch_status;
+    }
+    if (multi_list) {
+        int multi_status = run_multichannel(multi_list, mode, &synth_cfg, use_pcm_cache, split, to_stdout,
+                                            verify ? min_psnr : -1.0, info);
+        if (stats_mode && write_stats(&stats, stats_mode == 2, stats_out, info) < 0) multi_status = 1;
+        fprintf(info, "Concluído.\n");
+        return multi_status;
+    }
 
-    if (wav_data_output && wav_output_length > 0) {
-        save_wav_file(OUTPUT_FILENAME, SAMPLERATE, wav_data_output, wav_output_length);
-        free(wav_data_output);
+    SstvImages images;
+    StatsMark mark;
+    STATS_BEGIN(synth_cfg.stats, mark);
+    if (load_sstv_images(mode, COVER_IMG_FILENAME, FLAG_IMG_FILENAME, &images) < 0) return 1;
+    STATS_END(synth_cfg.stats, STATS_LOAD, mark);
+
+    // O cronograma completo só é montado quando o caminho exige acesso aleatório
+    // aos símbolos; o padrão gera o PCM direto dos pixels.
+    int status = 0;
+    if (compile_path) {
+        long long symbols_in = 0, records = 0;
+        long long total = compile_frame_schedule(mode, &images, samplerate, compile_path, synth_cfg.stats,
+                                                 &symbols_in, &records);
+        if (total > 0) {
+            fprintf(info, "Cronograma compilado em: %s (%lld símbolos em %lld registros, %lld KB, %lld amostras)\n",
+                    compile_path, symbols_in, records,
+                    (long long)(sizeof(PackedScheduleHeader) + records * sizeof(PackedSymbol)) / 1024, total);
+        } else {
+            status = 1;
+        }
+    } else if (realtime) {
+        // Um consumidor que fecha o pipe deve virar erro de escrita, não SIGPIPE.
+        signal(SIGPIPE, SIG_IGN);
+        rt.block_samples = (int)(block_ms * samplerate / 1000.0);
+        if (rt.block_samples < 1) rt.block_samples = 1;
+        rt.lead_seconds = lead_ms / 1000.0;
+        long long written = encode_frame_realtime(mode, &images, &synth_cfg, &rt);
+        if (written > 0) {
+            fprintf(info, "Tempo real: %lld amostras em blocos de %d (%.1f ms)%s\n", written, rt.block_samples,
+                    1000.0 * rt.block_samples / samplerate, rt.pace ? ", no ritmo do relógio" : "");
+            fprintf(info, "Primeira amostra após %.2f ms; pior bloco %.3f ms; %lld blocos atrasados\n",
+                    rt.first_sample_seconds * 1000.0, rt.worst_block_seconds * 1000.0, rt.late_blocks);
+        } else {
+            fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
+            status = 1;
+        }
+    } else if (use_symbol_array || engine_check || buffered || threads > 1) {
+        SymbolSchedule sstv_schedule;
+        if (build_sstv_schedule(mode, &images, &sstv_schedule, synth_cfg.samplerate, synth_cfg.stats) < 0) {
+            free_sstv_images(&images);
+            return 1;
+        }
+        status = encode_from_schedule(&sstv_schedule, &synth_cfg, info, to_stdout, buffered, threads, engine_check);
+        schedule_free(&sstv_schedule);
     } else {
-        fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
-        free(wav_data_output);
+        PcmCache cache;
+        const char* target = to_stdout ? NULL : OUTPUT_FILENAME;
+        if (use_pcm_cache && pcm_cache_init(&cache, &synth_cfg) < 0) use_pcm_cache = 0;
+        fprintf(info, "Gerando amostras WAV direto dos pixels...\n");
+        long long written = encode_frame(mode, &images, &synth_cfg, use_pcm_cache ? &cache : NULL, target);
+        if (use_pcm_cache) {
+            fprintf(info, "Cache de PCM: %lld acertos, %lld trechos gerados (%zu KB)\n",
+                    cache.hits, cache.misses, cache.bytes / 1024);
+            pcm_cache_free(&cache);
+        }
+        if (written > 0) {
+            fprintf(info, "Arquivo WAV salvo em: %s (%lld amostras)\n", to_stdout ? "<stdout>" : target, written);
+        } else {
+            fprintf(stderr, "Falha ao gerar dados WAV ou dados WAV vazios.\n");
+            status = 1;
+        }
     }
 
-    free(initial_silence);
-    free_audio_symbols_array(vox_syms, vox_sym_count);
-    free_audio_symbols_array(vis_syms, vis_sym_count);
-    free_audio_symbols_array(image_data_syms, image_data_sym_count);
-    free_audio_symbols_array(eof_syms, eof_sym_count);
-    free(final_silence);
+    // A verificação relê o arquivo; com stdout ou FIFO não há o que reler.
+    if (verify && status == 0 && !engine_check && !compile_path) {
+        const char* written_path = realtime ? rt.target : to_stdout ? NULL : OUTPUT_FILENAME;
+        struct stat st;
+        if (!written_path || stat(written_path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Aviso: --verify precisa de saída em arquivo; verificação ignorada.\n");
+        } else if (verify_output(written_path, 0, mode, &images, min_psnr, info, "") < 0) {
+            status = 1;
+        }
+    }
 
-    free(sstv_signal_array);
+    free_sstv_images(&images);
 
-    printf("Concluído.\n");
-    return 0;
+    if (stats_mode && write_stats(&stats, stats_mode == 2, stats_out, info) < 0) status = 1;
+    fprintf(info, "Concluído.\n");
+    return status;
 }
@@ -0,0 +1,608 @@
+// Decodificador de verificação: demodula o áudio gerado pelo encoder de volta
+// para a imagem, para provar que um caminho de síntese novo ainda produz o mesmo
+// quadro. Cobre só os formatos que este encoder gera.
+//
+// Frequência instantânea: o sinal é deslocado por um oscilador de 1900 Hz (centro
+// da faixa 1100-2300 Hz), filtrado por três médias móveis em cascata e passado por
+// um discriminador de fase (ângulo entre amostras consecutivas). O VIS dá o modo;
+// os pulsos de sincronismo a 1200 Hz ancoram o tempo nominal do modo nas amostras
+// reais, o que também corrige a inclinação (deriva entre relógio nominal e real).
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sstvenc_internal.h"
+
+#define DEMOD_CENTER_FREQ 1900.0
+#define DEMOD_IMAGE_NULL_FREQ 3600.0 // zero das médias móveis sobre a imagem em -(f + 1900)
+#define DEMOD_STAGES 3
+
+#define SYNC_THRESHOLD_FREQ ((SSTV_HSYNC_FREQ + SSTV_PORCH_FREQ) / 2.0)
+#define SYNC_SEARCH_SECONDS 0.010
+#define VIS_TONE_TOLERANCE 50.0
+#define VIS_STANDARD_BITS 8 // 7 bits do código e paridade par
+#define VIS_CLASSIC_BITS 10
+
+// Frequência instantânea (Hz) de cada amostra, já compensada do atraso dos filtros.
+static float* demod_frequency(const int16_t* pcm, long long count, int samplerate_local) {
+    float* freq = (float*)malloc((size_t)count * sizeof(float));
+    int len = (int)lrint(samplerate_local / DEMOD_IMAGE_NULL_FREQ);
+    if (len < 1) len = 1;
+    double* hist = (double*)calloc((size_t)DEMOD_STAGES * 2 * len, sizeof(double));
+    if (!freq || !hist) {
+        perror("malloc demodulador");
+        free(freq);
+        free(hist);
+        return NULL;
+    }
+
+    double acc[DEMOD_STAGES][2] = { { 0.0 } };
+    double step = 2.0 * M_PI * DEMOD_CENTER_FREQ / samplerate_local;
+    double to_hz = samplerate_local / (2.0 * M_PI);
+    double osc_re = 1.0, osc_im = 0.0;
+    double rot_re = cos(step), rot_im = -sin(step);
+    double prev_re = 0.0, prev_im = 0.0;
+    long long delay = (long long)DEMOD_STAGES * (len - 1) / 2;
+    int pos = 0;
+    for (long long n = 0; n < count; ++n) {
+        double re = pcm[n] * osc_re, im = pcm[n] * osc_im;
+        double next_re = osc_re * rot_re - osc_im * rot_im;
+        osc_im = osc_re * rot_im + osc_im * rot_re;
+        osc_re = next_re;
+        if ((n & 1023) == 0) { // renormaliza o oscilador contra o acúmulo de erro
+            double norm = 1.0 / sqrt(osc_re * osc_re + osc_im * osc_im);
+            osc_re *= norm;
+            osc_im *= norm;
+        }
+        for (int s = 0; s < DEMOD_STAGES; ++s) {
+            double* h = &hist[((size_t)s * len + pos) * 2];
+            acc[s][0] += re - h[0];
+            acc[s][1] += im - h[1];
+            h[0] = re;
+            h[1] = im;
+            re = acc[s][0];
+            im = acc[s][1];
+        }
+        pos = pos + 1 == len ? 0 : pos + 1;
+
+        double cross = prev_re * im - prev_im * re;
+        double dot = prev_re * re + prev_im * im;
+        prev_re = re;
+        prev_im = im;
+        if (n >= delay) freq[n - delay] = (float)(DEMOD_CENTER_FREQ + atan2(cross, dot) * to_hz);
+    }
+    for (long long n = count - delay > 0 ? count - delay : 0; n < count; ++n) {
+        freq[n] = n > 0 ? freq[n - 1] : (float)DEMOD_CENTER_FREQ;
+    }
+    free(hist);
+    return freq;
+}
+
+static double mean_freq(const float* freq, long long count, long long a, long long b) {
+    if (a < 0) a = 0;
+    if (b > count) b = count;
+    if (b <= a) return 0.0;
+    double sum = 0.0;
+    for (long long n = a; n < b; ++n) sum += freq[n];
+    return sum / (double)(b - a);
+}
+
+static int near_freq(double f, double target) {
+    return fabs(f - target) < VIS_TONE_TOLERANCE;
+}
+
+// Fim do trecho que começa em `from` e fica perto de `target`.
+static long long tone_end(const float* freq, long long count, long long from, double target) {
+    while (from < count && near_freq(freq[from], target)) from++;
+    return from;
+}
+
+// Pula a transição entre dois tons (o tempo de subida dos filtros), no máximo `limit` amostras.
+static long long skip_transition(const float* freq, long long count, long long from, long long limit, double target) {
+    long long end = from + limit < count ? from + limit : count;
+    while (from < end && !near_freq(freq[from], target)) from++;
+    return from;
+}
+
+// Lê o cabeçalho VIS e devolve a amostra onde a imagem começa (ou -1). O formato
+// padrão tem líder de 300 ms, 7 bits e paridade; o clássico, líder de 30 ms e dez
+// bits alternados terminados por um bit de parada de 10 ms.
+static long long parse_vis(const float* freq, long long count, int samplerate_local, int* vis_code) {
+    long long min_break = (long long)(SSTV_VIS_BREAK_DURATION * 0.6 * samplerate_local);
+    long long bit = (long long)(SSTV_VIS_BIT_DURATION * samplerate_local);
+    for (long long n = 0; n < count; ++n) {
+        if (!near_freq(freq[n], SSTV_HSYNC_FREQ)) continue;
+        long long brk_end = tone_end(freq, count, n, SSTV_HSYNC_FREQ);
+        if (brk_end - n < min_break) { n = brk_end; continue; }
+        long long leader_start = skip_transition(freq, count, brk_end, min_break, SSTV_VIS_LEADER_FREQ);
+        long long leader_end = tone_end(freq, count, leader_start, SSTV_VIS_LEADER_FREQ);
+        if (leader_end - brk_end < bit / 2) { n = brk_end; continue; }
+        int classic = leader_end - brk_end < (long long)(0.1 * samplerate_local);
+
+        // Bit de início a 1200 Hz, as células de 30 ms e a parada, também a 1200 Hz
+        // (na imagem, logo seguida do primeiro sincronismo).
+        long long cell = leader_end + bit;
+        int bits[VIS_CLASSIC_BITS];
+        int nbits = classic ? VIS_CLASSIC_BITS : VIS_STANDARD_BITS;
+        int valid = 1;
+        for (int b = 0; b < nbits && valid; ++b, cell += bit) {
+            double f = mean_freq(freq, count, cell + bit / 5, cell + bit - bit / 5);
+            if (near_freq(f, SSTV_VIS_BIT_ONE_FREQ)) bits[b] = 1;
+            else if (near_freq(f, SSTV_VIS_BIT_ZERO_FREQ)) bits[b] = 0;
+            else valid = 0;
+        }
+        long long stop = (long long)(SSTV_VIS_HEADER_TONE_DURATION_SHORT * samplerate_local);
+        if (!valid || !near_freq(mean_freq(freq, count, cell + stop / 5, cell + stop - stop / 5), SSTV_HSYNC_FREQ)) {
+            n = brk_end;
+            continue;
+        }
+        if (classic) {
+            *vis_code = -1;
+            return cell + stop;
+        }
+        int code = 0, parity = 0;
+        for (int b = 0; b < 7; ++b) {
+            code |= bits[b] << b;
+            parity ^= bits[b];
+        }
+        if (parity == bits[7]) {
+            *vis_code = code;
+            return cell + bit;
+        }
+        n = brk_end;
+    }
+    return -1;
+}
+
+// Duração nominal de um elemento do programa da linha. Sem scan_edges a varredura
+// tem largura-1 rampas (o último valor é o fim da última rampa).
+static double element_duration(const SstvMode* mode, const SstvLineElement* el, int line) {
+    switch (el->kind) {
+    case LINE_SCAN:
+        return mode->scan_edges ? el->duration : el->duration * (mode->width - 1) / mode->width;
+    case LINE_FLAG:
+        return mode->has_flag && line >= FLAG_IMG_POS_Y && line < FLAG_IMG_POS_Y + FLAG_IMG_HEIGHT ?
+               SSTV_FLAG_SEGMENT_TOTAL_DURATION : 0.0;
+    default:
+        return el->duration;
+    }
+}
+
+static int is_sync_element(const SstvLineElement* el) {
+    return el->kind == LINE_TONE && el->segment == PCM_SEG_HSYNC;
+}
+
+// Tempos nominais (s, a partir do início da imagem) de todos os sincronismos.
+static int collect_sync_times(const SstvMode* mode, double* times, int max) {
+    int n = 0;
+    double t = 0.0;
+    if (mode->start_sync > 0.0 && n < max) {
+        times[n++] = 0.0;
+        t += mode->start_sync;
+    }
+    for (int line = 0; line < mode->height / mode->rows_per_line; ++line) {
+        for (int e = 0; e < mode->program_len; ++e) {
+            const SstvLineElement* el = &mode->program[e];
+            if (is_sync_element(el) && n < max) times[n++] = t;
+            t += element_duration(mode, el, line);
+        }
+    }
+    return n;
+}
+
+// Início do pulso de sincronismo dentro de [lo, hi): primeira borda de descida
+// abaixo do limiar seguida de pelo menos `min_len` amostras. Uma corrida que já
+// vinha de antes de `lo` é ignorada (no começo da imagem ela emenda com o VIS).
+static long long find_sync(const float* freq, long long count, long long lo, long long hi, long long min_len) {
+    if (lo < 1) lo = 1;
+    if (hi > count) hi = count;
+    for (long long n = lo; n < hi; ++n) {
+        if (freq[n] >= SYNC_THRESHOLD_FREQ || freq[n - 1] < SYNC_THRESHOLD_FREQ) continue;
+        long long end = n;
+        while (end < count && end - n < min_len && freq[end] < SYNC_THRESHOLD_FREQ) end++;
+        if (end - n >= min_len) return n;
+        n = end;
+    }
+    return -1;
+}
+
+// Âncoras (tempo nominal -> amostra) e interpolação linear entre elas.
+typedef struct {
+    const double* times;
+    const double* samples;
+    int count;
+    int hint;
+} TimeMap;
+
+static double map_time(TimeMap* map, double t) {
+    const double* T = map->times;
+    int n = map->count;
+    if (n == 1) return map->samples[0] + t - T[0];
+    int k = map->hint;
+    if (k > n - 2) k = n - 2;
+    while (k > 0 && t < T[k]) k--;
+    while (k < n - 2 && t >= T[k + 1]) k++;
+    map->hint = k;
+    return map->samples[k] + (t - T[k]) * (map->samples[k + 1] - map->samples[k]) / (T[k + 1] - T[k]);
+}
+
+static inline uint8_t freq_to_u8(double f, double fmin, double range) {
+    double v = (f - fmin) * 255.0 / range;
+    return v <= 0.0 ? 0 : v >= 255.0 ? 255 : (uint8_t)(v + 0.5);
+}
+
+static inline uint8_t clamp_pixel(double v) {
+    return v <= 0.0 ? 0 : v >= 255.0 ? 255 : (uint8_t)(v + 0.5);
+}
+
+typedef struct {
+    const float* freq;
+    long long count;
+    TimeMap map;
+    double rate;     // amostras por segundo nominal, já com a inclinação
+} DecodeCtx;
+
+// Valor de cada pixel da varredura: média da frequência numa janela de meio pixel
+// em torno do instante em que a rampa passa pelo valor do pixel.
+static void decode_scan(DecodeCtx* dc, const SstvMode* mode, double t0, double duration, uint8_t* out) {
+    int width = mode->width;
+    double pixel = mode->scan_edges ? duration / width : duration / (width - 1);
+    double lead = mode->scan_edges ? pixel / 2.0 : 0.0;
+    long long scan_a = (long long)map_time(&dc->map, t0);
+    long long scan_b = (long long)map_time(&dc->map, t0 + duration);
+    double half_window = pixel * dc->rate / 4.0;
+    if (half_window < 1.0) half_window = 1.0;
+    for (int x = 0; x < width; ++x) {
+        double center = map_time(&dc->map, t0 + lead + x * pixel);
+        long long a = (long long)(center - half_window);
+        long long b = (long long)(center + half_window) + 1;
+        if (a < scan_a) a = scan_a;
+        if (b > scan_b) b = scan_b;
+        if (b <= a) b = a + 1;
+        out[x] = freq_to_u8(mean_freq(dc->freq, dc->count, a, b), SSTV_PIXEL_FREQ_MIN, SSTV_PIXEL_FREQ_RANGE);
+    }
+}
+
+// Flag: 15% de padding a 2300 Hz, 16 tons constantes, 15% de padding. O valor de
+// cada pixel é a média dos 60% centrais do tom.
+static void decode_flag(DecodeCtx* dc, double t0, double* acc) {
+    double pad = SSTV_FLAG_SEGMENT_TOTAL_DURATION * 0.15;
+    double pixel = SSTV_FLAG_SEGMENT_TOTAL_DURATION * 0.70 / FLAG_IMG_WIDTH;
+    for (int x = 0; x < FLAG_IMG_WIDTH; ++x) {
+        double start = t0 + pad + x * pixel;
+        long long a = (long long)map_time(&dc->map, start + pixel * 0.2);
+        long long b = (long long)map_time(&dc->map, start + pixel * 0.8);
+        acc[x] += freq_to_u8(mean_freq(dc->freq, dc->count, a, b), SSTV_FLAG_PIXEL_FREQ_MIN,
+                             SSTV_FLAG_PIXEL_FREQ_RANGE);
+    }
+}
+
+// Converte os planos decodificados (um por canal e linha transmitida) em RGB.
+static void planes_to_rgb(const SstvMode* mode, uint8_t* planes[CH_COUNT], uint8_t* rgb) {
+    int width = mode->width;
+    int lines = mode->height / mode->rows_per_line;
+    for (int line = 0; line < lines; ++line) {
+        for (int r = 0; r < mode->rows_per_line; ++r) {
+            uint8_t* row = rgb + ((size_t)(line * mode->rows_per_line + r) * width) * 3;
+            for (int x = 0; x < width; ++x) {
+                size_t i = (size_t)line * width + x;
+                if (mode->color == SSTV_COLOR_RGB) {
+                    row[x * 3 + 0] = planes[CH_R][i];
+                    row[x * 3 + 1] = planes[CH_G][i];
+                    row[x * 3 + 2] = planes[CH_B][i];
+                    continue;
+                }
+                double Y = (r == 0 ? planes[CH_Y] : planes[CH_Y2])[i];
+                double cr, cb;
+                if (planes[CH_CHROMA_ALT]) {
+                    // Robot 36: R-Y nas linhas pares, B-Y nas ímpares; a outra vem da vizinha.
+                    int even = line & ~1, odd = (line | 1) < lines ? (line | 1) : line;
+                    cr = planes[CH_CHROMA_ALT][(size_t)even * width + x];
+                    cb = planes[CH_CHROMA_ALT][(size_t)odd * width + x];
+                } else {
+                    cr = planes[CH_CR][i];
+                    cb = planes[CH_CB][i];
+                }
+                // Inversa da BT.601 em faixa de estúdio usada pelo encoder.
+                double y = 1.164383 * (Y - 16.0);
+                row[x * 3 + 0] = clamp_pixel(y + 1.596027 * (cr - 128.0));
+                row[x * 3 + 1] = clamp_pixel(y - 0.391762 * (cb - 128.0) - 0.812968 * (cr - 128.0));
+                row[x * 3 + 2] = clamp_pixel(y + 2.017232 * (cb - 128.0));
+            }
+        }
+    }
+}
+
+// Decodifica um quadro inteiro. mode_hint (opcional) vale quando o VIS não é
+// encontrado; se o VIS indicar outro modo, o do VIS prevalece.
+int sstv_decode(const int16_t* pcm, long long count, int samplerate_local, const SstvMode* mode_hint,
+                SstvDecoded* out) {
+    memset(out, 0, sizeof(*out));
+    float* freq = demod_frequency(pcm, count, samplerate_local);
+    if (!freq) return -1;
+
+    int vis_code = -2;
+    long long image_start = parse_vis(freq, count, samplerate_local, &vis_code);
+    const SstvMode* mode = image_start >= 0 ? find_sstv_mode_by_vis(vis_code) : NULL;
+    out->vis_found = mode != NULL;
+    if (!mode) mode = mode_hint;
+    if (!mode) {
+        fprintf(stderr, "ERRO: Cabeçalho VIS não reconhecido e nenhum modo informado.\n");
+        free(freq);
+        return -1;
+    }
+    if (mode_hint && mode != mode_hint) {
+        fprintf(stderr, "Aviso: VIS indica o modo %s, não %s.\n", mode->name, mode_hint->name);
+    }
+    out->mode = mode;
+    out->vis_code = mode->vis_code;
+
+    // Ancoragem: cada sincronismo é procurado perto de onde a âncora anterior o prevê.
+    int lines = mode->height / mode->rows_per_line;
+    int max_syncs = 1 + lines * mode->program_len;
+    double* sync_times = (double*)malloc((size_t)max_syncs * sizeof(double));
+    double* anchor_t = (double*)malloc((size_t)max_syncs * sizeof(double));
+    double* anchor_s = (double*)malloc((size_t)max_syncs * sizeof(double));
+    size_t plane_bytes = (size_t)lines * mode->width;
+    uint8_t* plane_mem = (uint8_t*)calloc(CH_COUNT, plane_bytes);
+    out->rgb = (uint8_t*)malloc((size_t)mode->width * mode->height * 3);
+    if (!sync_times || !anchor_t || !anchor_s || !plane_mem || !out->rgb) {
+        perror("malloc decodificador");
+        free(sync_times); free(anchor_t); free(anchor_s); free(plane_mem); free(freq);
+        sstv_decoded_free(out);
+        return -1;
+    }
+    int nsync = collect_sync_times(mode, sync_times, max_syncs);
+    double rate = samplerate_local;
+    long long window = (long long)(SYNC_SEARCH_SECONDS * samplerate_local);
+    long long min_len = (long long)(SSTV_VIS_BREAK_DURATION * 0.3 * samplerate_local);
+    int nanchor = 0;
+    double origin = image_start >= 0 ? (double)image_start : 0.0;
+    int k = 0;
+    if (image_start >= 0 && nsync > 0) {
+        // O primeiro sincronismo emenda com o bit de parada: o fim do VIS é a âncora.
+        anchor_t[0] = sync_times[0];
+        anchor_s[0] = origin + sync_times[0] * rate;
+        nanchor = k = 1;
+    }
+    for (; k < nsync; ++k) {
+        double predicted = nanchor == 0 ? origin + sync_times[k] * rate
+                         : anchor_s[nanchor - 1] + (sync_times[k] - anchor_t[nanchor - 1]) * rate;
+        long long lo = (long long)predicted - window, hi = (long long)predicted + window;
+        if (nanchor == 0 && image_start < 0) { lo = 0; hi = count; }
+        long long found = find_sync(freq, count, lo, hi, min_len);
+        if (found < 0) continue;
+        if (nanchor > 0) {
+            double span = sync_times[k] - anchor_t[nanchor - 1];
+            if (span > 0.0) rate = (found - anchor_s[nanchor - 1]) / span;
+        }
+        anchor_t[nanchor] = sync_times[k];
+        anchor_s[nanchor] = (double)found;
+        nanchor++;
+    }
+    out->syncs_expected = nsync;
+    out->syncs_found = nanchor;
+    if (nanchor == 0) {
+        anchor_t[0] = 0.0;
+        anchor_s[0] = origin;
+        nanchor = 1;
+    }
+    out->slant = nanchor > 1 ? (anchor_s[nanchor - 1] - anchor_s[0]) /
+                               ((anchor_t[nanchor - 1] - anchor_t[0]) * samplerate_local) : 1.0;
+
+    DecodeCtx dc = { freq, count, { anchor_t, anchor_s, nanchor, 0 }, samplerate_local * out->slant };
+    uint8_t* planes[CH_COUNT] = { NULL };
+    double flag_acc[FLAG_IMG_HEIGHT][FLAG_IMG_WIDTH] = { { 0.0 } };
+    int flag_hits[FLAG_IMG_HEIGHT] = { 0 };
+    double t = mode->start_sync;
+    for (int line = 0; line < lines; ++line) {
+        for (int e = 0; e < mode->program_len; ++e) {
+            const SstvLineElement* el = &mode->program[e];
+            double duration = element_duration(mode, el, line);
+            if (el->kind == LINE_SCAN) {
+                planes[el->chan] = plane_mem + (size_t)el->chan * plane_bytes;
+                decode_scan(&dc, mode, t, duration, planes[el->chan] + (size_t)line * mode->width);
+            } else if (el->kind == LINE_FLAG && duration > 0.0) {
+                decode_flag(&dc, t, flag_acc[line - FLAG_IMG_POS_Y]);
+                flag_hits[line - FLAG_IMG_POS_Y]++;
+            }
+            t += duration;
+        }
+    }
+    planes_to_rgb(mode, planes, out->rgb);
+    for (int y = 0; y < FLAG_IMG_HEIGHT; ++y) {
+        for (int x = 0; x < FLAG_IMG_WIDTH; ++x) {
+            out->flag[y * FLAG_IMG_WIDTH + x] = flag_hits[y] ? clamp_pixel(flag_acc[y][x] / flag_hits[y]) : 0;
+        }
+    }
+
+    free(sync_times);
+    free(anchor_t);
+    free(anchor_s);
+    free(plane_mem);
+    free(freq);
+    return 0;
+}
+
+void sstv_decoded_free(SstvDecoded* dec) {
+    free(dec->rgb);
+    dec->rgb = NULL;
+}
+
+static double psnr_from_mse(double mse) {
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+// Compara com a imagem de entrada na mesma geometria que o encoder usa (coordenadas
+// além da imagem repetem a última linha/coluna).
+void sstv_decode_score(const SstvDecoded* dec, const SstvImages* img, SstvDecodeScore* score) {
+    const SstvMode* mode = dec->mode;
+    double sq = 0.0, abs_sum = 0.0;
+    int max_err = 0;
+    for (int y = 0; y < mode->height; ++y) {
+        int sy = y < img->cover_h ? y : img->cover_h - 1;
+        for (int x = 0; x < mode->width; ++x) {
+            int sx = x < img->cover_w ? x : img->cover_w - 1;
+            const uint8_t* px = img->cover + ((size_t)sy * img->cover_w + sx) * img->cover_channels;
+            for (int c = 0; c < 3; ++c) {
+                int src = px[c < img->cover_channels ? c : img->cover_channels - 1];
+                int err = abs(dec->rgb[((size_t)y * mode->width + x) * 3 + c] - src);
+                sq += (double)err * err;
+                abs_sum += err;
+                if (err > max_err) max_err = err;
+            }
+        }
+    }
+    double n = (double)mode->width * mode->height * 3;
+    score->psnr = psnr_from_mse(sq / n);
+    score->mean_abs_err = abs_sum / n;
+    score->max_err = max_err;
+
+    score->flag_psnr = 0.0;
+    if (mode->has_flag && img->flag) {
+        double fsq = 0.0;
+        for (int y = 0; y < FLAG_IMG_HEIGHT; ++y) {
+            for (int x = 0; x < FLAG_IMG_WIDTH; ++x) {
+                int src = img->flag[(y < img->flag_h ? y : img->flag_h - 1) * img->flag_w +
+                                    (x < img->flag_w ? x : img->flag_w - 1)];
+                int err = dec->flag[y * FLAG_IMG_WIDTH + x] - src;
+                fsq += (double)err * err;
+            }
+        }
+        score->flag_psnr = psnr_from_mse(fsq / (FLAG_IMG_WIDTH * FLAG_IMG_HEIGHT));
+    }
+}
+
+// Compara duas decodificações do mesmo modo. Contra a decodificação da referência
+// libm, as perdas do próprio modo (crominância compartilhada, banda da varredura,
+// resolução do demodulador) aparecem dos dois lados e se cancelam: sobra só o que
+// o caminho de síntese mudou.
+void sstv_decode_compare(const SstvDecoded* dec, const SstvDecoded* ref, SstvDecodeScore* score) {
+    const SstvMode* mode = dec->mode;
+    double sq = 0.0, abs_sum = 0.0;
+    int max_err = 0;
+    size_t n = (size_t)mode->width * mode->height * 3;
+    for (size_t i = 0; i < n; ++i) {
+        int err = abs(dec->rgb[i] - ref->rgb[i]);
+        sq += (double)err * err;
+        abs_sum += err;
+        if (err > max_err) max_err = err;
+    }
+    score->psnr = psnr_from_mse(sq / n);
+    score->mean_abs_err = abs_sum / n;
+    score->max_err = max_err;
+
+    score->flag_psnr = 0.0;
+    if (mode->has_flag) {
+        double fsq = 0.0;
+        for (int i = 0; i < FLAG_IMG_WIDTH * FLAG_IMG_HEIGHT; ++i) {
+            int err = dec->flag[i] - ref->flag[i];
+            fsq += (double)err * err;
+        }
+        score->flag_psnr = psnr_from_mse(fsq / (FLAG_IMG_WIDTH * FLAG_IMG_HEIGHT));
+    }
+}
+
+int write_decoded_ppm(const char* filename, const SstvDecoded* dec) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) { perror(filename); return -1; }
+    fprintf(f, "P6\n%d %d\n255\n", dec->mode->width, dec->mode->height);
+    size_t n = (size_t)dec->mode->width * dec->mode->height * 3;
+    int status = fwrite(dec->rgb, 1, n, f) == n ? 0 : -1;
+    if (fclose(f) != 0) status = -1;
+    if (status < 0) fprintf(stderr, "ERRO: Falha ao escrever %s.\n", filename);
+    return status;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static int16_t mulaw_decode(uint8_t code) {
+    code = (uint8_t)~code;
+    int magnitude = ((((code & 0x0F) << 3) + 0x84) << ((code >> 4) & 7)) - 0x84;
+    return (int16_t)((code & 0x80) ? -magnitude : magnitude);
+}
+
+// Lê um WAV (RIFF ou RF64) nos formatos que o encoder escreve e devolve o canal
+// `channel` em int16. O chamador libera com free().
+int16_t* read_wav_samples(const char* filename, int channel, int* samplerate_local, long long* count) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) { perror(filename); return NULL; }
+    uint8_t hdr[12], chunk[8], fmt[40];
+    int tag = 0, channels = 0, bits = 0;
+    uint64_t ds64_data = 0;
+    int16_t* out = NULL;
+    if (fread(hdr, 1, 12, f) != 12 || (memcmp(hdr, "RIFF", 4) != 0 && memcmp(hdr, "RF64", 4) != 0) ||
+        memcmp(hdr + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "ERRO: %s não é um arquivo WAV.\n", filename);
+        fclose(f);
+        return NULL;
+    }
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint64_t size = get_u32(chunk + 4);
+        if (memcmp(chunk, "ds64", 4) == 0 && size >= 16) {
+            uint8_t ds64[16];
+            if (fread(ds64, 1, 16, f) != 16) break;
+            ds64_data = get_u64(ds64 + 8);
+            fseek(f, (long)(size - 16 + (size & 1)), SEEK_CUR);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && size <= sizeof(fmt)) {
+            if (fread(fmt, 1, size, f) != size) break;
+            tag = fmt[0] | (fmt[1] << 8);
+            channels = fmt[2] | (fmt[3] << 8);
+            *samplerate_local = (int)get_u32(fmt + 4);
+            bits = fmt[14] | (fmt[15] << 8);
+            if (size & 1) fseek(f, 1, SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (size == UINT32_MAX && ds64_data) size = ds64_data;
+            int bytes = bits / 8;
+            if (channels < 1 || bytes < 1 || !((tag == 1 && (bits == 16 || bits == 8)) ||
+                                             (tag == 3 && bits == 32) || (tag == 7 && bits == 8))) {
+                fprintf(stderr, "ERRO: Formato de %s não suportado (tag %d, %d bits).\n", filename, tag, bits);
+                break;
+            }
+            if (channel < 0 || channel >= channels) {
+                fprintf(stderr, "ERRO: %s tem %d canais; canal %d pedido.\n", filename, channels, channel + 1);
+                break;
+            }
+            long long frames = (long long)(size / ((uint64_t)bytes * channels));
+            uint8_t* raw = (uint8_t*)malloc((size_t)frames * bytes * channels);
+            out = (int16_t*)malloc((size_t)frames * sizeof(int16_t));
+            if (!raw || !out || fread(raw, (size_t)bytes * channels, (size_t)frames, f) != (size_t)frames) {
+                fprintf(stderr, "ERRO: Falha ao ler as amostras de %s.\n", filename);
+                free(raw);
+                free(out);
+                out = NULL;
+                break;
+            }
+            for (long long i = 0; i < frames; ++i) {
+                const uint8_t* p = raw + ((size_t)i * channels + channel) * bytes;
+                if (tag == 3) {
+                    float v;
+                    memcpy(&v, p, sizeof(v));
+                    out[i] = (int16_t)lrintf(fmaxf(-1.0f, fminf(1.0f, v)) * 32767.0f);
+                } else if (tag == 7) {
+                    out[i] = mulaw_decode(p[0]);
+                } else if (bits == 8) {
+                    out[i] = (int16_t)((p[0] - 128) << 8);
+                } else {
+                    out[i] = (int16_t)(p[0] | (p[1] << 8));
+                }
+            }
+            free(raw);
+            *count = frames;
+            break;
+        } else {
+            fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+    fclose(f);
+    if (!out) fprintf(stderr, "ERRO: %s sem dados de áudio utilizáveis.\n", filename);
+    return out;
+}
@@ -0,0 +1,3799 @@
+#define _GNU_SOURCE // fallocate
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#include "stb_image.h"
+
+#include "sstvenc.h"
+#include "sstvenc_internal.h"
+
+static const PolyKernelSet* select_poly_kernel(const char* isa_override);
+
+void synth_config_init(SynthConfig* cfg, SynthEngine engine, int samplerate_local) {
+    cfg->engine = engine;
+    cfg->samplerate = samplerate_local;
+    cfg->format = SAMPLE_FORMAT_INT16;
+    for (int i = 0; i <= NCO_LUT_SIZE; ++i) {
+        cfg->nco_lut[i] = (int32_t)lrint(sin(2.0 * M_PI * i / NCO_LUT_SIZE) * 32767.0);
+        cfg->nco_lut_f32[i] = (float)sin(2.0 * M_PI * i / NCO_LUT_SIZE);
+    }
+    cfg->poly = select_poly_kernel(NULL);
+    cfg->poly_isa = cfg->poly->name;
+    cfg->stats = NULL;
+}
+
+// Força uma variante do kernel SIMD ("scalar", "sse4.2", "avx2", "avx512").
+int synth_config_force_isa(SynthConfig* cfg, const char* isa) {
+    const PolyKernelSet* set = select_poly_kernel(isa);
+    if (strcmp(set->name, isa) != 0) {
+        fprintf(stderr, "ERRO: Variante %s indisponível nesta CPU ou desconhecida.\n", isa);
+        return -1;
+    }
+    cfg->poly = set;
+    cfg->poly_isa = set->name;
+    return 0;
+}
+
+int parse_synth_engine(const char* name, SynthEngine* engine) {
+    if (strcmp(name, "libm") == 0) *engine = SYNTH_ENGINE_LIBM;
+    else if (strcmp(name, "nco") == 0) *engine = SYNTH_ENGINE_NCO;
+    else if (strcmp(name, "simd") == 0) *engine = SYNTH_ENGINE_SIMD;
+    else {
+        fprintf(stderr, "ERRO: Motor de síntese desconhecido: %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+const char* synth_engine_name(SynthEngine engine) {
+    switch (engine) {
+    case SYNTH_ENGINE_NCO: return "nco";
+    case SYNTH_ENGINE_SIMD: return "simd";
+    default: return "libm";
+    }
+}
+
+void stats_init(SstvStats* st) {
+    memset(st, 0, sizeof(*st));
+    clock_gettime(CLOCK_MONOTONIC, &st->started);
+}
+
+void stats_mark(StatsMark* mark) {
+    clock_gettime(CLOCK_MONOTONIC, &mark->wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &mark->cpu);
+}
+
+static long long timespec_ns(const struct timespec* a, const struct timespec* b) {
+    return (long long)(b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+void stats_add_time(SstvStats* st, StatsStage stage, const StatsMark* mark) {
+    StatsMark now;
+    stats_mark(&now);
+    atomic_fetch_add_explicit(&st->wall_ns[stage], timespec_ns(&mark->wall, &now.wall), memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->cpu_ns[stage], timespec_ns(&mark->cpu, &now.cpu), memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->calls[stage], 1, memory_order_relaxed);
+}
+
+void stats_add_alloc(SstvStats* st, long long bytes) {
+    atomic_fetch_add_explicit(&st->bytes_allocated, bytes, memory_order_relaxed);
+    long long peak = atomic_load_explicit(&st->peak_buffer, memory_order_relaxed);
+    while (bytes > peak &&
+           !atomic_compare_exchange_weak_explicit(&st->peak_buffer, &peak, bytes,
+                                                  memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+static const char* const stats_stage_names[STATS_STAGE_COUNT] = {
+    [STATS_LOAD] = "load", [STATS_HEADER] = "header", [STATS_IMAGE] = "image",
+    [STATS_TRAILER] = "trailer", [STATS_PREFIX] = "prefix", [STATS_SYNTH] = "synth", [STATS_OUTPUT] = "output"
+};
+
+static const char* const stats_symbol_names[STATS_SYMBOL_TYPES] = {
+    [SILENCE_SYMBOL] = "silence", [TONE_SYMBOL] = "tone", [LINEAR_SWEEP_SYMBOL] = "sweep"
+};
+
+// Relatório final: tabela legível ou um objeto JSON numa linha.
+void print_stats(FILE* out, const SstvStats* st, int json) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double total_s = timespec_ns(&st->started, &now) * 1e-9;
+    long long samples = atomic_load(&st->samples);
+    double synth_s = atomic_load(&st->wall_ns[STATS_SYNTH]) * 1e-9;
+    double rate = synth_s > 0.0 ? samples / synth_s : 0.0;
+
+    if (json) {
+        fprintf(out, "{\"stages\": {");
+        for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+            fprintf(out, "%s\"%s\": {\"calls\": %lld, \"wall_s\": %.6f, \"cpu_s\": %.6f}", i ? ", " : "",
+                    stats_stage_names[i], atomic_load(&st->calls[i]),
+                    atomic_load(&st->wall_ns[i]) * 1e-9, atomic_load(&st->cpu_ns[i]) * 1e-9);
+        }
+        fprintf(out, "}, \"symbols\": {");
+        for (int i = 0; i < STATS_SYMBOL_TYPES; ++i) {
+            fprintf(out, "%s\"%s\": %lld", i ? ", " : "", stats_symbol_names[i], atomic_load(&st->symbols[i]));
+        }
+        fprintf(out, "}, \"bytes_allocated\": %lld, \"peak_buffer_bytes\": %lld, \"samples\": %lld,"
+                     " \"samples_per_s\": %.1f, \"total_s\": %.6f}\n",
+                atomic_load(&st->bytes_allocated), atomic_load(&st->peak_buffer), samples, rate, total_s);
+        return;
+    }
+    fprintf(out, "%-8s %8s %12s %12s\n", "etapa", "chamadas", "parede (ms)", "CPU (ms)");
+    for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+        if (atomic_load(&st->calls[i]) == 0) continue;
+        fprintf(out, "%-8s %8lld %12.3f %12.3f\n", stats_stage_names[i], atomic_load(&st->calls[i]),
+                atomic_load(&st->wall_ns[i]) * 1e-6, atomic_load(&st->cpu_ns[i]) * 1e-6);
+    }
+    fprintf(out, "Símbolos: %lld silêncio, %lld tom, %lld varredura\n", atomic_load(&st->symbols[SILENCE_SYMBOL]),
+            atomic_load(&st->symbols[TONE_SYMBOL]), atomic_load(&st->symbols[LINEAR_SWEEP_SYMBOL]));
+    fprintf(out, "Alocado: %lld KB, maior buffer %lld KB\n",
+            atomic_load(&st->bytes_allocated) / 1024, atomic_load(&st->peak_buffer) / 1024);
+    fprintf(out, "Amostras: %lld (%.0f amostras/s na síntese), total %.3f s\n", samples, rate, total_s);
+}
+
+// Conversões entre radianos e Q32.32 preservam a parte fracionária: truncar para
+// 32 bits a cada símbolo acumularia ~1e-4 rad de deriva ao longo de um quadro.
+static uint64_t nco_phase_from_rad(double phase) {
+    double turns = phase / (2.0 * M_PI);
+    turns -= floor(turns);
+    double hi = floor(turns * NCO_PHASE_SCALE);
+    double lo = (turns * NCO_PHASE_SCALE - hi) * NCO_PHASE_SCALE;
+    return ((uint64_t)hi << 32) + (uint64_t)lo;
+}
+
+static double nco_phase_to_rad(uint64_t acc) {
+    return (double)acc * (2.0 * M_PI / NCO_SUBPHASE_SCALE);
+}
+
+// Incremento de fase por amostra em Q32.32; válido para |freq| < samplerate / 2.
+static uint64_t nco_freq_word(double freq, int samplerate_local) {
+    return (uint64_t)(int64_t)llround(freq / samplerate_local * NCO_SUBPHASE_SCALE);
+}
+
+#define NCO_QUARTER_TURN (1u << 30) // pi/2 na parte alta do acumulador
+
+static inline int16_t nco_sample(const int32_t* lut, uint32_t acc, int32_t gain) {
+    uint32_t idx = acc >> NCO_FRAC_BITS;
+    int32_t a = lut[idx];
+    int32_t frac = (int32_t)(acc & ((1u << NCO_FRAC_BITS) - 1));
+    int32_t v = a + (int32_t)(((int64_t)(lut[idx + 1] - a) * frac) >> NCO_FRAC_BITS);
+    return (int16_t)((v * gain) >> 15);
+}
+
+// Motor polinomial: a fase de cada amostra vem em forma fechada (em voltas),
+//   t_j = t0 + j*c0 + j*(j-1)/2 * c1
+// então as amostras de um símbolo são independentes entre si e vetorizáveis.
+// O seno é um polinômio ímpar de grau 11 sobre [-1/4, 1/4] volta (erro < 6e-8).
+#define POLY_S1  6.28318530717958648f
+#define POLY_S3 -41.3417022403997098f
+#define POLY_S5  81.6052492760750379f
+#define POLY_S7 -76.7058597530612808f
+#define POLY_S9  42.0586939448085058f
+#define POLY_S11 -15.0946425768380700f
+
+// Variante grosseira para as saídas de 8 bits (u8, μ-law): grau 5 minimax, erro
+// < 6.8e-5 (-83 dB), bem abaixo da quantização de 8 bits (~-48 dB), com metade
+// dos termos.
+#define POLY_C1  6.2812800766395f
+#define POLY_C3 -41.095242688673395f
+#define POLY_C5  73.58551475358666f
+
+// Saídas dos kernels: int16 (grau 11), float em [-1, 1] (grau 11) e int16 grosseiro.
+#define POLY_OUT_INT16 0
+#define POLY_OUT_FLOAT 1
+#define POLY_OUT_COARSE 2
+
+// Sem contração em FMA: todas as variantes (escalar e SIMD) dão o mesmo resultado bit a bit.
+#ifdef __GNUC__
+#define POLY_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define POLY_NO_CONTRACT
+#endif
+
+static inline float poly_sin_turns(float x) {
+    float ax = fabsf(x);
+    ax = fminf(ax, 0.5f - ax); // sin(pi - a) = sin(a)
+    x = copysignf(ax, x);
+    float x2 = x * x;
+    float p = POLY_S11;
+    p = p * x2 + POLY_S9;
+    p = p * x2 + POLY_S7;
+    p = p * x2 + POLY_S5;
+    p = p * x2 + POLY_S3;
+    p = p * x2 + POLY_S1;
+    return p * x;
+}
+
+POLY_NO_CONTRACT
+static inline float poly_sin_turns_coarse(float x) {
+    float ax = fabsf(x);
+    ax = fminf(ax, 0.5f - ax);
+    x = copysignf(ax, x);
+    float x2 = x * x;
+    float p = POLY_C5;
+    p = p * x2 + POLY_C3;
+    p = p * x2 + POLY_C1;
+    return p * x;
+}
+
+static inline int16_t poly_pack_sample(float v) {
+    int32_t s = (int32_t)v;
+    if (s > INT16_MAX) s = INT16_MAX;
+    if (s < INT16_MIN) s = INT16_MIN;
+    return (int16_t)s;
+}
+
+POLY_NO_CONTRACT
+static inline float poly_turns_scalar(int j, double t0, double c0, double c1) {
+    double jd = (double)j;
+    double t = t0 + (jd * c0 + jd * (jd - 1.0) * (0.5 * c1));
+    t -= nearbyint(t);
+    return (float)t;
+}
+
+POLY_NO_CONTRACT
+static void poly_kernel_scalar(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    for (int k = 0; k < count; ++k) {
+        dst[k] = poly_pack_sample(gain * poly_sin_turns(poly_turns_scalar(j0 + k, t0, c0, c1)));
+    }
+}
+
+POLY_NO_CONTRACT
+static void poly_kernel_scalar_f32(float* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    for (int k = 0; k < count; ++k) dst[k] = gain * poly_sin_turns(poly_turns_scalar(j0 + k, t0, c0, c1));
+}
+
+POLY_NO_CONTRACT
+static void poly_kernel_scalar_coarse(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    for (int k = 0; k < count; ++k) {
+        dst[k] = poly_pack_sample(gain * poly_sin_turns_coarse(poly_turns_scalar(j0 + k, t0, c0, c1)));
+    }
+}
+
+// Resto de um bloco SIMD (menos amostras que a largura do vetor), na mesma saída.
+static void poly_kernel_scalar_tail(void* dst, int kind, int k, int j0, int count, double t0, double c0, double c1,
+                                    float gain) {
+    if (kind == POLY_OUT_FLOAT) poly_kernel_scalar_f32((float*)dst + k, j0 + k, count - k, t0, c0, c1, gain);
+    else if (kind == POLY_OUT_COARSE) poly_kernel_scalar_coarse((int16_t*)dst + k, j0 + k, count - k, t0, c0, c1, gain);
+    else poly_kernel_scalar((int16_t*)dst + k, j0 + k, count - k, t0, c0, c1, gain);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SSTV_X86_DISPATCH 1
+#include <immintrin.h>
+
+__attribute__((target("sse4.2")))
+static inline __m128 poly_sin_turns_sse(__m128 x, int coarse) {
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 sign = _mm_and_ps(x, sign_mask);
+    __m128 ax = _mm_andnot_ps(sign_mask, x);
+    ax = _mm_min_ps(ax, _mm_sub_ps(_mm_set1_ps(0.5f), ax));
+    x = _mm_or_ps(ax, sign);
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p;
+    if (coarse) {
+        p = _mm_set1_ps(POLY_C5);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_C3));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_C1));
+    } else {
+        p = _mm_set1_ps(POLY_S11);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_S9));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_S7));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_S5));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_S3));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(POLY_S1));
+    }
+    return _mm_mul_ps(p, x);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128 poly_turns_sse(__m128d j, __m128d t0, __m128d c0, __m128d c1h, __m128d j_hi) {
+    // j e j + 2 -> quatro fases reduzidas a [-1/2, 1/2] em float
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d ta = _mm_add_pd(t0, _mm_add_pd(_mm_mul_pd(j, c0), _mm_mul_pd(_mm_mul_pd(j, _mm_sub_pd(j, one)), c1h)));
+    __m128d tb = _mm_add_pd(t0, _mm_add_pd(_mm_mul_pd(j_hi, c0), _mm_mul_pd(_mm_mul_pd(j_hi, _mm_sub_pd(j_hi, one)), c1h)));
+    ta = _mm_sub_pd(ta, _mm_round_pd(ta, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    tb = _mm_sub_pd(tb, _mm_round_pd(tb, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    return _mm_movelh_ps(_mm_cvtpd_ps(ta), _mm_cvtpd_ps(tb));
+}
+
+// Corpo comum das três saídas; `kind` é constante em cada chamador e some na inlining.
+__attribute__((target("sse4.2"), always_inline)) POLY_NO_CONTRACT
+static inline void poly_kernel_sse42_body(void* dst, int kind, int j0, int count, double t0, double c0, double c1,
+                                          float gain) {
+    const __m128d vt0 = _mm_set1_pd(t0), vc0 = _mm_set1_pd(c0), vc1h = _mm_set1_pd(c1 * 0.5);
+    const __m128d two = _mm_set1_pd(2.0), four = _mm_set1_pd(4.0);
+    const __m128 vgain = _mm_set1_ps(gain);
+    __m128d j = _mm_setr_pd((double)j0, (double)j0 + 1.0);
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m128 lo = poly_turns_sse(j, vt0, vc0, vc1h, _mm_add_pd(j, two));
+        j = _mm_add_pd(j, four);
+        __m128 hi = poly_turns_sse(j, vt0, vc0, vc1h, _mm_add_pd(j, two));
+        j = _mm_add_pd(j, four);
+        __m128 vlo = _mm_mul_ps(vgain, poly_sin_turns_sse(lo, kind == POLY_OUT_COARSE));
+        __m128 vhi = _mm_mul_ps(vgain, poly_sin_turns_sse(hi, kind == POLY_OUT_COARSE));
+        if (kind == POLY_OUT_FLOAT) {
+            _mm_storeu_ps((float*)dst + k, vlo);
+            _mm_storeu_ps((float*)dst + k + 4, vhi);
+        } else {
+            __m128i s16 = _mm_packs_epi32(_mm_cvttps_epi32(vlo), _mm_cvttps_epi32(vhi));
+            _mm_storeu_si128((__m128i*)((int16_t*)dst + k), s16);
+        }
+    }
+    poly_kernel_scalar_tail(dst, kind, k, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("sse4.2"))) POLY_NO_CONTRACT
+static void poly_kernel_sse42(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_sse42_body(dst, POLY_OUT_INT16, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("sse4.2"))) POLY_NO_CONTRACT
+static void poly_kernel_sse42_f32(float* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_sse42_body(dst, POLY_OUT_FLOAT, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("sse4.2"))) POLY_NO_CONTRACT
+static void poly_kernel_sse42_coarse(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_sse42_body(dst, POLY_OUT_COARSE, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx2")))
+static inline __m128 poly_turns_avx2(__m256d j, __m256d t0, __m256d c0, __m256d c1h) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d t = _mm256_add_pd(t0, _mm256_add_pd(_mm256_mul_pd(j, c0),
+                                                _mm256_mul_pd(_mm256_mul_pd(j, _mm256_sub_pd(j, one)), c1h)));
+    t = _mm256_sub_pd(t, _mm256_round_pd(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    return _mm256_cvtpd_ps(t);
+}
+
+__attribute__((target("avx2"), always_inline)) POLY_NO_CONTRACT
+static inline void poly_kernel_avx2_body(void* dst, int kind, int j0, int count, double t0, double c0, double c1,
+                                         float gain) {
+    const __m256d vt0 = _mm256_set1_pd(t0), vc0 = _mm256_set1_pd(c0), vc1h = _mm256_set1_pd(c1 * 0.5);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256 vgain = _mm256_set1_ps(gain);
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256d j = _mm256_setr_pd((double)j0, (double)j0 + 1.0, (double)j0 + 2.0, (double)j0 + 3.0);
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m128 lo = poly_turns_avx2(j, vt0, vc0, vc1h);
+        j = _mm256_add_pd(j, four);
+        __m128 hi = poly_turns_avx2(j, vt0, vc0, vc1h);
+        j = _mm256_add_pd(j, four);
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+
+        __m256 sign = _mm256_and_ps(x, sign_mask);
+        __m256 ax = _mm256_andnot_ps(sign_mask, x);
+        ax = _mm256_min_ps(ax, _mm256_sub_ps(_mm256_set1_ps(0.5f), ax));
+        x = _mm256_or_ps(ax, sign);
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p;
+        if (kind == POLY_OUT_COARSE) {
+            p = _mm256_set1_ps(POLY_C5);
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_C3));
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_C1));
+        } else {
+            p = _mm256_set1_ps(POLY_S11);
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_S9));
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_S7));
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_S5));
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_S3));
+            p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(POLY_S1));
+        }
+        p = _mm256_mul_ps(vgain, _mm256_mul_ps(p, x));
+
+        if (kind == POLY_OUT_FLOAT) {
+            _mm256_storeu_ps((float*)dst + k, p);
+        } else {
+            __m256i s32 = _mm256_cvttps_epi32(p);
+            __m128i s16 = _mm_packs_epi32(_mm256_castsi256_si128(s32), _mm256_extracti128_si256(s32, 1));
+            _mm_storeu_si128((__m128i*)((int16_t*)dst + k), s16);
+        }
+    }
+    poly_kernel_scalar_tail(dst, kind, k, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx2"))) POLY_NO_CONTRACT
+static void poly_kernel_avx2(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx2_body(dst, POLY_OUT_INT16, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx2"))) POLY_NO_CONTRACT
+static void poly_kernel_avx2_f32(float* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx2_body(dst, POLY_OUT_FLOAT, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx2"))) POLY_NO_CONTRACT
+static void poly_kernel_avx2_coarse(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx2_body(dst, POLY_OUT_COARSE, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx512f"), always_inline)) POLY_NO_CONTRACT
+static inline void poly_kernel_avx512_body(void* dst, int kind, int j0, int count, double t0, double c0, double c1,
+                                           float gain) {
+    const __m512d vt0 = _mm512_set1_pd(t0), vc0 = _mm512_set1_pd(c0), vc1h = _mm512_set1_pd(c1 * 0.5);
+    const __m512d one = _mm512_set1_pd(1.0), eight = _mm512_set1_pd(8.0);
+    const __m512 vgain = _mm512_set1_ps(gain);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512i sign_mask = _mm512_set1_epi32((int)0x80000000);
+    __m512d j = _mm512_add_pd(_mm512_set1_pd((double)j0), _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7));
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m512d ta = _mm512_add_pd(vt0, _mm512_add_pd(_mm512_mul_pd(j, vc0),
+                                   _mm512_mul_pd(_mm512_mul_pd(j, _mm512_sub_pd(j, one)), vc1h)));
+        j = _mm512_add_pd(j, eight);
+        __m512d tb = _mm512_add_pd(vt0, _mm512_add_pd(_mm512_mul_pd(j, vc0),
+                                   _mm512_mul_pd(_mm512_mul_pd(j, _mm512_sub_pd(j, one)), vc1h)));
+        j = _mm512_add_pd(j, eight);
+        ta = _mm512_sub_pd(ta, _mm512_roundscale_pd(ta, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        tb = _mm512_sub_pd(tb, _mm512_roundscale_pd(tb, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        __m512 x = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(ta))),
+                                                       _mm256_castps_pd(_mm512_cvtpd_ps(tb)), 1));
+
+        __m512i xi = _mm512_castps_si512(x);
+        __m512i sign = _mm512_and_si512(xi, sign_mask);
+        __m512 ax = _mm512_castsi512_ps(_mm512_andnot_si512(sign_mask, xi));
+        ax = _mm512_min_ps(ax, _mm512_sub_ps(half, ax));
+        x = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(ax), sign));
+        __m512 x2 = _mm512_mul_ps(x, x);
+        __m512 p;
+        if (kind == POLY_OUT_COARSE) {
+            p = _mm512_set1_ps(POLY_C5);
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_C3));
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_C1));
+        } else {
+            p = _mm512_set1_ps(POLY_S11);
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_S9));
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_S7));
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_S5));
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_S3));
+            p = _mm512_add_ps(_mm512_mul_ps(p, x2), _mm512_set1_ps(POLY_S1));
+        }
+        p = _mm512_mul_ps(vgain, _mm512_mul_ps(p, x));
+
+        if (kind == POLY_OUT_FLOAT) {
+            _mm512_storeu_ps((float*)dst + k, p);
+        } else {
+            _mm256_storeu_si256((__m256i*)((int16_t*)dst + k), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(p)));
+        }
+    }
+    poly_kernel_scalar_tail(dst, kind, k, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx512f"))) POLY_NO_CONTRACT
+static void poly_kernel_avx512(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx512_body(dst, POLY_OUT_INT16, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx512f"))) POLY_NO_CONTRACT
+static void poly_kernel_avx512_f32(float* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx512_body(dst, POLY_OUT_FLOAT, j0, count, t0, c0, c1, gain);
+}
+
+__attribute__((target("avx512f"))) POLY_NO_CONTRACT
+static void poly_kernel_avx512_coarse(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain) {
+    poly_kernel_avx512_body(dst, POLY_OUT_COARSE, j0, count, t0, c0, c1, gain);
+}
+#endif
+
+// Variantes do motor SIMD, da mais larga à escalar, com as três saídas de cada uma.
+static const PolyKernelSet poly_kernel_sets[] = {
+#ifdef SSTV_X86_DISPATCH
+    { "avx512", poly_kernel_avx512, poly_kernel_avx512_f32, poly_kernel_avx512_coarse },
+    { "avx2",   poly_kernel_avx2,   poly_kernel_avx2_f32,   poly_kernel_avx2_coarse },
+    { "sse4.2", poly_kernel_sse42,  poly_kernel_sse42_f32,  poly_kernel_sse42_coarse },
+#endif
+    { "scalar", poly_kernel_scalar, poly_kernel_scalar_f32, poly_kernel_scalar_coarse },
+};
+#define POLY_KERNEL_SCALAR (&poly_kernel_sets[sizeof(poly_kernel_sets) / sizeof(poly_kernel_sets[0]) - 1])
+
+// Escolhe o melhor kernel para a CPU atual. isa_override (ou NULL) força uma variante.
+static const PolyKernelSet* select_poly_kernel(const char* isa_override) {
+#ifdef SSTV_X86_DISPATCH
+    __builtin_cpu_init();
+    int want_any = (isa_override == NULL);
+    if ((want_any || strcmp(isa_override, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+        return &poly_kernel_sets[0];
+    }
+    if ((want_any || strcmp(isa_override, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        return &poly_kernel_sets[1];
+    }
+    if ((want_any || strcmp(isa_override, "sse4.2") == 0) && __builtin_cpu_supports("sse4.2")) {
+        return &poly_kernel_sets[2];
+    }
+#else
+    (void)isa_override;
+#endif
+    return POLY_KERNEL_SCALAR;
+}
+
+long long schedule_total_samples(const SymbolSchedule* sched) {
+    long long total_samples_long = 0;
+    for (int i = 0; i < sched->count; ++i) {
+        total_samples_long += sched->syms[i].samples;
+    }
+    return total_samples_long;
+}
+
+static int schedule_source_next(void* ctx, AudioSymbol* out) {
+    ScheduleSource* ss = (ScheduleSource*)ctx;
+    if (ss->idx >= ss->sched->count) return 0;
+    *out = ss->sched->syms[ss->idx++];
+    return 1;
+}
+
+SymbolSource schedule_source(ScheduleSource* ss, const SymbolSchedule* sched) {
+    ss->sched = sched;
+    ss->idx = 0;
+    SymbolSource src = { schedule_source_next, ss };
+    return src;
+}
+
+static int chain_source_next(void* ctx, AudioSymbol* out) {
+    ChainSource* cs = (ChainSource*)ctx;
+    while (cs->idx < cs->count) {
+        SymbolSource* part = &cs->parts[cs->idx];
+        if (part->next(part->ctx, out)) return 1;
+        cs->idx++;
+    }
+    return 0;
+}
+
+SymbolSource chain_source(ChainSource* cs, const SymbolSource* parts, int count) {
+    assert(count <= MAX_CHAINED_SOURCES);
+    for (int i = 0; i < count; ++i) cs->parts[i] = parts[i];
+    cs->count = count;
+    cs->idx = 0;
+    SymbolSource src = { chain_source_next, cs };
+    return src;
+}
+
+void synth_cursor_init_source(SynthCursor* cur, SymbolSource source, const SynthConfig* cfg) {
+    cur->source = source;
+    cur->sym_active = 0;
+    cur->cfg = cfg;
+    cur->cache = NULL;
+    cur->cached = NULL;
+    cur->sym_pos = 0;
+    cur->sym_len = 0;
+    cur->phase = 0.0;
+    cur->sym_phase = 0.0;
+    cur->nco_acc = 0;
+    cur->nco_inc = 0;
+    cur->nco_delta = 0;
+    cur->nco_gain = 0;
+    cur->poly_t0 = 0.0;
+    cur->poly_c0 = 0.0;
+    cur->poly_c1 = 0.0;
+    cur->poly_gain = 0.0f;
+    cur->amp_f32 = 0.0f;
+}
+
+void synth_cursor_init(SynthCursor* cur, const SymbolSchedule* sched, const SynthConfig* cfg) {
+    synth_cursor_init_source(cur, schedule_source(&cur->sched_src, sched), cfg);
+}
+
+static void synth_begin_symbol_nco(SynthCursor* cur, const AudioSymbol* sym) {
+    int samplerate_local = cur->cfg->samplerate;
+    double amplitude = 0.0;
+    cur->nco_delta = 0;
+    if (sym->type == TONE_SYMBOL) {
+        cur->nco_acc = nco_phase_from_rad(cur->sym_phase);
+        cur->nco_inc = nco_freq_word(sym->tone.frequency, samplerate_local);
+        amplitude = sym->tone.amplitude;
+    } else if (sym->type == LINEAR_SWEEP_SYMBOL) {
+        cur->nco_acc = nco_phase_from_rad(cur->sym_phase);
+        cur->nco_inc = nco_freq_word(sym->sweep.freqstart, samplerate_local);
+        if (cur->sym_len > 0) {
+            double step = (sym->sweep.freqend - sym->sweep.freqstart) / cur->sym_len;
+            cur->nco_delta = (int64_t)llround(step / samplerate_local * NCO_SUBPHASE_SCALE);
+        }
+        amplitude = sym->sweep.amplitude;
+    }
+    if (amplitude > 1.0) amplitude = 1.0;
+    if (amplitude < -1.0) amplitude = -1.0;
+    cur->nco_gain = (int32_t)lrint(amplitude * 32768.0);
+    cur->amp_f32 = (float)amplitude;
+}
+
+// Saída float32: a mesma interpolação sobre a tabela em float, sem o degrau de 16 bits.
+static inline float nco_sample_f32(const float* lut, uint32_t acc, float gain) {
+    uint32_t idx = acc >> NCO_FRAC_BITS;
+    float frac = (float)(acc & ((1u << NCO_FRAC_BITS) - 1)) * (1.0f / (1u << NCO_FRAC_BITS));
+    return (lut[idx] + (lut[idx + 1] - lut[idx]) * frac) * gain;
+}
+
+// dst ou fdst (float32): só um dos dois é usado. qdst (só com dst) recebe a
+// quadratura, o mesmo acumulador adiantado de um quarto de volta.
+static void synth_render_nco(SynthCursor* cur, const AudioSymbol* sym, int16_t* dst, float* fdst, int16_t* qdst,
+                             int count) {
+    const int32_t* lut = cur->cfg->nco_lut;
+    uint64_t acc = cur->nco_acc;
+    uint64_t inc = cur->nco_inc;
+    int32_t gain = cur->nco_gain;
+
+    if (qdst) {
+        uint64_t qacc = acc, qinc = inc;
+        uint64_t delta = sym->type == LINEAR_SWEEP_SYMBOL ? (uint64_t)cur->nco_delta : 0;
+        if (sym->type == SILENCE_SYMBOL) {
+            if (count > 0) memset(qdst, 0, count * sizeof(int16_t));
+        } else {
+            for (int k = 0; k < count; ++k) {
+                qdst[k] = nco_sample(lut, (uint32_t)(qacc >> 32) + NCO_QUARTER_TURN, gain);
+                qacc += qinc;
+                qinc += delta;
+            }
+        }
+    }
+
+    if (fdst) {
+        const float* flut = cur->cfg->nco_lut_f32;
+        float fgain = cur->amp_f32;
+        uint64_t delta = sym->type == LINEAR_SWEEP_SYMBOL ? (uint64_t)cur->nco_delta : 0;
+        if (sym->type == SILENCE_SYMBOL) {
+            if (count > 0) memset(fdst, 0, count * sizeof(float));
+        } else {
+            for (int k = 0; k < count; ++k) {
+                fdst[k] = nco_sample_f32(flut, (uint32_t)(acc >> 32), fgain);
+                acc += inc;
+                inc += delta;
+            }
+        }
+    } else if (sym->type == TONE_SYMBOL) {
+        for (int k = 0; k < count; ++k) {
+            dst[k] = nco_sample(lut, (uint32_t)(acc >> 32), gain);
+            acc += inc;
+        }
+    } else if (sym->type == LINEAR_SWEEP_SYMBOL) {
+        uint64_t delta = (uint64_t)cur->nco_delta;
+        for (int k = 0; k < count; ++k) {
+            dst[k] = nco_sample(lut, (uint32_t)(acc >> 32), gain);
+            acc += inc;
+            inc += delta;
+        }
+    } else if (count > 0) {
+        memset(dst, 0, count * sizeof(int16_t));
+    }
+
+    cur->nco_acc = acc;
+    cur->nco_inc = inc;
+    if (cur->sym_pos + count == cur->sym_len && cur->sym_len > 0 && sym->type != SILENCE_SYMBOL) {
+        cur->phase = nco_phase_to_rad(acc);
+    }
+}
+
+// Fase em voltas após as sym_len amostras do símbolo (forma fechada do motor SIMD).
+static double poly_end_phase(const SynthCursor* cur) {
+    double n = cur->sym_len;
+    double t = cur->poly_t0 + (n * cur->poly_c0 + n * (n - 1.0) * (0.5 * cur->poly_c1));
+    return 2.0 * M_PI * (t - floor(t));
+}
+
+static void synth_begin_symbol_poly(SynthCursor* cur, const AudioSymbol* sym) {
+    double samplerate_local = cur->cfg->samplerate;
+    cur->poly_t0 = cur->sym_phase / (2.0 * M_PI);
+    cur->poly_c1 = 0.0;
+    if (sym->type == TONE_SYMBOL) {
+        cur->poly_c0 = sym->tone.frequency / samplerate_local;
+        cur->poly_gain = (float)(sym->tone.amplitude * 32767.0);
+        cur->amp_f32 = (float)sym->tone.amplitude;
+    } else if (sym->type == LINEAR_SWEEP_SYMBOL) {
+        cur->poly_c0 = sym->sweep.freqstart / samplerate_local;
+        if (cur->sym_len > 0) {
+            cur->poly_c1 = (sym->sweep.freqend - sym->sweep.freqstart) / cur->sym_len / samplerate_local;
+        }
+        cur->poly_gain = (float)(sym->sweep.amplitude * 32767.0);
+        cur->amp_f32 = (float)sym->sweep.amplitude;
+    }
+}
+
+// dst ou fdst (float32); coarse escolhe o polinômio de grau 5 para a saída int16.
+// qdst (só com dst) recebe a quadratura: a mesma fase em forma fechada + 1/4 de volta.
+static void synth_render_poly(SynthCursor* cur, const AudioSymbol* sym, int16_t* dst, float* fdst, int16_t* qdst,
+                              int count, int coarse) {
+    const PolyKernelSet* poly = cur->cfg->poly;
+    if (sym->type == SILENCE_SYMBOL) {
+        if (count > 0) {
+            if (fdst) memset(fdst, 0, count * sizeof(float));
+            else memset(dst, 0, count * sizeof(int16_t));
+            if (qdst) memset(qdst, 0, count * sizeof(int16_t));
+        }
+        return;
+    }
+    if (qdst) poly->int16(qdst, cur->sym_pos, count, cur->poly_t0 + 0.25, cur->poly_c0, cur->poly_c1, cur->poly_gain);
+    if (fdst) poly->float32(fdst, cur->sym_pos, count, cur->poly_t0, cur->poly_c0, cur->poly_c1, cur->amp_f32);
+    else (coarse ? poly->coarse : poly->int16)(dst, cur->sym_pos, count, cur->poly_t0, cur->poly_c0, cur->poly_c1,
+                                               cur->poly_gain);
+    if (cur->sym_pos + count == cur->sym_len && cur->sym_len > 0) {
+        cur->phase = poly_end_phase(cur);
+    }
+}
+
+// A referência gera o valor em double; só a gravação muda com a saída.
+static inline void libm_store(int16_t* dst, float* fdst, int k, double v) {
+    if (fdst) fdst[k] = (float)v;
+    else dst[k] = (int16_t)(v * 32767.0);
+}
+
+// qdst (só com dst) recebe o cosseno da mesma fase, na mesma passada.
+static void synth_render_libm(SynthCursor* cur, const AudioSymbol* sym, int16_t* dst, float* fdst, int16_t* qdst,
+                              int count) {
+    int samplerate_local = cur->cfg->samplerate;
+    switch (sym->type) {
+    case TONE_SYMBOL: {
+        const Tone* tone = &sym->tone;
+        double rfreq = 2.0 * M_PI * tone->frequency / samplerate_local;
+        for (int k = 0; k < count; ++k) {
+            int j = cur->sym_pos + k;
+            double theta = j * rfreq + cur->sym_phase;
+            libm_store(dst, fdst, k, tone->amplitude * sin(theta));
+            if (qdst) qdst[k] = (int16_t)(tone->amplitude * cos(theta) * 32767.0);
+        }
+        if (cur->sym_pos + count == cur->sym_len && cur->sym_len > 0) {
+            cur->phase = fmod(cur->sym_phase + cur->sym_len * rfreq, 2.0 * M_PI);
+        }
+        break;
+    }
+    case LINEAR_SWEEP_SYMBOL: {
+        const LinearSweep* sweep = &sym->sweep;
+        double freq_diff = sweep->freqend - sweep->freqstart;
+        double phase_for_sweep = cur->sym_phase;
+
+        for (int k = 0; k < count; ++k) {
+            int j = cur->sym_pos + k;
+            double instantaneous_freq = sweep->freqstart + (freq_diff * (double)j / cur->sym_len);
+            double rfreq_step = 2.0 * M_PI * instantaneous_freq / samplerate_local;
+            libm_store(dst, fdst, k, sweep->amplitude * sin(phase_for_sweep));
+            if (qdst) qdst[k] = (int16_t)(sweep->amplitude * cos(phase_for_sweep) * 32767.0);
+            phase_for_sweep = fmod(phase_for_sweep + rfreq_step, 2.0 * M_PI);
+        }
+        cur->sym_phase = phase_for_sweep;
+        if (cur->sym_pos + count == cur->sym_len && cur->sym_len > 0) {
+            cur->phase = phase_for_sweep;
+        }
+        break;
+    }
+    case SILENCE_SYMBOL:
+    default:
+        if (count > 0) {
+            if (fdst) memset(fdst, 0, count * sizeof(float));
+            else memset(dst, 0, count * sizeof(int16_t));
+            if (qdst) memset(qdst, 0, count * sizeof(int16_t));
+        }
+        break;
+    }
+}
+
+static const PcmCacheEntry* pcm_cache_get(PcmCache* cache, const AudioSymbol* sym, int length, double phase);
+
+static void synth_begin_symbol(SynthCursor* cur, const AudioSymbol* sym) {
+    cur->sym_len = sym->samples;
+    if (sym->type == TONE_SYMBOL) {
+        cur->sym_phase = fmod(cur->phase + sym->tone.phase_offset, 2.0 * M_PI);
+    } else if (sym->type == LINEAR_SWEEP_SYMBOL) {
+        cur->sym_phase = fmod(cur->phase + sym->sweep.phase_offset, 2.0 * M_PI);
+    }
+    cur->cached = NULL;
+    if (cur->cache && sym->segment != PCM_SEG_NONE && sym->type == TONE_SYMBOL && cur->sym_len > 0) {
+        cur->cached = pcm_cache_get(cur->cache, sym, cur->sym_len, cur->sym_phase);
+        if (cur->cached) return;
+    }
+    if (cur->cfg->engine == SYNTH_ENGINE_NCO) synth_begin_symbol_nco(cur, sym);
+    else if (cur->cfg->engine == SYNTH_ENGINE_SIMD) synth_begin_symbol_poly(cur, sym);
+}
+
+// Fase ao fim de um símbolo sem gerar amostras, idêntica bit a bit à que
+// synth_render deixaria em cur->phase. Base da passada de prefixo paralela.
+static double synth_symbol_end_phase(const SynthConfig* cfg, const AudioSymbol* sym, double phase) {
+    SynthCursor cur;
+    cur.cfg = cfg;
+    cur.cache = NULL;
+    cur.phase = phase;
+    synth_begin_symbol(&cur, sym);
+    if (cur.sym_len == 0 || sym->type == SILENCE_SYMBOL) return phase;
+
+    switch (cfg->engine) {
+    case SYNTH_ENGINE_NCO: {
+        uint64_t n = (uint64_t)cur.sym_len;
+        uint64_t tri = (n * (n - 1)) / 2;
+        return nco_phase_to_rad(cur.nco_acc + n * cur.nco_inc + tri * (uint64_t)cur.nco_delta);
+    }
+    case SYNTH_ENGINE_SIMD:
+        return poly_end_phase(&cur);
+    case SYNTH_ENGINE_LIBM:
+    default:
+        if (sym->type == TONE_SYMBOL) {
+            double rfreq = 2.0 * M_PI * sym->tone.frequency / cfg->samplerate;
+            return fmod(cur.sym_phase + cur.sym_len * rfreq, 2.0 * M_PI);
+        } else {
+            // A varredura de referência acumula fmod a cada amostra; não há atalho exato.
+            const LinearSweep* sweep = &sym->sweep;
+            double freq_diff = sweep->freqend - sweep->freqstart;
+            double phase_for_sweep = cur.sym_phase;
+            for (int j = 0; j < cur.sym_len; ++j) {
+                double instantaneous_freq = sweep->freqstart + (freq_diff * (double)j / cur.sym_len);
+                double rfreq_step = 2.0 * M_PI * instantaneous_freq / cfg->samplerate;
+                phase_for_sweep = fmod(phase_for_sweep + rfreq_step, 2.0 * M_PI);
+            }
+            return phase_for_sweep;
+        }
+    }
+}
+
+// Renderiza até max_samples amostras em out (int16) ou fout (float32) a partir da
+// posição do cursor; coarse vale para o motor SIMD em int16.
+static int synth_render_impl(SynthCursor* cur, int16_t* out, float* fout, int16_t* qout, int max_samples,
+                             int coarse) {
+    int written = 0;
+    while (written < max_samples) {
+        const AudioSymbol* sym = &cur->sym;
+        if (!cur->sym_active) {
+            if (!cur->source.next(cur->source.ctx, &cur->sym)) break;
+            STATS_SYMBOL(cur->cfg->stats, cur->sym.type);
+            cur->sym_active = 1;
+            synth_begin_symbol(cur, sym);
+        }
+
+        int count = cur->sym_len - cur->sym_pos;
+        if (count > max_samples - written) count = max_samples - written;
+        int16_t* dst = fout ? NULL : out + written;
+        float* fdst = fout ? fout + written : NULL;
+        int16_t* qdst = qout ? qout + written : NULL;
+
+        if (cur->cached) {
+            const int16_t* pcm = cur->cached->pcm + cur->sym_pos;
+            if (fdst) sample_format_info(SAMPLE_FORMAT_FLOAT32)->convert(fdst, pcm, count);
+            else memcpy(dst, pcm, count * sizeof(int16_t));
+            if (cur->sym_pos + count == cur->sym_len) cur->phase = cur->cached->end_phase;
+        } else if (cur->cfg->engine == SYNTH_ENGINE_NCO) {
+            synth_render_nco(cur, sym, dst, fdst, qdst, count);
+        } else if (cur->cfg->engine == SYNTH_ENGINE_SIMD) {
+            synth_render_poly(cur, sym, dst, fdst, qdst, count, coarse);
+        } else {
+            synth_render_libm(cur, sym, dst, fdst, qdst, count);
+        }
+
+        written += count;
+        cur->sym_pos += count;
+        if (cur->sym_pos >= cur->sym_len) {
+            cur->sym_active = 0;
+            cur->sym_pos = 0;
+        }
+    }
+    return written;
+}
+
+// Renderiza até max_samples amostras a partir da posição do cursor.
+// Retorna o número de amostras escritas (0 quando o cronograma termina).
+int synth_render(SynthCursor* cur, int16_t* out, int max_samples) {
+    return synth_render_impl(cur, out, NULL, NULL, max_samples, 0);
+}
+
+// Como synth_render, e `quad` recebe a mesma saída com fase +pi/2 na mesma
+// passada pelos símbolos. O cursor não pode usar o cache de PCM.
+static int synth_render_pair(SynthCursor* cur, int16_t* out, int16_t* quad, int max_samples) {
+    return synth_render_impl(cur, out, NULL, quad, max_samples, 0);
+}
+
+// Como synth_render, mas já no formato de cfg->format: float32 sai direto dos
+// motores em precisão de float; u8 e μ-law usam o polinômio grosseiro do motor
+// SIMD e só então passam pela conversão. `out` recebe bytes_per_sample por amostra.
+int synth_render_format(SynthCursor* cur, void* out, int max_samples) {
+    const SampleFormatInfo* info = sample_format_info(cur->cfg->format);
+    switch (cur->cfg->format) {
+    case SAMPLE_FORMAT_FLOAT32:
+        return synth_render_impl(cur, NULL, (float*)out, NULL, max_samples, 0);
+    case SAMPLE_FORMAT_U8:
+    case SAMPLE_FORMAT_MULAW: {
+        int16_t pcm[STREAM_CHUNK_SAMPLES];
+        int written = 0;
+        while (written < max_samples) {
+            int n = max_samples - written < STREAM_CHUNK_SAMPLES ? max_samples - written : STREAM_CHUNK_SAMPLES;
+            int produced = synth_render_impl(cur, pcm, NULL, NULL, n, 1);
+            info->convert((uint8_t*)out + (size_t)written * info->bytes_per_sample, pcm, produced);
+            written += produced;
+            if (produced < n) break;
+        }
+        return written;
+    }
+    case SAMPLE_FORMAT_INT16:
+    default:
+        return synth_render_impl(cur, (int16_t*)out, NULL, NULL, max_samples, 0);
+    }
+}
+
+int pcm_cache_init(PcmCache* cache, const SynthConfig* cfg) {
+    cache->cfg = cfg;
+    cache->bytes = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->slots = (PcmCacheEntry*)calloc(PCM_CACHE_SLOTS, sizeof(PcmCacheEntry));
+    if (!cache->slots) { perror("calloc PcmCache"); return -1; }
+    return 0;
+}
+
+void pcm_cache_free(PcmCache* cache) {
+    if (!cache->slots) return;
+    for (int i = 0; i < PCM_CACHE_SLOTS; ++i) free(cache->slots[i].pcm);
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->bytes = 0;
+}
+
+// Devolve o trecho pronto para (segmento, frequência, duração, fase quantizada),
+// renderizando-o na primeira vez. NULL se o cache estiver cheio.
+static const PcmCacheEntry* pcm_cache_get(PcmCache* cache, const AudioSymbol* sym, int length, double phase) {
+    int bucket = (int)floor(phase / (2.0 * M_PI) * PCM_CACHE_PHASE_BUCKETS + 0.5) % PCM_CACHE_PHASE_BUCKETS;
+    if (bucket < 0) bucket += PCM_CACHE_PHASE_BUCKETS;
+
+    uint64_t freq_bits;
+    memcpy(&freq_bits, &sym->tone.frequency, sizeof(freq_bits));
+    uint64_t h = (freq_bits ^ ((uint64_t)length << 20) ^ ((uint64_t)sym->segment << 56) ^ (uint64_t)bucket)
+                 * 0x9E3779B97F4A7C15ull;
+    for (int probe = 0; probe < PCM_CACHE_SLOTS; ++probe) {
+        PcmCacheEntry* e = &cache->slots[((h >> 52) + probe) & (PCM_CACHE_SLOTS - 1)];
+        if (e->segment == PCM_SEG_NONE) {
+            size_t bytes = (size_t)length * sizeof(int16_t);
+            if (cache->bytes + bytes > PCM_CACHE_MAX_BYTES) return NULL;
+            e->pcm = (int16_t*)malloc(bytes);
+            if (!e->pcm) return NULL;
+            STATS_ALLOC(cache->cfg->stats, bytes);
+
+            AudioSymbol tone = *sym;
+            tone.segment = PCM_SEG_NONE;
+            tone.tone.phase_offset = 0.0;
+            SymbolSchedule one = { &tone, 1, 1, cache->cfg->samplerate, SAMPLE_CLOCK_HALF };
+            SynthCursor tmp;
+            synth_cursor_init(&tmp, &one, cache->cfg);
+            tmp.phase = bucket * (2.0 * M_PI / PCM_CACHE_PHASE_BUCKETS);
+            synth_render(&tmp, e->pcm, length);
+
+            e->segment = sym->segment;
+            e->frequency = sym->tone.frequency;
+            e->amplitude = sym->tone.amplitude;
+            e->length = length;
+            e->bucket = bucket;
+            e->end_phase = tmp.phase;
+            cache->bytes += bytes;
+            cache->misses++;
+            return e;
+        }
+        if (e->segment == sym->segment && e->frequency == sym->tone.frequency &&
+            e->amplitude == sym->tone.amplitude && e->length == length && e->bucket == bucket) {
+            cache->hits++;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+int16_t* generate_wav(const SymbolSchedule* sched, const SynthConfig* cfg, int* wav_length) {
+    long long total_samples_long = schedule_total_samples(sched);
+
+    if (total_samples_long == 0) {
+        fprintf(stderr, "ERRO: Nenhum símbolo para gerar áudio ou duração total zero.\n");
+        *wav_length = 0;
+        return NULL;
+    }
+    if (total_samples_long > INT32_MAX) {
+        fprintf(stderr, "ERRO: Número total de amostras excede o limite de int32_t!\n");
+        *wav_length = 0;
+        return NULL;
+    }
+    int total_samples = (int)total_samples_long;
+
+    int16_t* wav = (int16_t*)malloc(total_samples * sizeof(int16_t));
+    if (!wav) {
+        perror("malloc para buffer WAV falhou");
+        *wav_length = 0;
+        return NULL;
+    }
+
+    STATS_ALLOC(cfg->stats, (long long)total_samples * sizeof(int16_t));
+
+    StatsMark mark;
+    STATS_BEGIN(cfg->stats, mark);
+    SynthCursor cursor;
+    synth_cursor_init(&cursor, sched, cfg);
+    *wav_length = synth_render(&cursor, wav, total_samples);
+    STATS_END(cfg->stats, STATS_SYNTH, mark);
+    return wav;
+}
+
+// Formatos além do int16: o motor sintetiza no formato do sink (no mapeamento do
+// arquivo, quando há) e não há passada de conversão depois.
+static long long stream_wav_source_native(SynthCursor* cursor, const SynthConfig* cfg, SampleSink* sink) {
+    float block[STREAM_CHUNK_SAMPLES]; // cabe qualquer formato (até 4 bytes por amostra)
+    long long total_written = 0;
+    int produced;
+    StatsMark mark;
+    for (;;) {
+        void* dst = sink->direct_native ? sink->direct_native(sink->ctx, total_written, STREAM_CHUNK_SAMPLES) : NULL;
+        if (!dst) dst = block;
+        STATS_BEGIN(cfg->stats, mark);
+        produced = synth_render_format(cursor, dst, STREAM_CHUNK_SAMPLES);
+        STATS_END(cfg->stats, STATS_SYNTH, mark);
+        if (produced <= 0) break;
+        STATS_BEGIN(cfg->stats, mark);
+        if (sink->write_native(sink->ctx, dst, produced) < 0) {
+            fprintf(stderr, "ERRO: Falha ao entregar bloco de amostras ao sink.\n");
+            if (sink->close) sink->close(sink->ctx, total_written);
+            return -1;
+        }
+        STATS_END(cfg->stats, STATS_OUTPUT, mark);
+        STATS_SAMPLES(cfg->stats, produced);
+        total_written += produced;
+    }
+
+    STATS_BEGIN(cfg->stats, mark);
+    if (sink->close && sink->close(sink->ctx, total_written) < 0) return -1;
+    STATS_END(cfg->stats, STATS_OUTPUT, mark);
+    STATS_ALLOC(cfg->stats, sizeof(block));
+    return total_written;
+}
+
+// Gera o sinal em blocos de STREAM_CHUNK_SAMPLES e entrega cada bloco ao sink assim
+// que fica cheio; a memória usada independe da duração do modo.
+long long stream_wav_source(SymbolSource source, const SynthConfig* cfg, PcmCache* cache, SampleSink* sink) {
+    int16_t ring[STREAM_RING_CHUNKS][STREAM_CHUNK_SAMPLES];
+    SynthCursor cursor;
+    synth_cursor_init_source(&cursor, source, cfg);
+    cursor.cache = cache;
+    if (cfg->format != SAMPLE_FORMAT_INT16 && sink->write_native) {
+        return stream_wav_source_native(&cursor, cfg, sink);
+    }
+
+    long long total_written = 0;
+    int slot = 0;
+    int produced;
+    StatsMark mark;
+    for (;;) {
+        int16_t* dst = sink->direct ? sink->direct(sink->ctx, total_written, STREAM_CHUNK_SAMPLES) : NULL;
+        if (!dst) dst = ring[slot];
+        STATS_BEGIN(cfg->stats, mark);
+        produced = synth_render(&cursor, dst, STREAM_CHUNK_SAMPLES);
+        STATS_END(cfg->stats, STATS_SYNTH, mark);
+        if (produced <= 0) break;
+        STATS_BEGIN(cfg->stats, mark);
+        if (sink->write(sink->ctx, dst, produced) < 0) {
+            fprintf(stderr, "ERRO: Falha ao entregar bloco de amostras ao sink.\n");
+            if (sink->close) sink->close(sink->ctx, total_written);
+            return -1;
+        }
+        STATS_END(cfg->stats, STATS_OUTPUT, mark);
+        STATS_SAMPLES(cfg->stats, produced);
+        total_written += produced;
+        slot = (slot + 1) % STREAM_RING_CHUNKS;
+    }
+
+    STATS_BEGIN(cfg->stats, mark);
+    if (sink->close && sink->close(sink->ctx, total_written) < 0) return -1;
+    STATS_END(cfg->stats, STATS_OUTPUT, mark);
+    STATS_ALLOC(cfg->stats, sizeof(ring));
+    return total_written;
+}
+
+long long stream_wav(const SymbolSchedule* sched, const SynthConfig* cfg, SampleSink* sink) {
+    ScheduleSource ss;
+    return stream_wav_source(schedule_source(&ss, sched), cfg, NULL, sink);
+}
+
+// Executor com roubo de trabalho: cada thread recebe uma faixa contígua de tarefas
+// e, ao esgotá-la, passa a consumir do início das faixas das outras threads.
+typedef struct {
+    atomic_int next;
+    int end;
+} JobRange;
+
+typedef struct {
+    JobRange* ranges;
+    int nthreads;
+    void (*fn)(void* ctx, int job, int worker);
+    void* ctx;
+} JobRunner;
+
+typedef struct {
+    JobRunner* runner;
+    int worker;
+} JobWorkerArg;
+
+static void* job_worker_main(void* arg) {
+    JobWorkerArg* wa = (JobWorkerArg*)arg;
+    JobRunner* runner = wa->runner;
+    for (int v = 0; v < runner->nthreads; ++v) {
+        JobRange* range = &runner->ranges[(wa->worker + v) % runner->nthreads];
+        int job;
+        while ((job = atomic_fetch_add(&range->next, 1)) < range->end) {
+            runner->fn(runner->ctx, job, wa->worker);
+        }
+    }
+    return NULL;
+}
+
+int default_thread_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > MAX_WORKER_THREADS) n = MAX_WORKER_THREADS;
+    return (int)n;
+}
+
+// Executa fn(ctx, job, worker) para job em [0, njobs) usando nthreads threads
+// (a thread chamadora é o worker 0). Retorna após todas as tarefas terminarem.
+int run_parallel_jobs(int njobs, int nthreads, void (*fn)(void* ctx, int job, int worker), void* ctx) {
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_WORKER_THREADS) nthreads = MAX_WORKER_THREADS;
+    if (nthreads > njobs) nthreads = njobs > 0 ? njobs : 1;
+
+    JobRange ranges[MAX_WORKER_THREADS];
+    JobWorkerArg args[MAX_WORKER_THREADS];
+    pthread_t threads[MAX_WORKER_THREADS];
+    JobRunner runner = { ranges, nthreads, fn, ctx };
+    for (int w = 0; w < nthreads; ++w) {
+        atomic_init(&ranges[w].next, (int)((long long)njobs * w / nthreads));
+        ranges[w].end = (int)((long long)njobs * (w + 1) / nthreads);
+        args[w].runner = &runner;
+        args[w].worker = w;
+    }
+
+    int started = 1;
+    for (int w = 1; w < nthreads; ++w, ++started) {
+        if (pthread_create(&threads[w], NULL, job_worker_main, &args[w]) != 0) {
+            // As faixas sem thread são roubadas pelas que já estão rodando.
+            fprintf(stderr, "Aviso: pthread_create falhou; usando %d threads.\n", started);
+            break;
+        }
+    }
+    job_worker_main(&args[0]);
+    for (int w = 1; w < started; ++w) {
+        pthread_join(threads[w], NULL);
+    }
+    return 0;
+}
+
+typedef struct {
+    const SymbolSchedule* sched;
+    const SynthConfig* cfg;
+    int16_t* wav;
+    int* job_first_sym;   // njobs + 1 entradas (a última é sched->count)
+    long long* job_offset;
+    double* job_phase;
+} ParallelRenderCtx;
+
+static void render_job(void* arg, int job, int worker) {
+    (void)worker;
+    ParallelRenderCtx* ctx = (ParallelRenderCtx*)arg;
+    int first = ctx->job_first_sym[job];
+    int last = ctx->job_first_sym[job + 1];
+    SymbolSchedule view = { ctx->sched->syms + first, last - first, last - first, ctx->cfg->samplerate,
+                            SAMPLE_CLOCK_HALF };
+
+    SynthCursor cursor;
+    synth_cursor_init(&cursor, &view, ctx->cfg);
+    cursor.phase = ctx->job_phase[job];
+    long long job_samples = ctx->job_offset[job + 1] - ctx->job_offset[job];
+    synth_render(&cursor, ctx->wav + ctx->job_offset[job], (int)job_samples);
+}
+
+// Igual a generate_wav, mas dividindo o cronograma em tarefas de ~uma linha.
+// Uma passada de prefixo serial calcula o deslocamento e a fase inicial de cada
+// tarefa; as threads então escrevem em regiões disjuntas do buffer. A saída é
+// idêntica bit a bit à do caminho serial para qualquer motor. Nos motores NCO e
+// SIMD a fase ao fim de um símbolo sai em forma fechada e a passada é barata; no
+// libm a varredura acumula fmod amostra a amostra e a passada custa quase uma
+// síntese sem o seno, o que limita o ganho com mais threads.
+// Renderiza o cronograma inteiro em `wav` (schedule_total_samples amostras), que
+// pode ser um buffer próprio ou a região mapeada do arquivo de saída.
+int render_schedule_parallel(const SymbolSchedule* sched, const SynthConfig* cfg, int nthreads, int16_t* wav) {
+    long long total_samples_long = schedule_total_samples(sched);
+    int max_jobs = (int)(total_samples_long / PARALLEL_JOB_SAMPLES) + 2;
+    int* job_first_sym = (int*)malloc((max_jobs + 1) * sizeof(int));
+    long long* job_offset = (long long*)malloc((max_jobs + 1) * sizeof(long long));
+    double* job_phase = (double*)malloc((max_jobs + 1) * sizeof(double));
+    if (!job_first_sym || !job_offset || !job_phase) {
+        perror("malloc para renderização paralela falhou");
+        free(job_first_sym); free(job_offset); free(job_phase);
+        return -1;
+    }
+
+    // Passada de prefixo: fase e deslocamento no início de cada tarefa.
+    StatsMark mark;
+    STATS_BEGIN(cfg->stats, mark);
+    int njobs = 0;
+    long long offset = 0;
+    long long job_start = 0;
+    double phase = 0.0;
+    for (int i = 0; i < sched->count; ++i) {
+        if (i == 0 || offset - job_start >= PARALLEL_JOB_SAMPLES) {
+            job_first_sym[njobs] = i;
+            job_offset[njobs] = offset;
+            job_phase[njobs] = phase;
+            job_start = offset;
+            njobs++;
+        }
+        offset += sched->syms[i].samples;
+        phase = synth_symbol_end_phase(cfg, &sched->syms[i], phase);
+    }
+    job_first_sym[njobs] = sched->count;
+    job_offset[njobs] = offset;
+    assert(njobs <= max_jobs);
+    STATS_END(cfg->stats, STATS_PREFIX, mark);
+
+    ParallelRenderCtx ctx = { sched, cfg, wav, job_first_sym, job_offset, job_phase };
+    STATS_BEGIN(cfg->stats, mark);
+    run_parallel_jobs(njobs, nthreads, render_job, &ctx);
+    STATS_END(cfg->stats, STATS_SYNTH, mark);
+
+    free(job_first_sym);
+    free(job_offset);
+    free(job_phase);
+    return 0;
+}
+
+int16_t* generate_wav_parallel(const SymbolSchedule* sched, const SynthConfig* cfg, int nthreads, int* wav_length) {
+    *wav_length = 0;
+    long long total_samples_long = schedule_total_samples(sched);
+    if (total_samples_long == 0) {
+        fprintf(stderr, "ERRO: Nenhum símbolo para gerar áudio ou duração total zero.\n");
+        return NULL;
+    }
+    if (total_samples_long > INT32_MAX) {
+        fprintf(stderr, "ERRO: Número total de amostras excede o limite de int32_t!\n");
+        return NULL;
+    }
+    int16_t* wav = (int16_t*)malloc(total_samples_long * sizeof(int16_t));
+    if (!wav) {
+        perror("malloc para buffer WAV falhou");
+        return NULL;
+    }
+    STATS_ALLOC(cfg->stats, total_samples_long * sizeof(int16_t));
+    if (render_schedule_parallel(sched, cfg, nthreads, wav) < 0) {
+        free(wav);
+        return NULL;
+    }
+    *wav_length = (int)total_samples_long;
+    return wav;
+}
+
+// Compara um motor de síntese com a referência libm no cronograma inteiro:
+// SNR (sinal / erro) em dB e o maior erro absoluto em LSB.
+int measure_engine_error(const SymbolSchedule* sched, const SynthConfig* cfg,
+                         double* snr_db, int* max_abs_err) {
+    SynthConfig* ref_cfg = (SynthConfig*)malloc(sizeof(SynthConfig));
+    if (!ref_cfg) { perror("malloc SynthConfig"); return -1; }
+    synth_config_init(ref_cfg, SYNTH_ENGINE_LIBM, cfg->samplerate);
+
+    int16_t ref[STREAM_CHUNK_SAMPLES];
+    int16_t test[STREAM_CHUNK_SAMPLES];
+    SynthCursor ref_cur, test_cur;
+    synth_cursor_init(&ref_cur, sched, ref_cfg);
+    synth_cursor_init(&test_cur, sched, cfg);
+
+    double signal_power = 0.0, error_power = 0.0;
+    int max_err = 0;
+    int produced;
+    while ((produced = synth_render(&ref_cur, ref, STREAM_CHUNK_SAMPLES)) > 0) {
+        synth_render(&test_cur, test, produced);
+        for (int k = 0; k < produced; ++k) {
+            int err = test[k] - ref[k];
+            signal_power += (double)ref[k] * ref[k];
+            error_power += (double)err * err;
+            if (abs(err) > max_err) max_err = abs(err);
+        }
+    }
+    free(ref_cfg);
+
+    *snr_db = error_power > 0.0 ? 10.0 * log10(signal_power / error_power) : INFINITY;
+    *max_abs_err = max_err;
+    return 0;
+}
+
+
+
+#define TONE(freq, dur, seg) { LINE_TONE, CH_R, (freq), 0.0, (dur), (seg) }
+#define TONE_ALT(even, odd, dur, seg) { LINE_TONE_ALT, CH_R, (even), (odd), (dur), (seg) }
+#define SCAN(chan, dur) { LINE_SCAN, (chan), 0.0, 0.0, (dur), PCM_SEG_NONE }
+#define FLAG_SEGMENT { LINE_FLAG, CH_R, 0.0, 0.0, SSTV_FLAG_SEGMENT_TOTAL_DURATION, PCM_SEG_NONE }
+
+#define CLASSIC_PORCH_DURATION (SSTV_COLOR_SCANLINE_DURATION / COVER_IMG_WIDTH / 2.0)
+#define CLASSIC_CHANNEL(chan) \
+    TONE(SSTV_HSYNC_FREQ, SSTV_HSYNC_DURATION, PCM_SEG_HSYNC), \
+    TONE(SSTV_PORCH_FREQ, CLASSIC_PORCH_DURATION, PCM_SEG_PORCH), \
+    SCAN(chan, SSTV_COLOR_SCANLINE_DURATION), \
+    TONE(SSTV_PORCH_FREQ, CLASSIC_PORCH_DURATION, PCM_SEG_PORCH), \
+    FLAG_SEGMENT
+
+static const SstvMode sstv_mode_classico = {
+    "classico", "Clássico (RGB sequencial com flag)", -1, COVER_IMG_WIDTH, COVER_IMG_HEIGHT, 1,
+    SSTV_COLOR_RGB, 0, 1, 0.0, 15,
+    { CLASSIC_CHANNEL(CH_R), CLASSIC_CHANNEL(CH_G), CLASSIC_CHANNEL(CH_B) }
+};
+
+#define MARTIN_PROGRAM(chan_dur) 8, { \
+    TONE(1200.0, 0.004862, PCM_SEG_HSYNC), TONE(1500.0, 0.000572, PCM_SEG_PORCH), \
+    SCAN(CH_G, chan_dur), TONE(1500.0, 0.000572, PCM_SEG_PORCH), \
+    SCAN(CH_B, chan_dur), TONE(1500.0, 0.000572, PCM_SEG_PORCH), \
+    SCAN(CH_R, chan_dur), TONE(1500.0, 0.000572, PCM_SEG_PORCH) }
+
+static const SstvMode sstv_mode_m1 = {
+    "m1", "Martin M1", 44, 320, 256, 1, SSTV_COLOR_RGB, 1, 0, 0.0, MARTIN_PROGRAM(0.146432)
+};
+static const SstvMode sstv_mode_m2 = {
+    "m2", "Martin M2", 40, 320, 256, 1, SSTV_COLOR_RGB, 1, 0, 0.0, MARTIN_PROGRAM(0.073216)
+};
+
+#define SCOTTIE_PROGRAM(chan_dur) 7, { \
+    TONE(1500.0, 0.0015, PCM_SEG_PORCH), SCAN(CH_G, chan_dur), \
+    TONE(1500.0, 0.0015, PCM_SEG_PORCH), SCAN(CH_B, chan_dur), \
+    TONE(1200.0, 0.009, PCM_SEG_HSYNC), TONE(1500.0, 0.0015, PCM_SEG_PORCH), \
+    SCAN(CH_R, chan_dur) }
+
+static const SstvMode sstv_mode_s1 = {
+    "s1", "Scottie S1", 60, 320, 256, 1, SSTV_COLOR_RGB, 1, 0, 0.009, SCOTTIE_PROGRAM(0.138240)
+};
+static const SstvMode sstv_mode_s2 = {
+    "s2", "Scottie S2", 56, 320, 256, 1, SSTV_COLOR_RGB, 1, 0, 0.009, SCOTTIE_PROGRAM(0.088064)
+};
+static const SstvMode sstv_mode_sdx = {
+    "sdx", "Scottie DX", 76, 320, 256, 1, SSTV_COLOR_RGB, 1, 0, 0.009, SCOTTIE_PROGRAM(0.345600)
+};
+
+static const SstvMode sstv_mode_r36 = {
+    "r36", "Robot 36", 8, 320, 240, 1, SSTV_COLOR_YCBCR, 1, 0, 0.0, 6, {
+        TONE(1200.0, 0.009, PCM_SEG_HSYNC), TONE(1500.0, 0.003, PCM_SEG_PORCH),
+        SCAN(CH_Y, 0.088),
+        TONE_ALT(1500.0, 2300.0, 0.0045, PCM_SEG_PORCH), TONE(1900.0, 0.0015, PCM_SEG_PORCH),
+        SCAN(CH_CHROMA_ALT, 0.044) }
+};
+static const SstvMode sstv_mode_r72 = {
+    "r72", "Robot 72", 12, 320, 240, 1, SSTV_COLOR_YCBCR, 1, 0, 0.0, 9, {
+        TONE(1200.0, 0.009, PCM_SEG_HSYNC), TONE(1500.0, 0.003, PCM_SEG_PORCH),
+        SCAN(CH_Y, 0.138),
+        TONE(1500.0, 0.0045, PCM_SEG_PORCH), TONE(1900.0, 0.0015, PCM_SEG_PORCH),
+        SCAN(CH_CR, 0.069),
+        TONE(2300.0, 0.0045, PCM_SEG_PORCH), TONE(1900.0, 0.0015, PCM_SEG_PORCH),
+        SCAN(CH_CB, 0.069) }
+};
+
+#define PD_PROGRAM(chan_dur) 6, { \
+    TONE(1200.0, 0.020, PCM_SEG_HSYNC), TONE(1500.0, 0.00208, PCM_SEG_PORCH), \
+    SCAN(CH_Y, chan_dur), SCAN(CH_CR, chan_dur), SCAN(CH_CB, chan_dur), SCAN(CH_Y2, chan_dur) }
+
+static const SstvMode sstv_mode_pd90 = {
+    "pd90", "PD90", 99, 320, 256, 2, SSTV_COLOR_YCBCR, 1, 0, 0.0, PD_PROGRAM(0.170240)
+};
+static const SstvMode sstv_mode_pd120 = {
+    "pd120", "PD120", 95, 640, 496, 2, SSTV_COLOR_YCBCR, 1, 0, 0.0, PD_PROGRAM(0.121600)
+};
+
+// Cada modo da lista ganha uma instância própria do gerador de símbolos da imagem.
+#define SSTV_MODE_LIST(X) \
+    X(classico) X(m1) X(m2) X(s1) X(s2) X(sdx) X(r36) X(r72) X(pd90) X(pd120)
+
+int generate_vox_signal(SymbolSchedule* sched) {
+    int freqs[VOX_SYMBOL_COUNT] = { 1900, 1500, 1900, 1500, 2300, 1500, 2300, 1500 };
+    for (int i = 0; i < VOX_SYMBOL_COUNT; ++i) {
+        if (add_tone_symbol(sched, SSTV_VOX_TONE_DURATION, freqs[i], 1.0, 0.0) < 0) return -1;
+        sched->syms[sched->count - 1].segment = PCM_SEG_HEADER;
+    }
+    return VOX_SYMBOL_COUNT;
+}
+
+static int add_header_tone(SymbolSchedule* sched, double duration, double freq) {
+    if (add_tone_symbol(sched, duration, freq, 1.0, 0.0) < 0) return -1;
+    sched->syms[sched->count - 1].segment = PCM_SEG_HEADER;
+    return 0;
+}
+
+// VIS padrão: líder, pausa, líder, bit de início, 7 bits do código (LSB primeiro),
+// paridade par e bit de parada.
+static int generate_standard_vis(SymbolSchedule* sched, int vis_code) {
+    int parity = 0;
+    if (add_header_tone(sched, SSTV_VIS_LEADER_DURATION, SSTV_VIS_LEADER_FREQ) < 0 ||
+        add_header_tone(sched, SSTV_VIS_BREAK_DURATION, SSTV_HSYNC_FREQ) < 0 ||
+        add_header_tone(sched, SSTV_VIS_LEADER_DURATION, SSTV_VIS_LEADER_FREQ) < 0 ||
+        add_header_tone(sched, SSTV_VIS_BIT_DURATION, SSTV_HSYNC_FREQ) < 0) return -1;
+    for (int bit = 0; bit < 7; ++bit) {
+        int one = (vis_code >> bit) & 1;
+        parity ^= one;
+        if (add_header_tone(sched, SSTV_VIS_BIT_DURATION,
+                            one ? SSTV_VIS_BIT_ONE_FREQ : SSTV_VIS_BIT_ZERO_FREQ) < 0) return -1;
+    }
+    if (add_header_tone(sched, SSTV_VIS_BIT_DURATION,
+                        parity ? SSTV_VIS_BIT_ONE_FREQ : SSTV_VIS_BIT_ZERO_FREQ) < 0 ||
+        add_header_tone(sched, SSTV_VIS_BIT_DURATION, SSTV_HSYNC_FREQ) < 0) return -1;
+    return 13;
+}
+
+int generate_vis_signal(SymbolSchedule* sched, const SstvMode* mode) {
+    if (mode->vis_code >= 0) return generate_standard_vis(sched, mode->vis_code);
+
+    int freqs[VIS_SYMBOL_COUNT] = {
+        1900, 1200, 1900, 1200, 1100, 1300, 1100, 1300, 1100, 1300, 1100, 1300, 1100, 1300, 1200
+    };
+    for (int i = 0; i < VIS_SYMBOL_COUNT; ++i) {
+        double duration = (i == 1 || i == VIS_SYMBOL_COUNT - 1) ?
+                           SSTV_VIS_HEADER_TONE_DURATION_SHORT : SSTV_VIS_HEADER_TONE_DURATION_LONG;
+        if (add_header_tone(sched, duration, freqs[i]) < 0) return -1;
+    }
+    return VIS_SYMBOL_COUNT;
+}
+
+int generate_eof_signal(SymbolSchedule* sched) {
+    int freqs[EOF_SYMBOL_COUNT] = { 1900, 1500, 1900, 1500 };
+    for (int i = 0; i < EOF_SYMBOL_COUNT; ++i) {
+        if (add_tone_symbol(sched, SSTV_EOF_TONE_DURATION, freqs[i], 1.0, 0.0) < 0) return -1;
+        sched->syms[sched->count - 1].segment = PCM_SEG_EOF;
+    }
+    return EOF_SYMBOL_COUNT;
+}
+
+
+// Ingestão das imagens: a origem é lida linha a linha, normalizada para RGB (ou
+// cinza, na flag) e acumulada com o peso da sobreposição vertical; quando uma
+// linha do modo fecha, a redução horizontal por área e a conversão para YCbCr
+// saem na mesma passada. PPM/PGM de 8 bits são lidos direto do arquivo, com só
+// uma linha da origem em memória; os outros formatos passam pelo stb_image, que
+// não decodifica por linha, e o buffer dele é liberado logo após a reamostragem.
+typedef struct {
+    FILE* f;                 // netpbm lido linha a linha
+    uint8_t* decoded;        // imagem inteira vinda do stb_image
+    const uint8_t* pixels;   // linhas contíguas (decoded ou do chamador)
+    uint8_t* row_buf;
+    int w, h, channels;
+    int next_row;
+} ImageReader;
+
+static inline uint8_t clamp_u8(double v) {
+    return v <= 0.0 ? 0 : v >= 255.0 ? 255 : (uint8_t)(v + 0.5);
+}
+
+// YCbCr (ITU-R BT.601, faixa de estúdio) como nos modos Robot e PD.
+static inline uint8_t bt601_y(double R, double G, double B) {
+    return clamp_u8(16.0 + (65.738 * R + 129.057 * G + 25.064 * B) / 256.0);
+}
+
+static inline double bt601_cr(double R, double G, double B) {
+    return 128.0 + (112.439 * R - 94.154 * G - 18.285 * B) / 256.0;
+}
+
+static inline double bt601_cb(double R, double G, double B) {
+    return 128.0 + (-37.945 * R - 74.494 * G + 112.439 * B) / 256.0;
+}
+
+// Inteiro do cabeçalho netpbm (pula espaços e comentários; consome o separador).
+static int netpbm_read_int(FILE* f, int* out) {
+    int c = fgetc(f);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        if (c == '#') while (c != '\n' && c != EOF) c = fgetc(f);
+        c = fgetc(f);
+    }
+    if (c < '0' || c > '9') return -1;
+    long long v = 0;
+    while (c >= '0' && c <= '9') {
+        v = v * 10 + (c - '0');
+        if (v > INT32_MAX) return -1;
+        c = fgetc(f);
+    }
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static void image_reader_open_pixels(ImageReader* r, const uint8_t* pixels, int w, int h, int channels) {
+    memset(r, 0, sizeof(*r));
+    r->pixels = pixels;
+    r->w = w;
+    r->h = h;
+    r->channels = channels;
+}
+
+static int image_reader_open_file(ImageReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    char magic[2];
+    int maxval;
+    if (fread(magic, 1, 2, f) == 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6') &&
+        netpbm_read_int(f, &r->w) == 0 && netpbm_read_int(f, &r->h) == 0 &&
+        netpbm_read_int(f, &maxval) == 0 && maxval == 255 && r->w > 0 && r->h > 0) {
+        r->channels = magic[1] == '6' ? 3 : 1;
+        r->row_buf = (uint8_t*)malloc((size_t)r->w * r->channels);
+        if (!r->row_buf) { perror("malloc linha da imagem"); fclose(f); return -1; }
+        r->f = f;
+        return 0;
+    }
+    fclose(f);
+    r->decoded = stbi_load(path, &r->w, &r->h, &r->channels, 0);
+    r->pixels = r->decoded;
+    return r->decoded ? 0 : -1;
+}
+
+// Arquivo de imagem já em memória (qualquer formato do stb_image), decodificado inteiro.
+static int image_reader_open_memory(ImageReader* r, const void* data, size_t size) {
+    int w, h, channels;
+    if (size > INT32_MAX) {
+        fprintf(stderr, "ERRO: Imagem em memória grande demais (%zu bytes).\n", size);
+        return -1;
+    }
+    uint8_t* pixels = stbi_load_from_memory((const stbi_uc*)data, (int)size, &w, &h, &channels, 0);
+    if (!pixels) {
+        fprintf(stderr, "ERRO: Imagem em memória não pôde ser decodificada: %s\n", stbi_failure_reason());
+        return -1;
+    }
+    image_reader_open_pixels(r, pixels, w, h, channels);
+    r->decoded = pixels;
+    return 0;
+}
+
+static void image_reader_close(ImageReader* r) {
+    if (r->f) fclose(r->f);
+    stbi_image_free(r->decoded);
+    free(r->row_buf);
+    memset(r, 0, sizeof(*r));
+}
+
+// Próxima linha da origem (NULL no fim ou se o arquivo acabar antes).
+static const uint8_t* image_reader_row(ImageReader* r) {
+    if (r->next_row >= r->h) return NULL;
+    size_t bytes = (size_t)r->w * r->channels;
+    if (r->f) {
+        if (fread(r->row_buf, 1, bytes, r->f) != bytes) return NULL;
+        r->next_row++;
+        return r->row_buf;
+    }
+    return r->pixels + (size_t)r->next_row++ * bytes;
+}
+
+// Linha da origem em out_ch canais: RGB (cinza replicado, alfa ignorado) ou cinza
+// com a mesma luminância inteira que o stb_image usa.
+static void normalize_row(const uint8_t* src, int w, int src_ch, int out_ch, uint8_t* dst) {
+    for (int x = 0; x < w; ++x) {
+        const uint8_t* p = src + (size_t)x * src_ch;
+        uint8_t* q = dst + (size_t)x * out_ch;
+        if (out_ch == 1) {
+            q[0] = src_ch >= 3 ? (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8) : p[0];
+        } else if (src_ch >= 3) {
+            q[0] = p[0];
+            q[1] = p[1];
+            q[2] = p[2];
+        } else {
+            q[0] = q[1] = q[2] = p[0];
+        }
+    }
+}
+
+// acc[i] += row[i] * weight. Multiplicação e soma separadas (sem FMA), para que
+// todas as variantes deem o mesmo resultado.
+typedef void (*RowAccumulateFn)(float* acc, const uint8_t* row, int n, float weight);
+
+POLY_NO_CONTRACT
+static void row_accumulate_scalar(float* acc, const uint8_t* row, int n, float weight) {
+    for (int i = 0; i < n; ++i) acc[i] += (float)row[i] * weight;
+}
+
+#ifdef SSTV_X86_DISPATCH
+__attribute__((target("sse4.2"))) POLY_NO_CONTRACT
+static void row_accumulate_sse42(float* acc, const uint8_t* row, int n, float weight) {
+    const __m128 w = _mm_set1_ps(weight);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+        for (int q = 0; q < 4; ++q, v = _mm_srli_si128(v, 4)) {
+            __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+            _mm_storeu_ps(acc + i + 4 * q, _mm_add_ps(_mm_loadu_ps(acc + i + 4 * q), _mm_mul_ps(f, w)));
+        }
+    }
+    row_accumulate_scalar(acc + i, row + i, n - i, weight);
+}
+
+__attribute__((target("avx2"))) POLY_NO_CONTRACT
+static void row_accumulate_avx2(float* acc, const uint8_t* row, int n, float weight) {
+    const __m256 w = _mm256_set1_ps(weight);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(lo, w)));
+        _mm256_storeu_ps(acc + i + 8, _mm256_add_ps(_mm256_loadu_ps(acc + i + 8), _mm256_mul_ps(hi, w)));
+    }
+    row_accumulate_scalar(acc + i, row + i, n - i, weight);
+}
+#endif
+
+static RowAccumulateFn select_row_accumulate(void) {
+#ifdef SSTV_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return row_accumulate_avx2;
+    if (__builtin_cpu_supports("sse4.2")) return row_accumulate_sse42;
+#endif
+    return row_accumulate_scalar;
+}
+
+// Pixels da origem que cobrem cada pixel de destino e a fração coberta (em
+// unidades de destino, então os pesos de cada pixel somam 1).
+typedef struct {
+    int first, count, weights;
+} AreaTap;
+
+static int build_area_taps(int src, int dst, AreaTap** taps_out, float** weights_out) {
+    AreaTap* taps = (AreaTap*)malloc((size_t)dst * sizeof(AreaTap));
+    float* weights = (float*)malloc(((size_t)src + dst) * sizeof(float));
+    if (!taps || !weights) {
+        perror("malloc reamostragem");
+        free(taps);
+        free(weights);
+        return -1;
+    }
+    int n = 0;
+    for (int x = 0; x < dst; ++x) {
+        int s0 = (int)((long long)x * src / dst);
+        int s1 = (int)(((long long)(x + 1) * src + dst - 1) / dst);
+        taps[x].first = s0;
+        taps[x].weights = n;
+        for (int s = s0; s < s1; ++s) {
+            double a = fmax((double)s * dst / src, (double)x);
+            double b = fmin((double)(s + 1) * dst / src, (double)(x + 1));
+            weights[n++] = (float)(b - a);
+        }
+        taps[x].count = n - taps[x].weights;
+    }
+    *taps_out = taps;
+    *weights_out = weights;
+    return 0;
+}
+
+// Uma linha transmitida em YCbCr a partir das linhas RGB já reamostradas.
+static void ycbcr_convert_line(const SstvMode* mode, const uint8_t* rgb, int line, uint8_t* ycbcr) {
+    size_t plane = (size_t)(mode->height / mode->rows_per_line) * mode->width;
+    uint8_t* y_rows[2] = { ycbcr + (size_t)line * mode->width, ycbcr + plane + (size_t)line * mode->width };
+    uint8_t* cr_row = ycbcr + 2 * plane + (size_t)line * mode->width;
+    uint8_t* cb_row = ycbcr + 3 * plane + (size_t)line * mode->width;
+    for (int x = 0; x < mode->width; ++x) {
+        double cr = 0.0, cb = 0.0;
+        for (int r = 0; r < mode->rows_per_line; ++r) {
+            const uint8_t* px = rgb + ((size_t)(line * mode->rows_per_line + r) * mode->width + x) * 3;
+            double R = px[0], G = px[1], B = px[2];
+            y_rows[r][x] = bt601_y(R, G, B);
+            cr += bt601_cr(R, G, B);
+            cb += bt601_cb(R, G, B);
+        }
+        cr_row[x] = clamp_u8(cr / mode->rows_per_line);
+        cb_row[x] = clamp_u8(cb / mode->rows_per_line);
+    }
+}
+
+// Reamostra por área a imagem do leitor para dst_w x dst_h em out_ch canais.
+// Com ycbcr_mode, cada linha transmitida vira YCbCr assim que suas linhas fecham.
+// Só o acúmulo vertical (por linha da origem) é vetorizado; os taps horizontais
+// rodam escalares, uma vez por linha de destino.
+static int ingest_image(ImageReader* r, int dst_w, int dst_h, int out_ch, const SstvMode* ycbcr_mode,
+                        uint8_t* out, uint8_t* ycbcr, const char* what) {
+    size_t src_n = (size_t)r->w * out_ch;
+    float* acc = (float*)calloc(src_n, sizeof(float));
+    uint8_t* norm = r->channels == out_ch ? NULL : (uint8_t*)malloc(src_n);
+    AreaTap* taps = NULL;
+    float* weights = NULL;
+    if (!acc || (r->channels != out_ch && !norm) || build_area_taps(r->w, dst_w, &taps, &weights) < 0) {
+        if (!acc || (r->channels != out_ch && !norm)) perror("malloc reamostragem");
+        free(acc);
+        free(norm);
+        return -1;
+    }
+    RowAccumulateFn accumulate = select_row_accumulate();
+    int status = 0;
+    int d = 0; // linha de destino aberta
+    for (int y = 0; y < r->h && status == 0; ++y) {
+        const uint8_t* row = image_reader_row(r);
+        if (!row) {
+            fprintf(stderr, "ERRO: %s truncada (linha %d de %d).\n", what, y, r->h);
+            status = -1;
+            break;
+        }
+        if (norm) {
+            normalize_row(row, r->w, r->channels, out_ch, norm);
+            row = norm;
+        }
+        // A linha y cobre [y, y + 1) * dst_h / h em unidades de destino.
+        double s0 = (double)((long long)y * dst_h) / r->h;
+        double s1 = (double)((long long)(y + 1) * dst_h) / r->h;
+        for (; d < dst_h && d < s1; ++d) {
+            accumulate(acc, row, (int)src_n, (float)(fmin(s1, d + 1.0) - fmax(s0, (double)d)));
+            if (s1 < d + 1.0) break; // a linha d continua na próxima linha da origem
+            uint8_t* dst = out + (size_t)d * dst_w * out_ch;
+            for (int x = 0; x < dst_w; ++x) {
+                const AreaTap* t = &taps[x];
+                for (int c = 0; c < out_ch; ++c) {
+                    float sum = 0.0f;
+                    for (int k = 0; k < t->count; ++k) {
+                        sum += weights[t->weights + k] * acc[(size_t)(t->first + k) * out_ch + c];
+                    }
+                    dst[x * out_ch + c] = clamp_u8(sum);
+                }
+            }
+            memset(acc, 0, src_n * sizeof(float));
+            if (ycbcr_mode && (d + 1) % ycbcr_mode->rows_per_line == 0) {
+                ycbcr_convert_line(ycbcr_mode, out, d / ycbcr_mode->rows_per_line, ycbcr);
+            }
+        }
+    }
+    free(acc);
+    free(norm);
+    free(taps);
+    free(weights);
+    return status;
+}
+
+// Capa na resolução do modo (e em YCbCr quando o modo pede).
+static int ingest_cover(ImageReader* r, const SstvMode* mode, SstvImages* img, const char* what) {
+    size_t pixels = (size_t)mode->width * mode->height;
+    uint8_t* cover = (uint8_t*)malloc(pixels * 3);
+    uint8_t* ycbcr = mode->color == SSTV_COLOR_YCBCR ? (uint8_t*)malloc(pixels / mode->rows_per_line * 4) : NULL;
+    if (!cover || (mode->color == SSTV_COLOR_YCBCR && !ycbcr)) {
+        perror("malloc capa");
+        free(cover);
+        free(ycbcr);
+        return -1;
+    }
+    if (ingest_image(r, mode->width, mode->height, 3, ycbcr ? mode : NULL, cover, ycbcr, what) < 0) {
+        free(cover);
+        free(ycbcr);
+        return -1;
+    }
+    img->cover = cover;
+    img->cover_w = mode->width;
+    img->cover_h = mode->height;
+    img->cover_channels = 3;
+    img->ycbcr = ycbcr;
+    img->ycbcr_mode = ycbcr ? mode : NULL;
+    return 0;
+}
+
+static int ingest_flag(ImageReader* r, SstvImages* img, const char* what) {
+    uint8_t* flag = (uint8_t*)malloc(FLAG_IMG_WIDTH * FLAG_IMG_HEIGHT);
+    if (!flag) { perror("malloc flag"); return -1; }
+    if (ingest_image(r, FLAG_IMG_WIDTH, FLAG_IMG_HEIGHT, 1, NULL, flag, NULL, what) < 0) {
+        free(flag);
+        return -1;
+    }
+    img->flag = flag;
+    img->flag_w = FLAG_IMG_WIDTH;
+    img->flag_h = FLAG_IMG_HEIGHT;
+    return 0;
+}
+
+// Dimensões do arquivo sem decodificar os pixels.
+int probe_image_size(const char* filename, int* width, int* height) {
+    int channels;
+    return stbi_info(filename, width, height, &channels) ? 0 : -1;
+}
+
+int load_cover_image(const char* cover_image_filename, const SstvMode* mode, SstvImages* img) {
+    ImageReader r;
+    img->cover = NULL;
+    img->ycbcr = NULL;
+    img->ycbcr_mode = NULL;
+    if (image_reader_open_file(&r, cover_image_filename) < 0) {
+        fprintf(stderr, "ERRO: %s não foi encontrado ou não pôde ser carregado.\n", cover_image_filename);
+        return -1;
+    }
+    int status = ingest_cover(&r, mode, img, cover_image_filename);
+    image_reader_close(&r);
+    return status;
+}
+
+// Como load_cover_image, para um arquivo de imagem recebido em memória.
+int load_cover_memory(const void* data, size_t size, const SstvMode* mode, SstvImages* img) {
+    ImageReader r;
+    img->cover = NULL;
+    img->ycbcr = NULL;
+    img->ycbcr_mode = NULL;
+    if (image_reader_open_memory(&r, data, size) < 0) return -1;
+    int status = ingest_cover(&r, mode, img, "Imagem em memória");
+    image_reader_close(&r);
+    return status;
+}
+
+int load_flag_image(const char* flag_image_filename, SstvImages* img) {
+    ImageReader r;
+    img->flag = NULL;
+    if (image_reader_open_file(&r, flag_image_filename) < 0) {
+        fprintf(stderr, "ERRO: %s não foi encontrado ou não pôde ser carregado.\n", flag_image_filename);
+        return -1;
+    }
+    int status = ingest_flag(&r, img, flag_image_filename);
+    image_reader_close(&r);
+    return status;
+}
+
+void free_cover_image(SstvImages* img) {
+    free(img->cover);
+    free(img->ycbcr);
+    img->cover = NULL;
+    img->ycbcr = NULL;
+    img->ycbcr_mode = NULL;
+}
+
+void free_flag_image(SstvImages* img) {
+    free(img->flag);
+    img->flag = NULL;
+}
+
+// A flag só é carregada nos modos que a transmitem.
+int load_sstv_images(const SstvMode* mode, const char* cover_image_filename, const char* flag_image_filename,
+                     SstvImages* img) {
+    img->flag = NULL;
+    if (load_cover_image(cover_image_filename, mode, img) < 0) return -1;
+    if (mode->has_flag && load_flag_image(flag_image_filename, img) < 0) {
+        free_cover_image(img);
+        return -1;
+    }
+    return 0;
+}
+
+void free_sstv_images(SstvImages* img) {
+    free_cover_image(img);
+    free_flag_image(img);
+}
+
+static inline void set_tone(AudioSymbol* sym, int samples, double freq, PcmSegment segment) {
+    sym->samples = samples;
+    sym->type = TONE_SYMBOL;
+    sym->segment = segment;
+    sym->tone.frequency = freq;
+    sym->tone.amplitude = 1.0;
+    sym->tone.phase_offset = 0.0;
+}
+
+static inline int flag_row_active(const SstvMode* mode, int y) {
+    return mode->has_flag && y >= FLAG_IMG_POS_Y && y < FLAG_IMG_POS_Y + FLAG_IMG_HEIGHT;
+}
+
+static inline int sstv_mode_lines(const SstvMode* mode) {
+    return mode->height / mode->rows_per_line;
+}
+
+// Símbolos de uma linha transmitida, sem gerá-la.
+static long long image_line_symbols(const SstvMode* mode, int line) {
+    long long n_syms = 0;
+    for (int e = 0; e < mode->program_len; ++e) {
+        const SstvLineElement* el = &mode->program[e];
+        switch (el->kind) {
+        case LINE_TONE:
+        case LINE_TONE_ALT:
+            n_syms++;
+            break;
+        case LINE_SCAN:
+            n_syms += mode->width - 1 + (mode->scan_edges ? 2 : 0);
+            break;
+        case LINE_FLAG:
+            if (flag_row_active(mode, line)) n_syms += 2 + FLAG_IMG_WIDTH;
+            break;
+        }
+    }
+    return n_syms;
+}
+
+int image_data_symbol_count(const SstvMode* mode) {
+    long long total = mode->start_sync > 0.0 ? 1 : 0;
+    for (int line = 0; line < sstv_mode_lines(mode); ++line) {
+        total += image_line_symbols(mode, line);
+    }
+    return (int)total;
+}
+
+static uint64_t sample_clock_step(double seconds, int samplerate_local) {
+    return (uint64_t)llround(seconds * samplerate_local * SAMPLE_CLOCK_ONE);
+}
+
+// Avança o relógio um símbolo e devolve as amostras inteiras que couberam nele.
+static inline int sample_clock_tick(uint64_t* clock, uint64_t step) {
+    uint64_t end = *clock + step;
+    int n = (int)((end >> 32) - (*clock >> 32));
+    *clock = end;
+    return n;
+}
+
+void sstv_timing_init(SstvTiming* t, const SstvMode* mode, int samplerate_local) {
+    memset(t, 0, sizeof(*t));
+    t->mode = mode;
+    t->samplerate = samplerate_local;
+    if (mode->start_sync > 0.0) t->start_sync = sample_clock_step(mode->start_sync, samplerate_local);
+    // Segmento da flag: 15% de padding, 70% de pixels, 15% de padding.
+    t->flag_pad = sample_clock_step(SSTV_FLAG_SEGMENT_TOTAL_DURATION * 0.15, samplerate_local);
+    t->flag_pixel = sample_clock_step(SSTV_FLAG_SEGMENT_TOTAL_DURATION * 0.70 / FLAG_IMG_WIDTH, samplerate_local);
+    for (int e = 0; e < mode->program_len; ++e) {
+        const SstvLineElement* el = &mode->program[e];
+        switch (el->kind) {
+        case LINE_TONE:
+        case LINE_TONE_ALT:
+            t->element[e] = sample_clock_step(el->duration, samplerate_local);
+            t->line += t->element[e];
+            break;
+        case LINE_SCAN:
+            t->element[e] = sample_clock_step(el->duration / mode->width, samplerate_local);
+            t->line += (uint64_t)(mode->width - 1) * t->element[e];
+            if (mode->scan_edges) t->line += 2 * (t->element[e] / 2);
+            break;
+        case LINE_FLAG:
+            if (mode->has_flag) t->flag_line += 2 * t->flag_pad + FLAG_IMG_WIDTH * t->flag_pixel;
+            break;
+        }
+    }
+}
+
+// Relógio no início da linha `line` (0 <= line <= linhas do modo); o pulso
+// inicial pertence à linha 0.
+uint64_t sstv_line_clock(const SstvTiming* t, int line) {
+    const SstvMode* mode = t->mode;
+    uint64_t clock = SAMPLE_CLOCK_HALF + (uint64_t)line * t->line;
+    if (line > 0) clock += t->start_sync;
+    if (mode->has_flag && line > FLAG_IMG_POS_Y) {
+        int flagged = line - FLAG_IMG_POS_Y < FLAG_IMG_HEIGHT ? line - FLAG_IMG_POS_Y : FLAG_IMG_HEIGHT;
+        clock += (uint64_t)flagged * t->flag_line;
+    }
+    return clock;
+}
+
+long long sstv_line_offset(const SstvTiming* t, int line) {
+    return (long long)(sstv_line_clock(t, line) >> 32);
+}
+
+// Total de amostras do corpo da imagem, sem gerar os símbolos.
+long long image_data_total_samples(const SstvMode* mode, int samplerate_local) {
+    SstvTiming t;
+    sstv_timing_init(&t, mode, samplerate_local);
+    return sstv_line_offset(&t, sstv_mode_lines(mode));
+}
+
+typedef enum {
+    IMG_STAGE_LINE_START,
+    IMG_STAGE_ELEMENT,
+    IMG_STAGE_SCAN_START,
+    IMG_STAGE_PIXELS,
+    IMG_STAGE_FLAG_PAD_START,
+    IMG_STAGE_FLAG_PIXELS,
+    IMG_STAGE_FLAG_PAD_END
+} ImageStage;
+
+// Gera os símbolos do corpo da imagem direto dos pixels decodificados, um por vez,
+// sem cronograma intermediário. As frequências vêm de tabelas de 256 entradas.
+typedef struct {
+    const SstvImages* img;
+    const SstvMode* mode;
+    double pixel_freq_lut[256];
+    double flag_freq_lut[256];
+    SstvTiming timing;
+    uint64_t clock;                 // relógio de amostras, recolocado a cada seek
+    ImageStage stage;
+    int line, elem, x;
+    int line_end;                   // primeira linha fora do trecho gerado
+    uint64_t pixel_step;            // varredura corrente
+    const uint8_t* row;             // canal corrente da linha
+    int stride;
+    const uint8_t* chan_row[CH_COUNT];
+    int chan_stride[CH_COUNT];
+    const uint8_t* flag_row;
+    uint8_t line_buf[CH_COUNT][SSTV_MAX_MODE_WIDTH]; // canais convertidos (YCbCr ou borda replicada)
+} ImageSymbolSource;
+
+// Linha y da imagem com x limitado à largura real (imagens menores que o modo).
+static inline const uint8_t* cover_pixel(const SstvImages* img, int y, int x) {
+    if (y >= img->cover_h) y = img->cover_h - 1;
+    if (x >= img->cover_w) x = img->cover_w - 1;
+    return img->cover + ((size_t)y * img->cover_w + x) * img->cover_channels;
+}
+
+static inline int cover_channel_index(const SstvImages* img, int chan) {
+    if (chan >= img->cover_channels) chan = img->cover_channels - 1;
+    if (chan < 0) chan = 0;
+    return chan;
+}
+
+// Prepara os ponteiros de cada canal para a linha corrente. RGB lê direto da imagem
+// quando ela cobre o modo; YCbCr (e imagens menores) passam pelo buffer da linha.
+static void image_source_begin_line(ImageSymbolSource* is) {
+    const SstvImages* img = is->img;
+    const SstvMode* mode = is->mode;
+    int y0 = is->line * mode->rows_per_line;
+    int rgb[3] = { cover_channel_index(img, 0), cover_channel_index(img, 1), cover_channel_index(img, 2) };
+
+    if (mode->color == SSTV_COLOR_RGB) {
+        if (img->cover_w >= mode->width && y0 < img->cover_h) {
+            const uint8_t* base = img->cover + (size_t)y0 * img->cover_w * img->cover_channels;
+            for (int c = 0; c < 3; ++c) {
+                is->chan_row[CH_R + c] = base + rgb[c];
+                is->chan_stride[CH_R + c] = img->cover_channels;
+            }
+            return;
+        }
+        for (int x = 0; x < mode->width; ++x) {
+            const uint8_t* px = cover_pixel(img, y0, x);
+            for (int c = 0; c < 3; ++c) is->line_buf[CH_R + c][x] = px[rgb[c]];
+        }
+        for (int c = 0; c < 3; ++c) {
+            is->chan_row[CH_R + c] = is->line_buf[CH_R + c];
+            is->chan_stride[CH_R + c] = 1;
+        }
+        return;
+    }
+
+    // YCbCr: planos da ingestão; imagens montadas à mão convertem aqui, linha a linha.
+    if (img->ycbcr && img->ycbcr_mode == mode) {
+        size_t plane = (size_t)(mode->height / mode->rows_per_line) * mode->width;
+        for (int c = CH_Y; c <= CH_CB; ++c) {
+            is->chan_row[c] = img->ycbcr + (size_t)(c - CH_Y) * plane + (size_t)is->line * mode->width;
+            is->chan_stride[c] = 1;
+        }
+        is->chan_row[CH_CHROMA_ALT] = is->chan_row[(is->line & 1) ? CH_CB : CH_CR];
+        is->chan_stride[CH_CHROMA_ALT] = 1;
+        return;
+    }
+    for (int x = 0; x < mode->width; ++x) {
+        double cr = 0.0, cb = 0.0;
+        for (int r = 0; r < mode->rows_per_line; ++r) {
+            const uint8_t* px = cover_pixel(img, y0 + r, x);
+            double R = px[rgb[0]], G = px[rgb[1]], B = px[rgb[2]];
+            is->line_buf[r == 0 ? CH_Y : CH_Y2][x] = bt601_y(R, G, B);
+            cr += bt601_cr(R, G, B);
+            cb += bt601_cb(R, G, B);
+        }
+        is->line_buf[CH_CR][x] = clamp_u8(cr / mode->rows_per_line);
+        is->line_buf[CH_CB][x] = clamp_u8(cb / mode->rows_per_line);
+    }
+    for (int c = CH_Y; c <= CH_CB; ++c) {
+        is->chan_row[c] = is->line_buf[c];
+        is->chan_stride[c] = 1;
+    }
+    is->chan_row[CH_CHROMA_ALT] = is->line_buf[(is->line & 1) ? CH_CB : CH_CR];
+    is->chan_stride[CH_CHROMA_ALT] = 1;
+}
+
+// Corpo do gerador, instanciado por modo: com `mode` constante o compilador fixa
+// largura, programa da linha e canais, e o laço quente não consulta a tabela.
+static inline __attribute__((always_inline))
+int image_source_next_mode(ImageSymbolSource* is, AudioSymbol* out, const SstvMode* mode) {
+    for (;;) {
+        switch (is->stage) {
+        case IMG_STAGE_LINE_START:
+            if (is->line >= is->line_end) return 0;
+            image_source_begin_line(is);
+            is->elem = 0;
+            is->stage = IMG_STAGE_ELEMENT;
+            if (is->line == 0 && mode->start_sync > 0.0) {
+                set_tone(out, sample_clock_tick(&is->clock, is->timing.start_sync), SSTV_HSYNC_FREQ, PCM_SEG_HSYNC);
+                return 1;
+            }
+            continue;
+        case IMG_STAGE_ELEMENT: {
+            if (is->elem == mode->program_len) {
+                is->line++;
+                is->stage = IMG_STAGE_LINE_START;
+                continue;
+            }
+            const SstvLineElement* el = &mode->program[is->elem];
+            switch (el->kind) {
+            case LINE_TONE:
+                set_tone(out, sample_clock_tick(&is->clock, is->timing.element[is->elem]), el->freq, el->segment);
+                is->elem++;
+                return 1;
+            case LINE_TONE_ALT:
+                set_tone(out, sample_clock_tick(&is->clock, is->timing.element[is->elem]),
+                         (is->line & 1) ? el->freq_alt : el->freq, el->segment);
+                is->elem++;
+                return 1;
+            case LINE_SCAN:
+                is->row = is->chan_row[el->chan];
+                is->stride = is->chan_stride[el->chan];
+                is->pixel_step = is->timing.element[is->elem];
+                is->x = 0;
+                is->stage = mode->scan_edges ? IMG_STAGE_SCAN_START : IMG_STAGE_PIXELS;
+                continue;
+            case LINE_FLAG:
+            default:
+                if (flag_row_active(mode, is->line)) {
+                    is->flag_row = &is->img->flag[(is->line - FLAG_IMG_POS_Y) * is->img->flag_w];
+                    is->stage = IMG_STAGE_FLAG_PAD_START;
+                } else {
+                    is->elem++;
+                }
+                continue;
+            }
+        }
+        case IMG_STAGE_SCAN_START:
+            set_tone(out, sample_clock_tick(&is->clock, is->pixel_step / 2), is->pixel_freq_lut[is->row[0]],
+                     PCM_SEG_NONE);
+            is->stage = IMG_STAGE_PIXELS;
+            return 1;
+        case IMG_STAGE_PIXELS:
+            if (is->x < mode->width - 1) {
+                uint8_t val1 = is->row[is->x * is->stride];
+                uint8_t val2 = is->row[(is->x + 1) * is->stride];
+                out->samples = sample_clock_tick(&is->clock, is->pixel_step);
+                out->type = LINEAR_SWEEP_SYMBOL;
+                out->segment = PCM_SEG_NONE;
+                out->sweep.freqstart = is->pixel_freq_lut[val1];
+                out->sweep.freqend = is->pixel_freq_lut[val2];
+                out->sweep.amplitude = 1.0;
+                out->sweep.phase_offset = 0.0;
+                is->x++;
+                return 1;
+            }
+            is->elem++;
+            is->stage = IMG_STAGE_ELEMENT;
+            if (mode->scan_edges) {
+                set_tone(out, sample_clock_tick(&is->clock, is->pixel_step / 2),
+                         is->pixel_freq_lut[is->row[(mode->width - 1) * is->stride]], PCM_SEG_NONE);
+                return 1;
+            }
+            continue;
+        case IMG_STAGE_FLAG_PAD_START:
+            set_tone(out, sample_clock_tick(&is->clock, is->timing.flag_pad), SSTV_FLAG_PAD_SYNC_FREQ,
+                     PCM_SEG_FLAG_PAD);
+            is->x = 0;
+            is->stage = IMG_STAGE_FLAG_PIXELS;
+            return 1;
+        case IMG_STAGE_FLAG_PIXELS:
+            if (is->x < FLAG_IMG_WIDTH) {
+                set_tone(out, sample_clock_tick(&is->clock, is->timing.flag_pixel),
+                         is->flag_freq_lut[is->flag_row[is->x]], PCM_SEG_NONE);
+                is->x++;
+                return 1;
+            }
+            /* fallthrough */
+        case IMG_STAGE_FLAG_PAD_END:
+        default:
+            set_tone(out, sample_clock_tick(&is->clock, is->timing.flag_pad), SSTV_FLAG_PAD_SYNC_FREQ,
+                     PCM_SEG_FLAG_PAD);
+            is->elem++;
+            is->stage = IMG_STAGE_ELEMENT;
+            return 1;
+        }
+    }
+}
+
+#define SSTV_MODE_NEXT_FN(id) \
+    static int image_source_next_##id(void* ctx, AudioSymbol* out) { \
+        return image_source_next_mode((ImageSymbolSource*)ctx, out, &sstv_mode_##id); \
+    }
+SSTV_MODE_LIST(SSTV_MODE_NEXT_FN)
+
+typedef struct {
+    const SstvMode* mode;
+    int (*next)(void* ctx, AudioSymbol* out);
+} SstvModeEntry;
+
+#define SSTV_MODE_ENTRY(id) { &sstv_mode_##id, image_source_next_##id },
+static const SstvModeEntry sstv_modes[] = { SSTV_MODE_LIST(SSTV_MODE_ENTRY) };
+#define SSTV_MODE_COUNT ((int)(sizeof(sstv_modes) / sizeof(sstv_modes[0])))
+
+const SstvMode* find_sstv_mode(const char* name) {
+    for (int i = 0; i < SSTV_MODE_COUNT; ++i) {
+        if (strcmp(sstv_modes[i].mode->name, name) == 0) return sstv_modes[i].mode;
+    }
+    return NULL;
+}
+
+const SstvMode* sstv_mode_at(int index) {
+    return index >= 0 && index < SSTV_MODE_COUNT ? sstv_modes[index].mode : NULL;
+}
+
+const SstvMode* find_sstv_mode_by_vis(int vis_code) {
+    for (int i = 0; i < SSTV_MODE_COUNT; ++i) {
+        if (sstv_modes[i].mode->vis_code == vis_code) return sstv_modes[i].mode;
+    }
+    return NULL;
+}
+
+void print_sstv_modes(FILE* out) {
+    for (int i = 0; i < SSTV_MODE_COUNT; ++i) {
+        const SstvMode* mode = sstv_modes[i].mode;
+        fprintf(out, "  %-9s %s, %dx%d\n", mode->name, mode->description, mode->width, mode->height);
+    }
+}
+
+SymbolSource image_symbol_source(ImageSymbolSource* is, const SstvMode* mode, const SstvImages* img,
+                                 int samplerate_local) {
+    SymbolSource src = { NULL, is };
+    for (int i = 0; i < SSTV_MODE_COUNT; ++i) {
+        if (sstv_modes[i].mode == mode) src.next = sstv_modes[i].next;
+    }
+    assert(src.next && mode->width <= SSTV_MAX_MODE_WIDTH);
+    is->img = img;
+    is->mode = mode;
+    for (int v = 0; v < 256; ++v) {
+        is->pixel_freq_lut[v] = SSTV_PIXEL_FREQ_MIN + SSTV_PIXEL_FREQ_RANGE * v / 255.0;
+        is->flag_freq_lut[v] = SSTV_FLAG_PIXEL_FREQ_MIN + SSTV_FLAG_PIXEL_FREQ_RANGE * v / 255.0;
+    }
+    sstv_timing_init(&is->timing, mode, samplerate_local);
+    is->clock = sstv_line_clock(&is->timing, 0);
+    is->stage = IMG_STAGE_LINE_START;
+    is->line = 0;
+    is->line_end = sstv_mode_lines(mode);
+    is->elem = 0;
+    is->x = 0;
+    is->pixel_step = 0;
+    is->row = NULL;
+    is->stride = 0;
+    is->flag_row = NULL;
+    return src;
+}
+
+// Restringe a fonte às linhas [first, end), recomeçando do início de `first` com
+// o mesmo relógio que a passada inteira teria ali.
+void image_symbol_source_seek(ImageSymbolSource* is, int first, int end) {
+    is->clock = sstv_line_clock(&is->timing, first);
+    is->line = first;
+    is->line_end = end;
+    is->elem = 0;
+    is->x = 0;
+    is->stage = IMG_STAGE_LINE_START;
+}
+
+// Caminho com cronograma materializado (depuração, renderização paralela).
+int generate_image_data_symbols(const SstvMode* mode, const SstvImages* img, SymbolSchedule* sched) {
+    int max_symbols_needed = image_data_symbol_count(mode);
+    if (sched->count + max_symbols_needed > sched->capacity) {
+        fprintf(stderr, "ERRO: Cronograma sem espaço para os símbolos da imagem.\n");
+        return -1;
+    }
+
+    int first_sym_idx = sched->count;
+    ImageSymbolSource* image_src = (ImageSymbolSource*)malloc(sizeof(ImageSymbolSource));
+    if (!image_src) { perror("malloc ImageSymbolSource"); return -1; }
+    SymbolSource src = image_symbol_source(image_src, mode, img, sched->samplerate);
+    while (src.next(src.ctx, &sched->syms[sched->count])) {
+        sched->count++;
+    }
+    free(image_src);
+    // O final do quadro recomeça o relógio, como no streaming, em que ele é um
+    // cronograma à parte.
+    sched->clock = SAMPLE_CLOCK_HALF;
+    assert(sched->count - first_sym_idx <= max_symbols_needed);
+    return sched->count - first_sym_idx;
+}
+
+int generate_header_schedule(const SstvMode* mode, SymbolSchedule* sched, int samplerate_local) {
+    if (schedule_init(sched, 1 + VOX_SYMBOL_COUNT + VIS_SYMBOL_COUNT, samplerate_local) < 0) return -1;
+    if (add_silence_symbol(sched, SSTV_SILENCE_DURATION) < 0 ||
+        generate_vox_signal(sched) < 0 ||
+        generate_vis_signal(sched, mode) < 0) {
+        schedule_free(sched);
+        return -1;
+    }
+    return 0;
+}
+
+int generate_trailer_schedule(SymbolSchedule* sched, int samplerate_local) {
+    if (schedule_init(sched, EOF_SYMBOL_COUNT + 1, samplerate_local) < 0) return -1;
+    if (generate_eof_signal(sched) < 0 ||
+        add_silence_symbol(sched, SSTV_SILENCE_DURATION) < 0) {
+        schedule_free(sched);
+        return -1;
+    }
+    return 0;
+}
+
+int build_sstv_schedule(const SstvMode* mode, const SstvImages* img, SymbolSchedule* sched, int samplerate_local,
+                        SstvStats* stats) {
+    int total_sstv_symbols = 1 + VOX_SYMBOL_COUNT + VIS_SYMBOL_COUNT + image_data_symbol_count(mode) + EOF_SYMBOL_COUNT + 1;
+    if (schedule_init(sched, total_sstv_symbols, samplerate_local) < 0) return -1;
+    STATS_ALLOC(stats, (long long)total_sstv_symbols * sizeof(AudioSymbol));
+
+    StatsMark mark;
+    int failed = add_silence_symbol(sched, SSTV_SILENCE_DURATION) < 0;
+    STATS_BEGIN(stats, mark);
+    failed = failed || generate_vox_signal(sched) < 0 || generate_vis_signal(sched, mode) < 0;
+    STATS_END(stats, STATS_HEADER, mark);
+    STATS_BEGIN(stats, mark);
+    failed = failed || generate_image_data_symbols(mode, img, sched) < 0;
+    STATS_END(stats, STATS_IMAGE, mark);
+    STATS_BEGIN(stats, mark);
+    failed = failed || generate_eof_signal(sched) < 0;
+    STATS_END(stats, STATS_TRAILER, mark);
+    failed = failed || add_silence_symbol(sched, SSTV_SILENCE_DURATION) < 0;
+    if (failed) {
+        schedule_free(sched);
+        return -1;
+    }
+    return 0;
+}
+
+// Quadro completo sem materializar o corpo da imagem: cabeçalho e final seguem como
+// cronogramas pequenos; a imagem vira PCM direto dos pixels via ImageSymbolSource.
+typedef struct {
+    const SstvMode* mode;
+    SymbolSchedule header;
+    SymbolSchedule trailer;
+    ScheduleSource header_src;
+    ScheduleSource trailer_src;
+    ImageSymbolSource image;
+    ChainSource chain;
+} SstvFrameSource;
+
+int sstv_frame_source_init(SstvFrameSource* fs, const SstvMode* mode, const SstvImages* img, int samplerate_local,
+                           SymbolSource* out, SstvStats* stats) {
+    StatsMark mark;
+    fs->mode = mode;
+    STATS_BEGIN(stats, mark);
+    if (generate_header_schedule(mode, &fs->header, samplerate_local) < 0) return -1;
+    STATS_END(stats, STATS_HEADER, mark);
+    STATS_BEGIN(stats, mark);
+    if (generate_trailer_schedule(&fs->trailer, samplerate_local) < 0) {
+        schedule_free(&fs->header);
+        return -1;
+    }
+    STATS_END(stats, STATS_TRAILER, mark);
+    SymbolSource parts[3] = {
+        schedule_source(&fs->header_src, &fs->header),
+        image_symbol_source(&fs->image, mode, img, samplerate_local),
+        schedule_source(&fs->trailer_src, &fs->trailer)
+    };
+    *out = chain_source(&fs->chain, parts, 3);
+    return 0;
+}
+
+long long sstv_frame_total_samples(const SstvFrameSource* fs) {
+    return schedule_total_samples(&fs->header)
+         + sstv_line_offset(&fs->image.timing, sstv_mode_lines(fs->mode))
+         + schedule_total_samples(&fs->trailer);
+}
+
+void sstv_frame_source_free(SstvFrameSource* fs) {
+    schedule_free(&fs->header);
+    schedule_free(&fs->trailer);
+}
+
+// Amostras de um quadro do modo, sem imagem: as durações não dependem dos pixels.
+long long sstv_frame_samples(const SstvMode* mode, int samplerate_local) {
+    SymbolSchedule header, trailer;
+    if (generate_header_schedule(mode, &header, samplerate_local) < 0) return -1;
+    if (generate_trailer_schedule(&trailer, samplerate_local) < 0) {
+        schedule_free(&header);
+        return -1;
+    }
+    long long total = schedule_total_samples(&header)
+                    + image_data_total_samples(mode, samplerate_local)
+                    + schedule_total_samples(&trailer);
+    schedule_free(&header);
+    schedule_free(&trailer);
+    return total;
+}
+
+int schedule_init(SymbolSchedule* sched, int capacity, int samplerate_local) {
+    sched->count = 0;
+    sched->capacity = 0;
+    sched->samplerate = samplerate_local;
+    sched->clock = SAMPLE_CLOCK_HALF;
+    sched->syms = (AudioSymbol*)malloc((size_t)capacity * sizeof(AudioSymbol));
+    if (!sched->syms) { perror("malloc SymbolSchedule"); return -1; }
+    sched->capacity = capacity;
+    return 0;
+}
+
+void schedule_free(SymbolSchedule* sched) {
+    free(sched->syms);
+    sched->syms = NULL;
+    sched->count = 0;
+    sched->capacity = 0;
+}
+
+// Reserva o próximo registro do cronograma; a capacidade é fixada em schedule_init.
+static AudioSymbol* schedule_push(SymbolSchedule* sched, double duration, AudioSymbolType type) {
+    if (sched->count >= sched->capacity) {
+        fprintf(stderr, "ERRO: Cronograma de símbolos cheio (%d).\n", sched->capacity);
+        return NULL;
+    }
+    AudioSymbol* sym = &sched->syms[sched->count++];
+    sym->samples = sample_clock_tick(&sched->clock, sample_clock_step(duration, sched->samplerate));
+    sym->type = type;
+    sym->segment = PCM_SEG_NONE;
+    return sym;
+}
+
+int add_silence_symbol(SymbolSchedule* sched, double duration) {
+    return schedule_push(sched, duration, SILENCE_SYMBOL) ? 0 : -1;
+}
+
+int add_tone_symbol(SymbolSchedule* sched, double duration, double freq, double amp, double phase_offset_rad) {
+    AudioSymbol* sym = schedule_push(sched, duration, TONE_SYMBOL);
+    if (!sym) return -1;
+    sym->tone.frequency = freq;
+    sym->tone.amplitude = amp;
+    sym->tone.phase_offset = phase_offset_rad;
+    return 0;
+}
+
+int add_sweep_symbol(SymbolSchedule* sched, double duration, double f_start, double f_end, double amp, double phase_offset_rad) {
+    AudioSymbol* sym = schedule_push(sched, duration, LINEAR_SWEEP_SYMBOL);
+    if (!sym) return -1;
+    sym->sweep.freqstart = f_start;
+    sym->sweep.freqend = f_end;
+    sym->sweep.amplitude = amp;
+    sym->sweep.phase_offset = phase_offset_rad;
+    return 0;
+}
+
+static void convert_int16(void* dst, const int16_t* src, int count) {
+    memcpy(dst, src, (size_t)count * sizeof(int16_t));
+}
+
+static void convert_float32(void* dst, const int16_t* src, int count) {
+    float* out = (float*)dst;
+    for (int i = 0; i < count; ++i) out[i] = src[i] * (1.0f / 32768.0f);
+}
+
+static void convert_u8(void* dst, const int16_t* src, int count) {
+    uint8_t* out = (uint8_t*)dst;
+    for (int i = 0; i < count; ++i) out[i] = (uint8_t)((src[i] >> 8) + 128);
+}
+
+// μ-law G.711 sobre os 14 bits mais significativos da amostra; o segmento sai
+// direto da posição do bit mais alto, sem tabela global.
+static inline uint8_t mulaw_encode(int sample14) {
+    int sign = sample14 < 0 ? 0x80 : 0;
+    int magnitude = sign ? -sample14 : sample14;
+    if (magnitude > 8158) magnitude = 8158;
+    magnitude += 33;
+    int exponent = (31 - __builtin_clz((unsigned)magnitude)) - 5;
+    int mantissa = (magnitude >> (exponent + 1)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+static void convert_mulaw(void* dst, const int16_t* src, int count) {
+    uint8_t* out = (uint8_t*)dst;
+    for (int i = 0; i < count; ++i) out[i] = mulaw_encode(src[i] >> 2);
+}
+
+static const SampleFormatInfo sample_formats[] = {
+    [SAMPLE_FORMAT_INT16]   = { "int16",   1, 2, convert_int16 },
+    [SAMPLE_FORMAT_FLOAT32] = { "float32", 3, 4, convert_float32 },
+    [SAMPLE_FORMAT_U8]      = { "u8",      1, 1, convert_u8 },
+    [SAMPLE_FORMAT_MULAW]   = { "mulaw",   7, 1, convert_mulaw },
+};
+
+const SampleFormatInfo* sample_format_info(SampleFormat format) {
+    return &sample_formats[format];
+}
+
+int parse_sample_format(const char* name, SampleFormat* format) {
+    for (int f = 0; f < (int)(sizeof(sample_formats) / sizeof(sample_formats[0])); ++f) {
+        if (strcmp(sample_formats[f].name, name) == 0) {
+            *format = (SampleFormat)f;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Posições no cabeçalho: PCM usa o cabeçalho clássico de 44 bytes; os demais
+// formatos levam cbSize no fmt e um chunk fact com o número de amostras. Em RF64
+// um chunk ds64 logo após "WAVE" guarda os tamanhos de 64 bits.
+#define WAV_PCM_HEADER_BYTES 44
+#define WAV_EXT_HEADER_BYTES 58
+#define WAV_DS64_BYTES 36
+#define WAV_MAX_HEADER_BYTES (WAV_EXT_HEADER_BYTES + WAV_DS64_BYTES)
+
+static int wav_header_bytes(SampleFormat format, int rf64) {
+    return (sample_formats[format].wav_tag == 1 ? WAV_PCM_HEADER_BYTES : WAV_EXT_HEADER_BYTES)
+         + (rf64 ? WAV_DS64_BYTES : 0);
+}
+
+static int wav_needs_rf64(SampleFormat format, long long length) {
+    return wav_header_bytes(format, 0) - 8 + (unsigned long long)length * sample_formats[format].bytes_per_sample
+           > UINT32_MAX;
+}
+
+// Bytes que um sink de descritor (open_wav_fd_sink) entrega para `length` amostras.
+long long wav_stream_bytes(SampleFormat format, long long length, int raw) {
+    long long data = length * sample_formats[format].bytes_per_sample;
+    return raw ? data : wav_header_bytes(format, wav_needs_rf64(format, length)) + data;
+}
+
+static uint8_t* put_bytes(uint8_t* p, const void* v, size_t n) { memcpy(p, v, n); return p + n; }
+static uint8_t* put_u16(uint8_t* p, uint16_t v) { return put_bytes(p, &v, sizeof(v)); }
+static uint8_t* put_u32(uint8_t* p, uint32_t v) { return put_bytes(p, &v, sizeof(v)); }
+static uint8_t* put_u64(uint8_t* p, uint64_t v) { return put_bytes(p, &v, sizeof(v)); }
+
+// Monta o cabeçalho inteiro em memória; retorna o tamanho em bytes. `length` conta
+// amostras intercaladas (quadros x canais).
+int build_wav_header(uint8_t* buf, int samplerate_local, SampleFormat format, int channels, long long length,
+                     int rf64) {
+    const SampleFormatInfo* info = &sample_formats[format];
+    uint64_t frames = (uint64_t)length / channels;
+    int header_bytes = wav_header_bytes(format, rf64);
+    int extended = info->wav_tag != 1;
+    uint64_t data_bytes = (uint64_t)length * info->bytes_per_sample;
+    uint64_t riff_size = header_bytes - 8 + data_bytes;
+    uint8_t* p = buf;
+
+    p = put_bytes(p, rf64 ? "RF64" : "RIFF", 4);
+    p = put_u32(p, rf64 ? UINT32_MAX : (uint32_t)riff_size);
+    p = put_bytes(p, "WAVE", 4);
+    if (rf64) {
+        p = put_bytes(p, "ds64", 4);
+        p = put_u32(p, 28);
+        p = put_u64(p, riff_size);
+        p = put_u64(p, data_bytes);
+        p = put_u64(p, frames);
+        p = put_u32(p, 0); // sem tabela de chunks extras
+    }
+    p = put_bytes(p, "fmt ", 4);
+    p = put_u32(p, extended ? 18 : 16);
+    p = put_u16(p, (uint16_t)info->wav_tag);
+    p = put_u16(p, (uint16_t)channels);
+    p = put_u32(p, (uint32_t)samplerate_local);
+    p = put_u32(p, (uint32_t)samplerate_local * channels * info->bytes_per_sample);
+    p = put_u16(p, (uint16_t)(channels * info->bytes_per_sample));
+    p = put_u16(p, (uint16_t)(info->bytes_per_sample * 8));
+    if (extended) {
+        p = put_u16(p, 0);
+        p = put_bytes(p, "fact", 4);
+        p = put_u32(p, 4);
+        p = put_u32(p, rf64 ? UINT32_MAX : (uint32_t)frames);
+    }
+    p = put_bytes(p, "data", 4);
+    p = put_u32(p, rf64 ? UINT32_MAX : (uint32_t)data_bytes);
+    assert(p - buf == header_bytes);
+    return header_bytes;
+}
+
+// writev até o fim, tratando escritas parciais e EINTR.
+static int write_all_v(int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static size_t wav_map_data_capacity(const WavFileSink* wfs) {
+    return (wfs->map_size - wfs->header_bytes) / wfs->format_info->bytes_per_sample;
+}
+
+// Reserva espaço no disco já na abertura: disco cheio aparece aqui, e não como
+// SIGBUS ao escrever no mapeamento.
+static int wav_map_resize(WavFileSink* wfs, size_t new_size) {
+    if (fallocate(wfs->fd, 0, 0, (off_t)new_size) != 0) {
+        if (errno != EOPNOTSUPP && errno != ENOSYS) {
+            perror("fallocate");
+            return -1;
+        }
+        if (ftruncate(wfs->fd, (off_t)new_size) != 0) {
+            perror("ftruncate");
+            return -1;
+        }
+    }
+    uint8_t* map = (uint8_t*)mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, wfs->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    if (wfs->map) munmap(wfs->map, wfs->map_size);
+    wfs->map = map;
+    wfs->map_size = new_size;
+    return 0;
+}
+
+// Escreve no mapeamento (convertendo se preciso) ou, no backend writev, junta o
+// cabeçalho pendente com o bloco numa única chamada.
+static int wav_file_sink_write(void* ctx, const int16_t* samples, int count) {
+    WavFileSink* wfs = (WavFileSink*)ctx;
+    const SampleFormatInfo* info = wfs->format_info;
+    if (wfs->map) {
+        if ((size_t)(wfs->written + count) > wav_map_data_capacity(wfs)) {
+            size_t grown = wfs->map_size + (wfs->map_size - wfs->header_bytes) / 2
+                         + (size_t)count * info->bytes_per_sample;
+            if (wav_map_resize(wfs, grown) < 0) return -1;
+        }
+        uint8_t* dst = wfs->map + wfs->header_bytes + (size_t)wfs->written * info->bytes_per_sample;
+        if ((const void*)dst != (const void*)samples) info->convert(dst, samples, count);
+        wfs->written += count;
+        return 0;
+    }
+
+    struct iovec iov[2];
+    int iovcnt = 0;
+    if (wfs->header_pending) {
+        iov[iovcnt].iov_base = wfs->header;
+        iov[iovcnt++].iov_len = wfs->header_bytes;
+        wfs->header_pending = 0;
+    }
+    if (info->convert == convert_int16) {
+        iov[iovcnt].iov_base = (void*)samples;
+        iov[iovcnt++].iov_len = (size_t)count * sizeof(int16_t);
+        if (write_all_v(wfs->fd, iov, iovcnt) < 0) { perror("writev"); return -1; }
+    } else {
+        for (int done = 0; done < count || iovcnt > 0; ) {
+            int n = count - done < STREAM_CHUNK_SAMPLES ? count - done : STREAM_CHUNK_SAMPLES;
+            info->convert(wfs->convert_buf, samples + done, n);
+            iov[iovcnt].iov_base = wfs->convert_buf;
+            iov[iovcnt++].iov_len = (size_t)n * info->bytes_per_sample;
+            if (write_all_v(wfs->fd, iov, iovcnt) < 0) { perror("writev"); return -1; }
+            iovcnt = 0;
+            done += n;
+        }
+    }
+    wfs->written += count;
+    return 0;
+}
+
+// Amostras já no formato do arquivo: copiadas para o mapeamento (ou só confirmadas,
+// se foram sintetizadas nele) ou enviadas por writev junto com o cabeçalho pendente.
+static int wav_file_sink_write_native(void* ctx, const void* data, int count) {
+    WavFileSink* wfs = (WavFileSink*)ctx;
+    size_t bytes = (size_t)count * wfs->format_info->bytes_per_sample;
+    if (wfs->map) {
+        if ((size_t)(wfs->written + count) > wav_map_data_capacity(wfs)) {
+            size_t grown = wfs->map_size + (wfs->map_size - wfs->header_bytes) / 2 + bytes;
+            if (wav_map_resize(wfs, grown) < 0) return -1;
+        }
+        uint8_t* dst = wfs->map + wfs->header_bytes + (size_t)wfs->written * wfs->format_info->bytes_per_sample;
+        if ((const void*)dst != data) memcpy(dst, data, bytes);
+        wfs->written += count;
+        return 0;
+    }
+    struct iovec iov[2];
+    int iovcnt = 0;
+    if (wfs->header_pending) {
+        iov[iovcnt].iov_base = wfs->header;
+        iov[iovcnt++].iov_len = wfs->header_bytes;
+        wfs->header_pending = 0;
+    }
+    iov[iovcnt].iov_base = (void*)data;
+    iov[iovcnt++].iov_len = bytes;
+    if (write_all_v(wfs->fd, iov, iovcnt) < 0) { perror("writev"); return -1; }
+    wfs->written += count;
+    return 0;
+}
+
+static void* wav_file_sink_direct_native(void* ctx, long long offset, long long count) {
+    WavFileSink* wfs = (WavFileSink*)ctx;
+    if (!wfs->map || (size_t)(offset + count) > wav_map_data_capacity(wfs)) return NULL;
+    return wfs->map + wfs->header_bytes + (size_t)offset * wfs->format_info->bytes_per_sample;
+}
+
+// Ponteiro para as próximas `count` amostras int16 dentro do arquivo mapeado, para
+// o motor sintetizar direto no destino. NULL quando não há mapeamento, o formato
+// exige conversão ou o trecho passa do espaço reservado.
+static int16_t* wav_file_sink_direct(void* ctx, long long offset, long long count) {
+    WavFileSink* wfs = (WavFileSink*)ctx;
+    if (!wfs->map || wfs->format != SAMPLE_FORMAT_INT16) return NULL;
+    if ((size_t)(offset + count) > wav_map_data_capacity(wfs)) return NULL;
+    return (int16_t*)(wfs->map + wfs->header_bytes) + offset;
+}
+
+// Corrige os tamanhos do cabeçalho com o total realmente escrito e, no backend
+// mmap, ajusta o arquivo ao tamanho final.
+static int wav_file_sink_close(void* ctx, long long total_samples) {
+    WavFileSink* wfs = (WavFileSink*)ctx;
+    int status = 0;
+    if (wav_needs_rf64(wfs->format, total_samples) && !wfs->rf64) {
+        fprintf(stderr, "ERRO: Saída passou de 4 GB sem cabeçalho RF64 reservado.\n");
+        status = -1;
+    }
+    build_wav_header(wfs->header, wfs->samplerate, wfs->format, wfs->channels, total_samples, wfs->rf64);
+    if (wfs->map) {
+        memcpy(wfs->map, wfs->header, wfs->header_bytes);
+        if (munmap(wfs->map, wfs->map_size) != 0) status = -1;
+        wfs->map = NULL;
+        off_t final_size = wfs->header_bytes + (off_t)total_samples * wfs->format_info->bytes_per_sample;
+        if (ftruncate(wfs->fd, final_size) != 0) {
+            perror("ftruncate");
+            status = -1;
+        }
+    } else if (wfs->header_pending) {
+        struct iovec iov = { wfs->header, (size_t)wfs->header_bytes };
+        if (write_all_v(wfs->fd, &iov, 1) < 0) status = -1;
+    } else if (wfs->seekable &&
+               pwrite(wfs->fd, wfs->header, wfs->header_bytes, 0) != wfs->header_bytes) {
+        fprintf(stderr, "ERRO: Não foi possível corrigir o cabeçalho WAV.\n");
+        status = -1;
+    }
+    if (wfs->owns_fd && close(wfs->fd) != 0) status = -1;
+    wfs->fd = -1;
+    return status;
+}
+
+static void wav_sink_begin(WavFileSink* wfs, int samplerate_local, SampleFormat format, int channels,
+                           long long expected_samples) {
+    wfs->format = format;
+    wfs->format_info = sample_format_info(format);
+    wfs->samplerate = samplerate_local;
+    wfs->channels = channels;
+    wfs->rf64 = wav_needs_rf64(format, expected_samples);
+    wfs->header_bytes = build_wav_header(wfs->header, samplerate_local, format, channels, expected_samples, wfs->rf64);
+    wfs->header_pending = 1;
+    wfs->map = NULL;
+    wfs->map_size = 0;
+    wfs->written = 0;
+}
+
+static void wav_sink_bind(WavFileSink* wfs, SampleSink* sink) {
+    sink->write = wav_file_sink_write;
+    sink->close = wav_file_sink_close;
+    sink->direct = wav_file_sink_direct;
+    sink->write_native = wav_file_sink_write_native;
+    sink->direct_native = wav_file_sink_direct_native;
+    sink->ctx = wfs;
+}
+
+// Sink sobre um descritor que não é arquivo comum (socket, pipe) e que continua do
+// chamador. O cabeçalho já sai com expected_samples; com raw, só as amostras.
+int open_wav_fd_sink(WavFileSink* wfs, SampleSink* sink, int fd, int samplerate_local, SampleFormat format,
+                     int channels, long long expected_samples, int raw) {
+    wav_sink_begin(wfs, samplerate_local, format, channels, expected_samples);
+    if (raw) {
+        wfs->header_bytes = 0;
+        wfs->header_pending = 0;
+    }
+    wfs->fd = fd;
+    wfs->owns_fd = 0;
+    wfs->seekable = 0;
+    wav_sink_bind(wfs, sink);
+    return 0;
+}
+
+// filename == NULL escreve em stdout. Arquivos comuns são pré-alocados e mapeados
+// (expected_samples define o tamanho inicial); se o mmap falhar, ou para pipes e
+// stdout, as amostras saem por writev. O cabeçalho é corrigido no fechamento.
+int open_wav_file_sink(WavFileSink* wfs, SampleSink* sink, const char* filename,
+                       int samplerate_local, SampleFormat format, int channels, long long expected_samples) {
+    struct stat st;
+    wav_sink_begin(wfs, samplerate_local, format, channels, expected_samples);
+    if (filename) {
+        wfs->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (wfs->fd < 0) {
+            fprintf(stderr, "Não foi possível abrir o arquivo %s para escrita.\n", filename);
+            return -1;
+        }
+        wfs->owns_fd = 1;
+    } else {
+        fflush(stdout);
+        wfs->fd = STDOUT_FILENO;
+        wfs->owns_fd = 0;
+    }
+    wfs->seekable = fstat(wfs->fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    if (wfs->seekable && expected_samples > 0) {
+        size_t size = wfs->header_bytes + (size_t)expected_samples * wfs->format_info->bytes_per_sample;
+        if (wav_map_resize(wfs, size) == 0) {
+            wfs->header_pending = 0;
+        } else if (errno == ENOSPC || errno == EFBIG) {
+            fprintf(stderr, "ERRO: Sem espaço para %zu bytes de saída.\n", size);
+            if (wfs->owns_fd) close(wfs->fd);
+            return -1;
+        } else if (ftruncate(wfs->fd, 0) != 0) {
+            perror("ftruncate");
+            if (wfs->owns_fd) close(wfs->fd);
+            return -1;
+        }
+    }
+    wav_sink_bind(wfs, sink);
+    return 0;
+}
+
+// `data` tem num_channels amostras intercaladas por quadro; length conta todas.
+int save_wav_file(const char* filename, int samplerate_local, SampleFormat format, int num_channels,
+                  int16_t* data, int length) {
+    if (!data || length == 0) {
+        fprintf(stderr, "Dados de áudio inválidos para salvar.\n");
+        return -1;
+    }
+    WavFileSink wfs;
+    SampleSink sink;
+    if (open_wav_file_sink(&wfs, &sink, filename, samplerate_local, format, num_channels, length) < 0) return -1;
+    int status = sink.write(sink.ctx, data, length);
+    if (sink.close(sink.ctx, status == 0 ? length : 0) < 0) status = -1;
+    if (status < 0) {
+        fprintf(stderr, "ERRO: Falha ao escrever %s.\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// Quadro inteiro em memória pelo motor libm, sem cache: a referência contra a qual
+// --verify compara a decodificação de um caminho de síntese. O chamador libera.
+int16_t* render_frame_reference(const SstvMode* mode, const SstvImages* img, int samplerate_local, long long* count) {
+    SynthConfig* ref_cfg = (SynthConfig*)malloc(sizeof(SynthConfig));
+    if (!ref_cfg) { perror("malloc SynthConfig"); return NULL; }
+    synth_config_init(ref_cfg, SYNTH_ENGINE_LIBM, samplerate_local);
+    SstvFrameSource frame;
+    SymbolSource source;
+    if (sstv_frame_source_init(&frame, mode, img, samplerate_local, &source, NULL) < 0) {
+        free(ref_cfg);
+        return NULL;
+    }
+    long long total = sstv_frame_total_samples(&frame);
+    int16_t* pcm = total > 0 && total <= INT32_MAX ? (int16_t*)malloc((size_t)total * sizeof(int16_t)) : NULL;
+    if (pcm) {
+        SynthCursor cursor;
+        synth_cursor_init_source(&cursor, source, ref_cfg);
+        *count = synth_render(&cursor, pcm, (int)total);
+    } else {
+        perror("malloc quadro de referência");
+    }
+    sstv_frame_source_free(&frame);
+    free(ref_cfg);
+    return pcm;
+}
+
+// Codifica um quadro direto dos pixels para um arquivo WAV (target == NULL: stdout).
+// Retorna o número de amostras escritas ou -1.
+long long encode_frame(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg, PcmCache* cache, const char* target) {
+    SstvFrameSource frame;
+    SymbolSource source;
+    WavFileSink wfs;
+    SampleSink sink;
+    if (sstv_frame_source_init(&frame, mode, img, cfg->samplerate, &source, cfg->stats) < 0) return -1;
+
+    long long written = -1;
+    long long expected = sstv_frame_total_samples(&frame);
+    if (open_wav_file_sink(&wfs, &sink, target, cfg->samplerate, cfg->format, 1, expected) == 0) {
+        written = stream_wav_source(source, cfg, cache, &sink);
+    }
+    sstv_frame_source_free(&frame);
+    return written;
+}
+
+// Como encode_frame, para um descritor aberto pelo chamador (socket, pipe), que
+// continua aberto no fim. Com raw sai só o PCM, sem cabeçalho WAV.
+long long encode_frame_fd(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg, PcmCache* cache,
+                          int fd, int raw) {
+    SstvFrameSource frame;
+    SymbolSource source;
+    WavFileSink wfs;
+    SampleSink sink;
+    if (sstv_frame_source_init(&frame, mode, img, cfg->samplerate, &source, cfg->stats) < 0) return -1;
+
+    long long written = -1;
+    long long expected = sstv_frame_total_samples(&frame);
+    if (open_wav_fd_sink(&wfs, &sink, fd, cfg->samplerate, cfg->format, 1, expected, raw) == 0) {
+        written = stream_wav_source(source, cfg, cache, &sink);
+    }
+    sstv_frame_source_free(&frame);
+    return written;
+}
+
+// Um canal do encode_frames_multichannel: a própria imagem seguida do final, a
+// partir da fase em que o cabeçalho compartilhado terminou.
+typedef struct {
+    ImageSymbolSource image;
+    ScheduleSource trailer_src;
+    ChainSource chain;
+    SynthCursor cursor;
+    WavFileSink wfs;
+    SampleSink sink;
+    int sink_open;
+    int16_t plane[STREAM_CHUNK_SAMPLES];
+} MultiChannel;
+
+static void interleave_block(int16_t* dst, int16_t* const* planes, int channels, int count) {
+    if (channels == 2) {
+        const int16_t* a = planes[0];
+        const int16_t* b = planes[1];
+        for (int i = 0; i < count; ++i) {
+            dst[2 * i] = a[i];
+            dst[2 * i + 1] = b[i];
+        }
+        return;
+    }
+    for (int c = 0; c < channels; ++c) {
+        const int16_t* src = planes[c];
+        for (int i = 0; i < count; ++i) dst[(size_t)i * channels + c] = src[i];
+    }
+}
+
+// Entrega um bloco por canal: intercalado num sink só (split == 0) ou cada plano
+// no sink do seu canal. `planes[c]` pode já estar dentro da região direta do sink.
+static int multichannel_write(MultiChannel* ch, int count, int split, SampleSink* shared, int16_t* interleaved,
+                              long long frame_offset, int16_t* const* planes, int produced) {
+    if (split) {
+        for (int c = 0; c < count; ++c) {
+            if (ch[c].sink.write(ch[c].sink.ctx, planes[c], produced) < 0) return -1;
+        }
+        return 0;
+    }
+    int16_t* dst = shared->direct ? shared->direct(shared->ctx, frame_offset * count, (long long)produced * count) : NULL;
+    if (!dst) dst = interleaved;
+    interleave_block(dst, planes, count, produced);
+    return shared->write(shared->ctx, dst, produced * count);
+}
+
+// Codifica `count` imagens do mesmo modo num passo só. O cabeçalho (VOX + VIS) é
+// idêntico em todos os canais: é sintetizado uma vez e replicado. Depois cada canal
+// segue com o seu cursor, todos a partir da mesma fase e avançando bloco a bloco
+// juntos; como as durações não dependem dos pixels, os blocos têm o mesmo tamanho.
+// Sem split, targets[0] recebe um WAV de `count` canais intercalados (NULL: stdout);
+// com split, targets[c] recebe o canal c em mono. Sem cache, o canal c sai idêntico
+// ao encode_frame de imgs[c]. Retorna as amostras por canal ou -1.
+long long encode_frames_multichannel(const SstvMode* mode, const SstvImages* imgs, int count, const SynthConfig* cfg,
+                                     PcmCache* cache, const char* const* targets, int split) {
+    if (count < 1 || count > MULTICHANNEL_MAX) {
+        fprintf(stderr, "ERRO: Número de canais inválido (%d; máximo %d).\n", count, MULTICHANNEL_MAX);
+        return -1;
+    }
+    SymbolSchedule header, trailer;
+    StatsMark mark;
+    STATS_BEGIN(cfg->stats, mark);
+    if (generate_header_schedule(mode, &header, cfg->samplerate) < 0) return -1;
+    STATS_END(cfg->stats, STATS_HEADER, mark);
+    STATS_BEGIN(cfg->stats, mark);
+    if (generate_trailer_schedule(&trailer, cfg->samplerate) < 0) {
+        schedule_free(&header);
+        return -1;
+    }
+    STATS_END(cfg->stats, STATS_TRAILER, mark);
+
+    MultiChannel* ch = (MultiChannel*)calloc((size_t)count, sizeof(MultiChannel));
+    int16_t* interleaved = split ? NULL : (int16_t*)malloc((size_t)STREAM_CHUNK_SAMPLES * count * sizeof(int16_t));
+    if (!ch || (!split && !interleaved)) {
+        perror("malloc canais");
+        free(ch);
+        free(interleaved);
+        schedule_free(&header);
+        schedule_free(&trailer);
+        return -1;
+    }
+    STATS_ALLOC(cfg->stats, (size_t)count * sizeof(MultiChannel)
+                            + (split ? 0 : (size_t)STREAM_CHUNK_SAMPLES * count * sizeof(int16_t)));
+
+    long long expected = schedule_total_samples(&header)
+                       + image_data_total_samples(mode, cfg->samplerate)
+                       + schedule_total_samples(&trailer);
+    WavFileSink shared_wfs;
+    SampleSink shared;
+    int status = 0;
+    int shared_open = 0;
+    if (split) {
+        for (int c = 0; c < count && status == 0; ++c) {
+            status = open_wav_file_sink(&ch[c].wfs, &ch[c].sink, targets[c], cfg->samplerate, cfg->format, 1,
+                                        expected);
+            ch[c].sink_open = status == 0;
+        }
+    } else {
+        status = open_wav_file_sink(&shared_wfs, &shared, targets[0], cfg->samplerate, cfg->format, count,
+                                    expected * count);
+        shared_open = status == 0;
+    }
+
+    int16_t* planes[MULTICHANNEL_MAX];
+    long long frames = 0;
+    int produced;
+
+    // Cabeçalho: uma síntese só, o mesmo bloco em todos os canais.
+    SynthCursor head;
+    synth_cursor_init(&head, &header, cfg);
+    head.cache = cache;
+    while (status == 0) {
+        int16_t* dst = split && ch[0].sink.direct ? ch[0].sink.direct(ch[0].sink.ctx, frames, STREAM_CHUNK_SAMPLES)
+                                                  : NULL;
+        if (!dst) dst = ch[0].plane;
+        STATS_BEGIN(cfg->stats, mark);
+        produced = synth_render(&head, dst, STREAM_CHUNK_SAMPLES);
+        STATS_END(cfg->stats, STATS_SYNTH, mark);
+        if (produced <= 0) break;
+        for (int c = 0; c < count; ++c) planes[c] = dst;
+        STATS_BEGIN(cfg->stats, mark);
+        if (multichannel_write(ch, count, split, &shared, interleaved, frames, planes, produced) < 0) status = -1;
+        STATS_END(cfg->stats, STATS_OUTPUT, mark);
+        frames += produced;
+    }
+
+    for (int c = 0; c < count; ++c) {
+        SymbolSource parts[2] = {
+            image_symbol_source(&ch[c].image, mode, &imgs[c], cfg->samplerate),
+            schedule_source(&ch[c].trailer_src, &trailer)
+        };
+        synth_cursor_init_source(&ch[c].cursor, chain_source(&ch[c].chain, parts, 2), cfg);
+        ch[c].cursor.cache = cache;
+        ch[c].cursor.phase = head.phase;
+    }
+    while (status == 0) {
+        produced = -1;
+        STATS_BEGIN(cfg->stats, mark);
+        for (int c = 0; c < count; ++c) {
+            int16_t* dst = split && ch[c].sink.direct
+                         ? ch[c].sink.direct(ch[c].sink.ctx, frames, STREAM_CHUNK_SAMPLES) : NULL;
+            planes[c] = dst ? dst : ch[c].plane;
+            int n = synth_render(&ch[c].cursor, planes[c], STREAM_CHUNK_SAMPLES);
+            if (produced >= 0 && n != produced) {
+                fprintf(stderr, "ERRO: Canais dessincronizados (%d != %d amostras).\n", n, produced);
+                status = -1;
+            }
+            produced = n;
+        }
+        STATS_END(cfg->stats, STATS_SYNTH, mark);
+        if (status < 0 || produced <= 0) break;
+        STATS_BEGIN(cfg->stats, mark);
+        if (multichannel_write(ch, count, split, &shared, interleaved, frames, planes, produced) < 0) status = -1;
+        STATS_END(cfg->stats, STATS_OUTPUT, mark);
+        frames += produced;
+    }
+
+    STATS_BEGIN(cfg->stats, mark);
+    for (int c = 0; c < count; ++c) {
+        if (ch[c].sink_open && ch[c].sink.close(ch[c].sink.ctx, status == 0 ? frames : 0) < 0) status = -1;
+    }
+    if (shared_open && shared.close(shared.ctx, status == 0 ? frames * count : 0) < 0) status = -1;
+    STATS_END(cfg->stats, STATS_OUTPUT, mark);
+
+    free(ch);
+    free(interleaved);
+    schedule_free(&header);
+    schedule_free(&trailer);
+    if (status < 0) {
+        fprintf(stderr, "ERRO: Falha ao gerar o quadro de %d canais.\n", count);
+        return -1;
+    }
+    STATS_SAMPLES(cfg->stats, frames * count);
+    return frames;
+}
+
+// Cronograma compilado (.ssts). O registro pendente absorve os seguintes enquanto
+// forem o mesmo tom (ou silêncio) sem segmento de cache; a soma das amostras é a
+// mesma que o motor daria símbolo a símbolo, então o quadro mantém a duração.
+#define PACKED_WRITE_RECORDS 4096
+
+static int pack_symbol(const AudioSymbol* sym, PackedSymbol* out) {
+    double f0 = 0.0, f1 = 0.0, amp = 0.0, phase_offset = 0.0;
+    if (sym->type == TONE_SYMBOL) {
+        f0 = f1 = sym->tone.frequency;
+        amp = sym->tone.amplitude;
+        phase_offset = sym->tone.phase_offset;
+    } else if (sym->type == LINEAR_SWEEP_SYMBOL) {
+        f0 = sym->sweep.freqstart;
+        f1 = sym->sweep.freqend;
+        amp = sym->sweep.amplitude;
+        phase_offset = sym->sweep.phase_offset;
+    }
+    if (phase_offset != 0.0 || f0 < 0.0 || f1 < 0.0 || f0 * PACKED_FREQ_SCALE > UINT32_MAX ||
+        f1 * PACKED_FREQ_SCALE > UINT32_MAX) {
+        fprintf(stderr, "ERRO: Símbolo fora do formato compacto (%.3f-%.3f Hz, fase %.3f).\n", f0, f1, phase_offset);
+        return -1;
+    }
+    if (amp > 1.0) amp = 1.0;
+    if (amp < -1.0) amp = -1.0;
+    out->samples = (uint32_t)sym->samples;
+    out->freq_start = (uint32_t)lrint(f0 * PACKED_FREQ_SCALE);
+    out->freq_end = (uint32_t)lrint(f1 * PACKED_FREQ_SCALE);
+    out->amplitude = (int16_t)lrint(amp * PACKED_AMPLITUDE_SCALE);
+    out->type = (uint8_t)sym->type;
+    out->segment = (uint8_t)sym->segment;
+    if (out->type == LINEAR_SWEEP_SYMBOL && out->freq_start == out->freq_end) out->type = TONE_SYMBOL;
+    return 0;
+}
+
+static int packed_mergeable(const PackedSymbol* a, const PackedSymbol* b) {
+    if (a->type != b->type || a->type == LINEAR_SWEEP_SYMBOL) return 0;
+    if (a->segment != PCM_SEG_NONE || b->segment != PCM_SEG_NONE) return 0;
+    if ((uint64_t)a->samples + b->samples > UINT32_MAX) return 0;
+    return a->type == SILENCE_SYMBOL || (a->freq_start == b->freq_start && a->amplitude == b->amplitude);
+}
+
+// Consome `source` e grava o .ssts em `filename`. Retorna o total de amostras ou -1;
+// symbols_in/records_out (opcionais) recebem quantos símbolos entraram e quantos
+// registros saíram.
+long long compile_packed_schedule(const char* filename, SymbolSource source, const SstvMode* mode,
+                                  int samplerate_local, long long* symbols_in, long long* records_out) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) { perror(filename); return -1; }
+    PackedScheduleHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PACKED_SCHEDULE_MAGIC, 4);
+    hdr.byte_order = PACKED_BYTE_ORDER_MARK;
+    hdr.version = PACKED_SCHEDULE_VERSION;
+    hdr.record_bytes = sizeof(PackedSymbol);
+    hdr.samplerate = (uint32_t)samplerate_local;
+    snprintf(hdr.mode, sizeof(hdr.mode), "%s", mode->name);
+
+    PackedSymbol* buf = (PackedSymbol*)malloc(PACKED_WRITE_RECORDS * sizeof(PackedSymbol));
+    int status = buf && fwrite(&hdr, sizeof(hdr), 1, f) == 1 ? 0 : -1;
+    int used = 0;
+    long long in = 0;
+    AudioSymbol sym;
+    while (status == 0 && source.next(source.ctx, &sym)) {
+        PackedSymbol rec;
+        in++;
+        if (pack_symbol(&sym, &rec) < 0) { status = -1; break; }
+        if (rec.samples == 0) continue;
+        hdr.total_samples += rec.samples;
+        if (used > 0 && packed_mergeable(&buf[used - 1], &rec)) {
+            buf[used - 1].samples += rec.samples;
+            continue;
+        }
+        if (used == PACKED_WRITE_RECORDS) {
+            // O último registro fica no buffer: ainda pode absorver os próximos.
+            if (fwrite(buf, sizeof(PackedSymbol), used - 1, f) != (size_t)(used - 1)) { status = -1; break; }
+            buf[0] = buf[used - 1];
+            used = 1;
+        }
+        buf[used++] = rec;
+        hdr.count++;
+    }
+    if (status == 0 && used > 0 && fwrite(buf, sizeof(PackedSymbol), used, f) != (size_t)used) status = -1;
+    // O cabeçalho volta ao início com a contagem final.
+    if (status == 0 && (fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1)) status = -1;
+    if (fclose(f) != 0) status = -1;
+    free(buf);
+    if (status < 0) {
+        fprintf(stderr, "ERRO: Falha ao gravar o cronograma compilado %s.\n", filename);
+        return -1;
+    }
+    if (symbols_in) *symbols_in = in;
+    if (records_out) *records_out = (long long)hdr.count;
+    return (long long)hdr.total_samples;
+}
+
+// Mapeia um .ssts e confere o cabeçalho; os registros são usados no lugar, sem cópia.
+int map_packed_schedule(const char* filename, PackedSchedule* ps) {
+    struct stat st;
+    memset(ps, 0, sizeof(*ps));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(filename);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(PackedScheduleHeader)) {
+        fprintf(stderr, "ERRO: %s é curto demais para um cronograma compilado.\n", filename);
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return -1; }
+    ps->map = map;
+    ps->map_size = (size_t)st.st_size;
+    ps->header = (const PackedScheduleHeader*)map;
+    ps->syms = (const PackedSymbol*)(ps->header + 1);
+
+    const PackedScheduleHeader* h = ps->header;
+    char mode_name[sizeof(h->mode) + 1];
+    memcpy(mode_name, h->mode, sizeof(h->mode));
+    mode_name[sizeof(h->mode)] = '\0';
+    const char* problem = NULL;
+    if (memcmp(h->magic, PACKED_SCHEDULE_MAGIC, 4) != 0) problem = "não é um cronograma compilado";
+    else if (h->byte_order != PACKED_BYTE_ORDER_MARK) problem = "foi gravado num host de outra ordem de bytes";
+    else if (h->version != PACKED_SCHEDULE_VERSION || h->record_bytes != sizeof(PackedSymbol)) {
+        problem = "tem versão ou registro incompatível";
+    } else if (h->count > (ps->map_size - sizeof(*h)) / sizeof(PackedSymbol)) problem = "está truncado";
+    else if (h->samplerate < 1 || !(ps->mode = find_sstv_mode(mode_name))) problem = "tem modo ou taxa inválidos";
+    // O arquivo pode vir de outra máquina: tipo e segmento indexam tabelas, e os
+    // chamadores dimensionam a saída por total_samples.
+    uint64_t sum = 0;
+    for (uint64_t i = 0; !problem && i < h->count; ++i) {
+        const PackedSymbol* p = &ps->syms[i];
+        if (p->type > LINEAR_SWEEP_SYMBOL || p->segment > PCM_SEG_EOF || p->samples > INT_MAX) {
+            problem = "tem registro inválido";
+        }
+        sum += p->samples;
+    }
+    if (!problem && sum != h->total_samples) problem = "tem total de amostras diferente da soma dos registros";
+    if (problem) {
+        fprintf(stderr, "ERRO: %s %s.\n", filename, problem);
+        unmap_packed_schedule(ps);
+        return -1;
+    }
+    madvise(map, ps->map_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void unmap_packed_schedule(PackedSchedule* ps) {
+    if (ps->map) munmap(ps->map, ps->map_size);
+    ps->map = NULL;
+    ps->header = NULL;
+    ps->syms = NULL;
+}
+
+static int packed_schedule_next(void* ctx, AudioSymbol* out) {
+    PackedScheduleSource* pss = (PackedScheduleSource*)ctx;
+    if (pss->idx >= pss->count) return 0;
+    const PackedSymbol* p = &pss->syms[pss->idx++];
+    out->samples = (int)p->samples;
+    out->type = (AudioSymbolType)p->type;
+    out->segment = (PcmSegment)p->segment;
+    double amp = p->amplitude / PACKED_AMPLITUDE_SCALE;
+    if (p->type == LINEAR_SWEEP_SYMBOL) {
+        out->sweep.freqstart = p->freq_start / PACKED_FREQ_SCALE;
+        out->sweep.freqend = p->freq_end / PACKED_FREQ_SCALE;
+        out->sweep.amplitude = amp;
+        out->sweep.phase_offset = 0.0;
+    } else {
+        out->tone.frequency = p->freq_start / PACKED_FREQ_SCALE;
+        out->tone.amplitude = amp;
+        out->tone.phase_offset = 0.0;
+    }
+    return 1;
+}
+
+SymbolSource packed_schedule_source(PackedScheduleSource* pss, const PackedSchedule* ps) {
+    pss->syms = ps->syms;
+    pss->count = ps->header->count;
+    pss->idx = 0;
+    SymbolSource src = { packed_schedule_next, pss };
+    return src;
+}
+
+// Compila o quadro completo (cabeçalho, imagem e final) direto dos pixels.
+long long compile_frame_schedule(const SstvMode* mode, const SstvImages* img, int samplerate_local,
+                                 const char* filename, SstvStats* stats, long long* symbols_in, long long* records_out) {
+    SstvFrameSource frame;
+    SymbolSource source;
+    if (sstv_frame_source_init(&frame, mode, img, samplerate_local, &source, stats) < 0) return -1;
+    StatsMark mark;
+    STATS_BEGIN(stats, mark);
+    long long total = compile_packed_schedule(filename, source, mode, samplerate_local, symbols_in, records_out);
+    STATS_END(stats, STATS_IMAGE, mark);
+    sstv_frame_source_free(&frame);
+    return total;
+}
+
+// Sintetiza um .ssts já mapeado para um WAV (target == NULL: stdout). A taxa da
+// configuração tem de ser a do arquivo: as durações estão em amostras.
+long long render_packed_schedule(const PackedSchedule* ps, const SynthConfig* cfg, PcmCache* cache,
+                                 const char* target) {
+    if ((uint32_t)cfg->samplerate != ps->header->samplerate) {
+        fprintf(stderr, "ERRO: Cronograma compilado para %u Hz; síntese configurada para %d Hz.\n",
+                ps->header->samplerate, cfg->samplerate);
+        return -1;
+    }
+    PackedScheduleSource pss;
+    WavFileSink wfs;
+    SampleSink sink;
+    if (open_wav_file_sink(&wfs, &sink, target, cfg->samplerate, cfg->format, 1,
+                           (long long)ps->header->total_samples) < 0) {
+        return -1;
+    }
+    return stream_wav_source(packed_schedule_source(&pss, ps), cfg, cache, &sink);
+}
+
+static double timespec_diff(const struct timespec* a, const struct timespec* b) {
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+static struct timespec timespec_add(struct timespec t, double seconds) {
+    long long ns = t.tv_nsec + (long long)(seconds * 1e9);
+    t.tv_sec += ns / 1000000000LL;
+    ns %= 1000000000LL;
+    if (ns < 0) { ns += 1000000000LL; t.tv_sec--; }
+    t.tv_nsec = (long)ns;
+    return t;
+}
+
+// Codifica um quadro em blocos de rt->block_samples escritos assim que ficam
+// prontos. Num pipe ou FIFO o cabeçalho não pode ser corrigido depois, então já
+// sai com o tamanho final (o quadro tem duração conhecida). Com rt->pace, o bloco
+// que começa na amostra s só é escrito em origem + s/taxa - lead, e o consumidor
+// recebe o áudio no ritmo em que toca, sem rajadas. Retorna as amostras escritas ou -1.
+long long encode_frame_realtime(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg,
+                                RealtimeOptions* rt) {
+    SstvFrameSource frame;
+    SymbolSource source;
+    if (sstv_frame_source_init(&frame, mode, img, cfg->samplerate, &source, cfg->stats) < 0) return -1;
+
+    const SampleFormatInfo* fi = sample_format_info(cfg->format);
+    int block = rt->block_samples > 0 ? rt->block_samples : STREAM_CHUNK_SAMPLES;
+    // O motor já entrega cada bloco no formato de saída (synth_render_format).
+    uint8_t* samples = (uint8_t*)malloc((size_t)block * fi->bytes_per_sample);
+    int fd = STDOUT_FILENO;
+    if (rt->target) fd = open(rt->target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!samples || fd < 0) {
+        perror(fd < 0 ? rt->target : "malloc bloco de tempo real");
+        free(samples);
+        sstv_frame_source_free(&frame);
+        return -1;
+    }
+
+    STATS_ALLOC(cfg->stats, (long long)block * fi->bytes_per_sample);
+    long long total = sstv_frame_total_samples(&frame);
+    uint8_t header[WAV_HEADER_BUF_BYTES];
+    int header_bytes = rt->raw ? 0 : build_wav_header(header, cfg->samplerate, cfg->format, 1, total,
+                                                      wav_needs_rf64(cfg->format, total));
+
+    SynthCursor cursor;
+    synth_cursor_init_source(&cursor, source, cfg);
+    rt->first_sample_seconds = -1.0;
+    rt->worst_block_seconds = 0.0;
+    rt->late_blocks = 0;
+
+    struct timespec play_start, t0, t1;
+    long long written = 0;
+    int status = 0;
+    StatsMark mark;
+    for (;;) {
+        STATS_BEGIN(cfg->stats, mark);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int produced = synth_render_format(&cursor, samples, block);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        STATS_END(cfg->stats, STATS_SYNTH, mark);
+        if (produced <= 0) break;
+        double cost = timespec_diff(&t0, &t1);
+        if (cost > rt->worst_block_seconds) rt->worst_block_seconds = cost;
+
+        if (written > 0) {
+            double due = (double)written / cfg->samplerate;
+            if (timespec_diff(&play_start, &t1) > due) rt->late_blocks++;
+            if (rt->pace) {
+                struct timespec wake = timespec_add(play_start, due - rt->lead_seconds);
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {}
+            }
+        }
+
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (header_bytes > 0) {
+            iov[iovcnt].iov_base = header;
+            iov[iovcnt++].iov_len = (size_t)header_bytes;
+            header_bytes = 0;
+        }
+        iov[iovcnt].iov_base = samples;
+        iov[iovcnt++].iov_len = (size_t)produced * fi->bytes_per_sample;
+        STATS_BEGIN(cfg->stats, mark);
+        int wrote = write_all_v(fd, iov, iovcnt);
+        STATS_END(cfg->stats, STATS_OUTPUT, mark);
+        if (wrote < 0) {
+            perror("write tempo real");
+            status = -1;
+            break;
+        }
+        STATS_SAMPLES(cfg->stats, produced);
+        if (written == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &play_start);
+            rt->first_sample_seconds = timespec_diff(&rt->origin, &play_start);
+        }
+        written += produced;
+    }
+
+    // Num arquivo em NFS, por exemplo, o erro de escrita só aparece no close.
+    if (rt->target && close(fd) < 0) {
+        perror(rt->target);
+        status = -1;
+    }
+    free(samples);
+    sstv_frame_source_free(&frame);
+    return status < 0 ? -1 : written;
+}
+
+int line_cache_init(LineCache* lc, const SstvMode* mode, const SynthConfig* cfg) {
+    lc->mode = mode;
+    lc->cfg = cfg;
+    lc->nlines = sstv_mode_lines(mode);
+    lc->frame = 0;
+    lc->bytes = 0;
+    lc->hits = 0;
+    lc->misses = 0;
+    lc->lines = (LineCacheEntry*)calloc((size_t)lc->nlines * LINE_CACHE_WAYS, sizeof(LineCacheEntry));
+    if (!lc->lines) { perror("calloc LineCache"); return -1; }
+    return 0;
+}
+
+static void line_cache_drop(LineCache* lc, LineCacheEntry* e) {
+    lc->bytes -= (size_t)e->capacity * 2 * sizeof(int16_t);
+    free(e->pcm);
+    free(e->quad);
+    memset(e, 0, sizeof(*e));
+}
+
+void line_cache_free(LineCache* lc) {
+    if (!lc->lines) return;
+    for (int i = 0; i < lc->nlines * LINE_CACHE_WAYS; ++i) {
+        free(lc->lines[i].pcm);
+        free(lc->lines[i].quad);
+    }
+    free(lc->lines);
+    lc->lines = NULL;
+    lc->bytes = 0;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t n) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL; // FNV-1a
+    }
+    return h;
+}
+
+// Tudo o que a linha lê da imagem: as linhas da capa e, se houver, a da flag.
+static uint64_t image_line_hash(const SstvMode* mode, const SstvImages* img, int line) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int dims[3] = { img->cover_w, img->cover_h, img->cover_channels };
+    h = hash_bytes(h, dims, sizeof(dims));
+    h = hash_bytes(h, &line, sizeof(line));
+    size_t row_bytes = (size_t)img->cover_w * img->cover_channels;
+    for (int r = 0; r < mode->rows_per_line; ++r) {
+        int y = line * mode->rows_per_line + r;
+        if (y >= img->cover_h) y = img->cover_h - 1;
+        h = hash_bytes(h, img->cover + (size_t)y * row_bytes, row_bytes);
+    }
+    if (flag_row_active(mode, line)) {
+        h = hash_bytes(h, &img->flag[(line - FLAG_IMG_POS_Y) * img->flag_w], FLAG_IMG_WIDTH);
+    }
+    return h ? h : 1;
+}
+
+// Sintetiza uma fonte inteira a partir de `*phase`, entregando os blocos ao sink.
+static int render_source_to_sink(SymbolSource source, const SynthConfig* cfg, PcmCache* cache,
+                                 double* phase, SampleSink* sink, long long* written) {
+    int16_t chunk[STREAM_CHUNK_SAMPLES];
+    SynthCursor cursor;
+    synth_cursor_init_source(&cursor, source, cfg);
+    cursor.cache = cache;
+    cursor.phase = *phase;
+    int produced;
+    while ((produced = synth_render(&cursor, chunk, STREAM_CHUNK_SAMPLES)) > 0) {
+        if (sink->write(sink->ctx, chunk, produced) < 0) return -1;
+        *written += produced;
+    }
+    *phase = cursor.phase;
+    return 0;
+}
+
+// Linha guardada, girada da fase em que foi sintetizada para `phase`.
+static int splice_cached_line(const LineCacheEntry* e, double phase, SampleSink* sink, long long* written) {
+    int16_t chunk[STREAM_CHUNK_SAMPLES];
+    double delta = phase - e->start_phase;
+    float c = (float)cos(delta), s = (float)sin(delta);
+    for (int pos = 0; pos < e->length; pos += STREAM_CHUNK_SAMPLES) {
+        int n = e->length - pos < STREAM_CHUNK_SAMPLES ? e->length - pos : STREAM_CHUNK_SAMPLES;
+        for (int k = 0; k < n; ++k) {
+            float v = e->pcm[pos + k] * c + e->quad[pos + k] * s;
+            v = v > 32767.0f ? 32767.0f : v < -32767.0f ? -32767.0f : v;
+            chunk[k] = (int16_t)lrintf(v);
+        }
+        if (sink->write(sink->ctx, chunk, n) < 0) return -1;
+    }
+    *written += e->length;
+    return 0;
+}
+
+// Com `quad` a linha sai junto com a quadratura, numa só passada pelos símbolos.
+static int render_image_line(SymbolSource src, int line, const SynthConfig* cfg, double phase,
+                             int16_t* dst, int16_t* quad, int max, double* end_phase) {
+    image_symbol_source_seek((ImageSymbolSource*)src.ctx, line, line + 1);
+    SynthCursor cursor;
+    synth_cursor_init_source(&cursor, src, cfg);
+    cursor.phase = phase;
+    int n = quad ? synth_render_pair(&cursor, dst, quad, max) : synth_render(&cursor, dst, max);
+    *end_phase = cursor.phase;
+    return n;
+}
+
+// Entrada de `line` com o conteúdo `h`; sem ela, a via vazia ou a usada há mais tempo.
+static LineCacheEntry* line_cache_lookup(LineCache* lc, int line, uint64_t h, int* found) {
+    LineCacheEntry* ways = &lc->lines[(size_t)line * LINE_CACHE_WAYS];
+    LineCacheEntry* victim = &ways[0];
+    for (int w = 0; w < LINE_CACHE_WAYS; ++w) {
+        if (ways[w].hash == h) { *found = 1; return &ways[w]; }
+        if (victim->hash && (!ways[w].hash || ways[w].used < victim->used)) victim = &ways[w];
+    }
+    *found = 0;
+    return victim;
+}
+
+// Como encode_frame, mas linha a linha através de `lc`. Com o cache vazio a saída
+// é idêntica à do encode_frame; linhas repetidas saem do cache já na fase certa.
+// As linhas não passam pelo cache de PCM (`cache` só serve ao cabeçalho e ao
+// trailer): a fase quantizada dele somaria erro à rotação do par guardado.
+long long encode_frame_incremental(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg,
+                                   PcmCache* cache, LineCache* lc, const char* target) {
+    if (lc->mode != mode || lc->cfg != cfg) {
+        fprintf(stderr, "ERRO: Cache de linhas criado para outro modo ou configuração.\n");
+        return -1;
+    }
+    SymbolSchedule header, trailer;
+    StatsMark mark;
+    STATS_BEGIN(cfg->stats, mark);
+    if (generate_header_schedule(mode, &header, cfg->samplerate) < 0) return -1;
+    STATS_END(cfg->stats, STATS_HEADER, mark);
+    STATS_BEGIN(cfg->stats, mark);
+    if (generate_trailer_schedule(&trailer, cfg->samplerate) < 0) {
+        schedule_free(&header);
+        return -1;
+    }
+    STATS_END(cfg->stats, STATS_TRAILER, mark);
+    ImageSymbolSource* is = (ImageSymbolSource*)malloc(sizeof(ImageSymbolSource));
+    if (!is) {
+        perror("malloc ImageSymbolSource");
+        schedule_free(&header);
+        schedule_free(&trailer);
+        return -1;
+    }
+    SymbolSource line_src = image_symbol_source(is, mode, img, cfg->samplerate);
+
+    long long expected = schedule_total_samples(&header)
+                       + image_data_total_samples(mode, cfg->samplerate)
+                       + schedule_total_samples(&trailer);
+    WavFileSink wfs;
+    SampleSink sink;
+    if (open_wav_file_sink(&wfs, &sink, target, cfg->samplerate, cfg->format, 1, expected) < 0) {
+        free(is);
+        schedule_free(&header);
+        schedule_free(&trailer);
+        return -1;
+    }
+
+    long long written = 0;
+    double phase = 0.0;
+    int16_t* scratch = NULL;
+    long long scratch_len = 0;
+    ScheduleSource ss;
+    int status = render_source_to_sink(schedule_source(&ss, &header), cfg, cache, &phase, &sink, &written);
+    for (int line = 0; status == 0 && line < lc->nlines; ++line) {
+        uint64_t h = image_line_hash(mode, img, line);
+        int found;
+        LineCacheEntry* e = line_cache_lookup(lc, line, h, &found);
+        e->used = lc->frame;
+        if (found) {
+            status = splice_cached_line(e, phase, &sink, &written);
+            phase = fmod(phase + e->advance, 2.0 * M_PI);
+            lc->hits++;
+            continue;
+        }
+        lc->misses++;
+
+        long long samples = sstv_line_offset(&is->timing, line + 1) - sstv_line_offset(&is->timing, line);
+        size_t held = (size_t)e->capacity * 2 * sizeof(int16_t);
+        int store = lc->bytes - held + (size_t)samples * 2 * sizeof(int16_t) <= LINE_CACHE_MAX_BYTES;
+        if (store && samples > e->capacity) {
+            int16_t* grown = (int16_t*)realloc(e->pcm, samples * sizeof(int16_t));
+            if (grown) e->pcm = grown;
+            int16_t* grown_quad = grown ? (int16_t*)realloc(e->quad, samples * sizeof(int16_t)) : NULL;
+            if (grown_quad) {
+                e->quad = grown_quad;
+                STATS_ALLOC(cfg->stats, samples * 2 * sizeof(int16_t));
+                lc->bytes += (size_t)(samples - e->capacity) * 2 * sizeof(int16_t);
+                e->capacity = (int)samples;
+            } else {
+                store = 0;
+            }
+        }
+        int16_t* pcm = e->pcm;
+        if (!store) {
+            // Sem espaço: a linha é sintetizada e enviada sem ir para o cache.
+            line_cache_drop(lc, e);
+            if (samples > scratch_len) {
+                int16_t* grown = (int16_t*)realloc(scratch, samples * sizeof(int16_t));
+                if (!grown) { perror("realloc"); status = -1; break; }
+                scratch = grown;
+                scratch_len = samples;
+            }
+            pcm = scratch;
+        }
+
+        double end_phase;
+        int16_t* quad = store ? e->quad : NULL;
+        int n = render_image_line(line_src, line, cfg, phase, pcm, quad, (int)samples, &end_phase);
+        if (store) {
+            e->hash = h;
+            e->length = n;
+            e->start_phase = phase;
+            e->advance = end_phase - phase;
+        }
+        if (sink.write(sink.ctx, pcm, n) < 0) status = -1;
+        written += n;
+        phase = end_phase;
+    }
+    if (status == 0) status = render_source_to_sink(schedule_source(&ss, &trailer), cfg, cache, &phase, &sink, &written);
+    if (sink.close(sink.ctx, written) < 0) status = -1;
+    lc->frame++;
+
+    free(scratch);
+    free(is);
+    schedule_free(&header);
+    schedule_free(&trailer);
+    if (status < 0) {
+        fprintf(stderr, "ERRO: Falha ao gerar o quadro incremental.\n");
+        return -1;
+    }
+    STATS_SAMPLES(cfg->stats, written);
+    return written;
+}
+
+
+// API pública (sstvenc.h).
+struct SstvEncoder {
+    SynthConfig cfg;
+    const SstvMode* mode;
+    SstvImages images;
+    PcmCache cache;
+    int use_cache;
+    SstvFrameSource frame;
+    int frame_ready;
+    SynthCursor cursor;
+};
+
+void sstv_encoder_config_init(SstvEncoderConfig* cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+SstvEncoder* sstv_encoder_new(const SstvEncoderConfig* cfg) {
+    SstvEncoderConfig defaults;
+    if (!cfg) {
+        sstv_encoder_config_init(&defaults);
+        cfg = &defaults;
+    }
+    const SstvMode* mode = find_sstv_mode(cfg->mode ? cfg->mode : "classico");
+    if (!mode) {
+        fprintf(stderr, "ERRO: Modo SSTV desconhecido: %s\n", cfg->mode);
+        return NULL;
+    }
+    SynthEngine engine = SYNTH_ENGINE_LIBM;
+    if (cfg->engine && parse_synth_engine(cfg->engine, &engine) < 0) return NULL;
+    int samplerate = cfg->samplerate ? cfg->samplerate : SAMPLERATE;
+    if (samplerate < 8000 || samplerate > 384000) {
+        fprintf(stderr, "ERRO: Taxa de amostragem fora do intervalo 8000-384000 Hz: %d\n", samplerate);
+        return NULL;
+    }
+
+    SstvEncoder* enc = (SstvEncoder*)calloc(1, sizeof(SstvEncoder));
+    if (!enc) { perror("calloc SstvEncoder"); return NULL; }
+    enc->mode = mode;
+    synth_config_init(&enc->cfg, engine, samplerate);
+    if (cfg->isa && synth_config_force_isa(&enc->cfg, cfg->isa) < 0) {
+        free(enc);
+        return NULL;
+    }
+    enc->use_cache = cfg->pcm_cache && pcm_cache_init(&enc->cache, &enc->cfg) == 0;
+    return enc;
+}
+
+static void sstv_encoder_stop(SstvEncoder* enc) {
+    if (enc->frame_ready) sstv_frame_source_free(&enc->frame);
+    enc->frame_ready = 0;
+}
+
+void sstv_encoder_free(SstvEncoder* enc) {
+    if (!enc) return;
+    sstv_encoder_stop(enc);
+    free_sstv_images(&enc->images);
+    if (enc->use_cache) pcm_cache_free(&enc->cache);
+    free(enc);
+}
+
+// Monta a fonte do quadro na primeira leitura depois de uma mudança.
+static int sstv_encoder_start(SstvEncoder* enc) {
+    if (enc->frame_ready) return 0;
+    if (!enc->images.cover || (enc->mode->has_flag && !enc->images.flag)) {
+        fprintf(stderr, "ERRO: Encoder sem %s carregada.\n", enc->images.cover ? "flag" : "imagem");
+        return -1;
+    }
+    SymbolSource source;
+    if (sstv_frame_source_init(&enc->frame, enc->mode, &enc->images, enc->cfg.samplerate, &source, NULL) < 0) return -1;
+    synth_cursor_init_source(&enc->cursor, source, &enc->cfg);
+    enc->cursor.cache = enc->use_cache ? &enc->cache : NULL;
+    enc->frame_ready = 1;
+    return 0;
+}
+
+// Reamostra a imagem do leitor para o modo do encoder e troca a do slot.
+static int sstv_encoder_ingest(SstvEncoder* enc, SstvImageSlot slot, ImageReader* r, const char* what) {
+    SstvImages fresh;
+    int status = slot == SSTV_IMAGE_COVER ? ingest_cover(r, enc->mode, &fresh, what) : ingest_flag(r, &fresh, what);
+    image_reader_close(r);
+    if (status < 0) return -1;
+    sstv_encoder_stop(enc);
+    if (slot == SSTV_IMAGE_COVER) {
+        free_cover_image(&enc->images);
+        enc->images.cover = fresh.cover;
+        enc->images.cover_w = fresh.cover_w;
+        enc->images.cover_h = fresh.cover_h;
+        enc->images.cover_channels = fresh.cover_channels;
+        enc->images.ycbcr = fresh.ycbcr;
+        enc->images.ycbcr_mode = fresh.ycbcr_mode;
+    } else {
+        free_flag_image(&enc->images);
+        enc->images.flag = fresh.flag;
+        enc->images.flag_w = fresh.flag_w;
+        enc->images.flag_h = fresh.flag_h;
+    }
+    return 0;
+}
+
+int sstv_encoder_load_file(SstvEncoder* enc, SstvImageSlot slot, const char* path) {
+    ImageReader r;
+    if (image_reader_open_file(&r, path) < 0) {
+        fprintf(stderr, "ERRO: %s não pôde ser decodificada: %s\n", path, stbi_failure_reason());
+        return -1;
+    }
+    return sstv_encoder_ingest(enc, slot, &r, path);
+}
+
+int sstv_encoder_load_memory(SstvEncoder* enc, SstvImageSlot slot, const void* data, size_t size) {
+    ImageReader r;
+    if (image_reader_open_memory(&r, data, size) < 0) return -1;
+    return sstv_encoder_ingest(enc, slot, &r, "Imagem em memória");
+}
+
+int sstv_encoder_set_pixels(SstvEncoder* enc, SstvImageSlot slot, const uint8_t* pixels,
+                            int width, int height, int channels) {
+    if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        fprintf(stderr, "ERRO: Pixels inválidos (%dx%d, %d canais).\n", width, height, channels);
+        return -1;
+    }
+    ImageReader r;
+    image_reader_open_pixels(&r, pixels, width, height, channels);
+    return sstv_encoder_ingest(enc, slot, &r, "Pixels");
+}
+
+long long sstv_encoder_total_samples(SstvEncoder* enc) {
+    if (sstv_encoder_start(enc) < 0) return -1;
+    return sstv_frame_total_samples(&enc->frame);
+}
+
+size_t sstv_encoder_read(SstvEncoder* enc, int16_t* buf, size_t n) {
+    if (sstv_encoder_start(enc) < 0) return 0;
+    size_t done = 0;
+    while (done < n) {
+        int want = n - done > INT32_MAX ? INT32_MAX : (int)(n - done);
+        int produced = synth_render(&enc->cursor, buf + done, want);
+        if (produced <= 0) break;
+        done += produced;
+    }
+    return done;
+}
+
+void sstv_encoder_rewind(SstvEncoder* enc) {
+    sstv_encoder_stop(enc);
+}
+
+long long sstv_encoder_write_wav(SstvEncoder* enc, const char* path, const char* format) {
+    SampleFormat fmt = SAMPLE_FORMAT_INT16;
+    if (format && parse_sample_format(format, &fmt) < 0) {
+        fprintf(stderr, "ERRO: Formato de amostra desconhecido: %s\n", format);
+        return -1;
+    }
+    long long total = sstv_encoder_total_samples(enc);
+    if (total < 0) return -1;
+
+    WavFileSink* wfs = (WavFileSink*)malloc(sizeof(WavFileSink));
+    if (!wfs) { perror("malloc WavFileSink"); return -1; }
+    SampleSink sink;
+    if (open_wav_file_sink(wfs, &sink, path, enc->cfg.samplerate, fmt, 1, total) < 0) {
+        free(wfs);
+        return -1;
+    }
+    int16_t chunk[STREAM_CHUNK_SAMPLES];
+    long long written = 0;
+    int status = 0;
+    for (;;) {
+        int16_t* dst = sink.direct(sink.ctx, written, STREAM_CHUNK_SAMPLES);
+        if (!dst) dst = chunk;
+        int produced = synth_render(&enc->cursor, dst, STREAM_CHUNK_SAMPLES);
+        if (produced <= 0) break;
+        if (sink.write(sink.ctx, dst, produced) < 0) { status = -1; break; }
+        written += produced;
+    }
+    if (sink.close(sink.ctx, written) < 0) status = -1;
+    free(wfs);
+    return status < 0 ? -1 : written;
+}
@@ -0,0 +1,72 @@
+// libsstvenc: encoder SSTV embutível. Cada SstvEncoder guarda todo o seu estado
+// (configuração, imagens, posição no quadro), sem variáveis globais; encoders
+// diferentes podem rodar ao mesmo tempo em threads diferentes. O mesmo encoder
+// não deve ser usado por duas threads simultaneamente.
+#ifndef SSTVENC_H
+#define SSTVENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Só o que leva SSTV_API sai da biblioteca compartilhada quando ela é compilada
+// com -fvisibility=hidden; o resto de sstvenc.c fica interno.
+#if defined(__GNUC__)
+#define SSTV_API __attribute__((visibility("default")))
+#else
+#define SSTV_API
+#endif
+
+typedef struct SstvEncoder SstvEncoder;
+
+typedef struct {
+    const char* mode;    // "classico", "m1", "s1", "r36", "pd90"... (NULL: "classico")
+    int samplerate;      // Hz (0: 96000)
+    const char* engine;  // "libm", "nco" ou "simd" (NULL: "libm")
+    const char* isa;     // variante SIMD forçada (NULL: escolhida pela CPU)
+    int pcm_cache;       // reaproveita trechos constantes entre quadros (até 32 MB)
+} SstvEncoderConfig;
+
+typedef enum {
+    SSTV_IMAGE_COVER, // imagem principal, 1 a 4 canais
+    SSTV_IMAGE_FLAG   // overlay do modo clássico, convertido para escala de cinza
+} SstvImageSlot;
+
+SSTV_API void sstv_encoder_config_init(SstvEncoderConfig* cfg);
+
+// NULL se a configuração for inválida.
+SSTV_API SstvEncoder* sstv_encoder_new(const SstvEncoderConfig* cfg);
+SSTV_API void sstv_encoder_free(SstvEncoder* enc);
+
+// Imagens de arquivo, de um arquivo já em memória (PNG, JPEG, ...) ou de pixels
+// crus (linhas contíguas, `channels` bytes por pixel), em qualquer tamanho: a
+// imagem é reamostrada por área para a resolução do modo (a flag, para 16x16 em
+// cinza) na chamada; o chamador pode liberar o buffer em seguida. Trocar uma
+// imagem recomeça o quadro. Retornam 0 ou -1.
+SSTV_API int sstv_encoder_load_file(SstvEncoder* enc, SstvImageSlot slot, const char* path);
+SSTV_API int sstv_encoder_load_memory(SstvEncoder* enc, SstvImageSlot slot, const void* data, size_t size);
+SSTV_API int sstv_encoder_set_pixels(SstvEncoder* enc, SstvImageSlot slot, const uint8_t* pixels,
+                            int width, int height, int channels);
+
+// Total de amostras do quadro (-1 se faltar imagem).
+SSTV_API long long sstv_encoder_total_samples(SstvEncoder* enc);
+
+// Gera as próximas n amostras sob demanda. Retorna quantas foram escritas em buf;
+// menos que n só no fim do quadro, 0 depois dele ou em erro.
+SSTV_API size_t sstv_encoder_read(SstvEncoder* enc, int16_t* buf, size_t n);
+
+// Volta ao início do quadro (para retransmitir ou gerar de novo).
+SSTV_API void sstv_encoder_rewind(SstvEncoder* enc);
+
+// Escreve o restante do quadro num arquivo WAV ("int16", "float32", "u8" ou
+// "mulaw"; NULL = int16). Retorna o número de amostras ou -1.
+SSTV_API long long sstv_encoder_write_wav(SstvEncoder* enc, const char* path, const char* format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,634 @@
+// Tipos e funções internas do libsstvenc, compartilhados entre a biblioteca
+// (sstvenc.c) e o programa de linha de comando (main.c). Não fazem parte da API
+// pública; quem embute o encoder deve usar apenas sstvenc.h.
+#ifndef SSTVENC_INTERNAL_H
+#define SSTVENC_INTERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SAMPLERATE 96000 // taxa padrão; a efetiva vem de SynthConfig
+
+#define COVER_IMG_WIDTH 320
+#define COVER_IMG_HEIGHT 256
+
+#define FLAG_IMG_WIDTH 16 
+#define FLAG_IMG_HEIGHT 16
+#define FLAG_IMG_POS_Y 44 
+#define SSTV_COLOR_SCANLINE_DURATION 0.13974
+#define SSTV_FLAG_SEGMENT_TOTAL_DURATION 0.0464
+
+#define SSTV_HSYNC_FREQ 1200.0
+#define SSTV_HSYNC_DURATION 0.009
+
+#define SSTV_PORCH_FREQ 1500.0
+#define SSTV_PIXEL_FREQ_MIN 1500.0
+#define SSTV_PIXEL_FREQ_MAX 2300.0
+#define SSTV_PIXEL_FREQ_RANGE (SSTV_PIXEL_FREQ_MAX - SSTV_PIXEL_FREQ_MIN)
+
+#define SSTV_FLAG_PAD_SYNC_FREQ 2300.0
+#define SSTV_FLAG_PIXEL_FREQ_MIN 1550.0
+#define SSTV_FLAG_PIXEL_FREQ_MAX 2250.0
+#define SSTV_FLAG_PIXEL_FREQ_RANGE (SSTV_FLAG_PIXEL_FREQ_MAX - SSTV_FLAG_PIXEL_FREQ_MIN)
+
+#define SSTV_VOX_TONE_DURATION 0.1
+#define SSTV_VIS_HEADER_TONE_DURATION_SHORT 0.01
+#define SSTV_VIS_HEADER_TONE_DURATION_LONG 0.03 
+#define SSTV_EOF_TONE_DURATION 0.1
+#define SSTV_SILENCE_DURATION 0.1
+
+typedef enum {
+    SILENCE_SYMBOL,
+    TONE_SYMBOL,
+    LINEAR_SWEEP_SYMBOL
+} AudioSymbolType;
+
+// Trechos constantes do sinal (iguais em todo quadro para um modo e taxa), que
+// podem vir do cache de PCM em vez de serem sintetizados de novo.
+typedef enum {
+    PCM_SEG_NONE = 0,
+    PCM_SEG_HEADER,   // VOX + VIS
+    PCM_SEG_HSYNC,
+    PCM_SEG_PORCH,
+    PCM_SEG_FLAG_PAD,
+    PCM_SEG_EOF
+} PcmSegment;
+
+typedef struct {
+    double frequency;
+    double amplitude;
+    double phase_offset;
+} Tone;
+
+typedef struct {
+    double freqstart;
+    double freqend;
+    double amplitude;
+    double phase_offset;
+} LinearSweep;
+
+// Registro único (tagged union): o cronograma inteiro fica num só array contíguo.
+// A duração já vem em amostras inteiras, fixada por quem gera o símbolo.
+typedef struct {
+    int samples;
+    AudioSymbolType type;
+    PcmSegment segment;
+    union {
+        Tone tone;
+        LinearSweep sweep;
+    };
+} AudioSymbol;
+
+// Relógio de amostras em Q32.32: cada símbolo soma o seu passo e recebe a
+// diferença das partes inteiras, como no Bresenham. A fração nunca se perde e,
+// partindo de meia amostra, as fronteiras caem na amostra mais próxima.
+#define SAMPLE_CLOCK_ONE 4294967296.0
+#define SAMPLE_CLOCK_HALF (1ULL << 31)
+
+typedef struct {
+    AudioSymbol* syms;
+    int count;
+    int capacity;
+    int samplerate;  // converte as durações de add_*_symbol
+    uint64_t clock;
+} SymbolSchedule;
+
+#define VOX_SYMBOL_COUNT 8
+#define VIS_SYMBOL_COUNT 15
+#define EOF_SYMBOL_COUNT 4
+
+int schedule_init(SymbolSchedule* sched, int capacity, int samplerate_local);
+void schedule_free(SymbolSchedule* sched);
+int add_silence_symbol(SymbolSchedule* sched, double duration);
+int add_tone_symbol(SymbolSchedule* sched, double duration, double freq, double amp, double phase_offset_rad);
+int add_sweep_symbol(SymbolSchedule* sched, double duration, double f_start, double f_end, double amp, double phase_offset_rad);
+
+#define STREAM_CHUNK_SAMPLES 2048 // 4 KB por bloco
+#define STREAM_RING_CHUNKS 4
+
+#define PARALLEL_JOB_SAMPLES 16384 // ~uma linha de varredura a 96 kHz
+#define MAX_WORKER_THREADS 64
+#define MULTICHANNEL_MAX 16 // imagens por passo em encode_frames_multichannel
+
+// Formatos de amostra na saída. A síntese produz int16; cada formato tem o seu
+// laço de conversão, aplicado por bloco logo antes da escrita.
+typedef enum {
+    SAMPLE_FORMAT_INT16,
+    SAMPLE_FORMAT_FLOAT32,
+    SAMPLE_FORMAT_U8,
+    SAMPLE_FORMAT_MULAW
+} SampleFormat;
+
+typedef struct {
+    const char* name;
+    int16_t wav_tag;       // WAVE_FORMAT_PCM, _IEEE_FLOAT ou _MULAW
+    int bytes_per_sample;
+    void (*convert)(void* dst, const int16_t* src, int count);
+} SampleFormatInfo;
+
+// Destino das amostras no modo streaming: arquivo, stdout ou callback do usuário.
+typedef struct {
+    int (*write)(void* ctx, const int16_t* samples, int count);
+    int (*close)(void* ctx, long long total_samples);
+    // Opcional: região onde o motor pode sintetizar direto; o write seguinte com o
+    // mesmo ponteiro só confirma as amostras.
+    int16_t* (*direct)(void* ctx, long long offset, long long count);
+    // Opcionais: o mesmo par com as amostras já no formato do sink, geradas pelo
+    // motor nesse formato (synth_render_format), sem passar pelo int16.
+    int (*write_native)(void* ctx, const void* data, int count);
+    void* (*direct_native)(void* ctx, long long offset, long long count);
+    void* ctx;
+} SampleSink;
+
+#define WAV_HEADER_BUF_BYTES 96
+
+typedef struct {
+    int fd;
+    int owns_fd;
+    int seekable;
+    int samplerate;
+    SampleFormat format;
+    const SampleFormatInfo* format_info;
+    int channels;         // amostras intercaladas por quadro
+    int rf64;
+    uint8_t header[WAV_HEADER_BUF_BYTES];
+    int header_bytes;
+    int header_pending;   // backend writev: cabeçalho sai junto com o primeiro bloco
+    uint8_t* map;         // backend mmap: arquivo inteiro mapeado
+    size_t map_size;
+    long long written;
+    float convert_buf[STREAM_CHUNK_SAMPLES];
+} WavFileSink;
+
+int open_wav_file_sink(WavFileSink* wfs, SampleSink* sink, const char* filename,
+                       int samplerate_local, SampleFormat format, int channels, long long expected_samples);
+int open_wav_fd_sink(WavFileSink* wfs, SampleSink* sink, int fd, int samplerate_local, SampleFormat format,
+                     int channels, long long expected_samples, int raw);
+
+typedef enum {
+    SYNTH_ENGINE_LIBM,  // referência: sin()/fmod() em double a cada amostra
+    SYNTH_ENGINE_NCO,   // acumulador de fase de 32 bits + tabela seno interpolada
+    SYNTH_ENGINE_SIMD   // fase em forma fechada + seno polinomial vetorizado (SSE4.2/AVX2/AVX-512)
+} SynthEngine;
+
+typedef void (*PolyKernelFn)(int16_t* dst, int j0, int count, double t0, double c0, double c1, float gain);
+typedef void (*PolyKernelF32Fn)(float* dst, int j0, int count, double t0, double c0, double c1, float gain);
+
+// Kernels de uma variante SIMD, um por saída: int16, float em [-1, 1] e int16 com
+// o polinômio grosseiro, que basta para os formatos de 8 bits.
+typedef struct {
+    const char* name;
+    PolyKernelFn int16;
+    PolyKernelF32Fn float32;
+    PolyKernelFn coarse;
+} PolyKernelSet;
+
+// Tamanho da tabela do NCO (2^NCO_LUT_BITS entradas). Com 10 bits o erro de
+// interpolação linear fica em (2*pi/1024)^2/8 ~ 4.7e-6, ~0.15 LSB em 16 bits.
+// Medido com --engine-check no quadro padrão contra libm: 10 bits -> SNR 89 dB
+// (erro máx. 2 LSB), 8 bits -> 86 dB, 6 bits -> 61 dB.
+#ifndef NCO_LUT_BITS
+#define NCO_LUT_BITS 10
+#endif
+#define NCO_LUT_SIZE (1 << NCO_LUT_BITS)
+#define NCO_FRAC_BITS (32 - NCO_LUT_BITS)
+#define NCO_PHASE_SCALE 4294967296.0 // 2^32 = uma volta completa
+#define NCO_SUBPHASE_SCALE 18446744073709551616.0 // 2^64: fase/incremento com 32 bits extras
+
+// Instrumentação (--stats): tempos por etapa, símbolos por tipo, bytes alocados
+// e maior buffer. Fica desligada enquanto SynthConfig.stats for NULL, o que custa
+// um teste de ponteiro por bloco ou símbolo; com -DSSTV_NO_STATS some do binário.
+typedef enum {
+    STATS_LOAD,     // leitura das imagens
+    STATS_HEADER,   // generate_vox_signal + generate_vis_signal
+    STATS_IMAGE,    // generate_image_data_symbols (no streaming, dentro da síntese)
+    STATS_TRAILER,  // generate_eof_signal
+    STATS_PREFIX,   // passada de prefixo serial da renderização paralela
+    STATS_SYNTH,
+    STATS_OUTPUT,
+    STATS_STAGE_COUNT
+} StatsStage;
+
+#define STATS_SYMBOL_TYPES (LINEAR_SWEEP_SYMBOL + 1)
+
+// Contadores atômicos: workers paralelos e do modo lote somam no mesmo registro.
+typedef struct {
+    atomic_llong wall_ns[STATS_STAGE_COUNT];
+    atomic_llong cpu_ns[STATS_STAGE_COUNT];
+    atomic_llong calls[STATS_STAGE_COUNT];
+    atomic_llong symbols[STATS_SYMBOL_TYPES];
+    atomic_llong bytes_allocated;
+    atomic_llong peak_buffer;
+    atomic_llong samples;
+    struct timespec started;
+} SstvStats;
+
+typedef struct {
+    struct timespec wall;
+    struct timespec cpu;
+} StatsMark;
+
+#ifndef SSTV_NO_STATS
+#define STATS_ENABLED 1
+#define STATS_BEGIN(st, mark) do { if (st) stats_mark(&(mark)); } while (0)
+#define STATS_END(st, stage, mark) do { if (st) stats_add_time((st), (stage), &(mark)); } while (0)
+#define STATS_SYMBOL(st, type) do { if (st) atomic_fetch_add_explicit(&(st)->symbols[(type)], 1, memory_order_relaxed); } while (0)
+#define STATS_SAMPLES(st, n) do { if (st) atomic_fetch_add_explicit(&(st)->samples, (n), memory_order_relaxed); } while (0)
+#define STATS_ALLOC(st, bytes) do { if (st) stats_add_alloc((st), (long long)(bytes)); } while (0)
+#else
+#define STATS_ENABLED 0
+#define STATS_BEGIN(st, mark) do { (void)(st); (void)(mark); } while (0)
+#define STATS_END(st, stage, mark) do { (void)(st); } while (0)
+#define STATS_SYMBOL(st, type) do { (void)(st); } while (0)
+#define STATS_SAMPLES(st, n) do { (void)(st); } while (0)
+#define STATS_ALLOC(st, bytes) do { (void)(st); } while (0)
+#endif
+
+typedef struct {
+    SynthEngine engine;
+    int samplerate;
+    SampleFormat format;               // formato das amostras no arquivo de saída
+    int32_t nco_lut[NCO_LUT_SIZE + 1]; // sin * 32767, com uma entrada de guarda
+    float nco_lut_f32[NCO_LUT_SIZE + 1]; // sin em float, para a saída float32
+    const PolyKernelSet* poly;         // escolhido por CPUID em synth_config_init
+    const char* poly_isa;
+    SstvStats* stats;                  // NULL: instrumentação desligada
+} SynthConfig;
+
+// Fonte de símbolos sob demanda: preenche *out com o próximo símbolo e retorna 1,
+// ou 0 quando acaba. Permite sintetizar sem materializar o cronograma inteiro.
+typedef struct {
+    int (*next)(void* ctx, AudioSymbol* out);
+    void* ctx;
+} SymbolSource;
+
+typedef struct {
+    const SymbolSchedule* sched;
+    int idx;
+} ScheduleSource;
+
+#define MAX_CHAINED_SOURCES 4
+
+typedef struct {
+    SymbolSource parts[MAX_CHAINED_SOURCES];
+    int count;
+    int idx;
+} ChainSource;
+
+// Cache de PCM dos trechos constantes (PcmSegment). Cada entrada guarda um símbolo
+// já renderizado a partir de uma fase quantizada em PCM_CACHE_PHASE_BUCKETS variantes;
+// o trecho começa com erro de fase <= pi/PCM_CACHE_PHASE_BUCKETS e termina contínuo.
+#define PCM_CACHE_PHASE_BUCKETS 256
+#define PCM_CACHE_SLOTS 4096
+#define PCM_CACHE_MAX_BYTES (32u << 20)
+
+typedef struct {
+    PcmSegment segment; // PCM_SEG_NONE = slot livre
+    double frequency;
+    double amplitude;
+    int length;
+    int bucket;
+    int16_t* pcm;
+    double end_phase;
+} PcmCacheEntry;
+
+typedef struct {
+    const SynthConfig* cfg; // motor e taxa com que as entradas foram geradas
+    PcmCacheEntry* slots;
+    size_t bytes;
+    long long hits;
+    long long misses;
+} PcmCache;
+
+// Cursor de síntese: guarda onde a renderização parou (símbolo, amostra e fase),
+// permitindo gerar o sinal em blocos de qualquer tamanho sem descontinuidade.
+typedef struct {
+    SymbolSource source;
+    ScheduleSource sched_src; // armazenamento da fonte quando o cursor lê um cronograma
+    AudioSymbol sym;          // símbolo em andamento
+    int sym_active;
+    const SynthConfig* cfg;
+    PcmCache* cache;          // opcional; NULL sintetiza tudo
+    const PcmCacheEntry* cached;
+    int sym_pos;
+    int sym_len;
+    double phase;      // fase acumulada entre símbolos (current_main_phase)
+    double sym_phase;  // fase inicial do tom / fase corrente da varredura
+    uint64_t nco_acc;  // estado do NCO em Q32.32: os 32 bits altos são a fase
+    uint64_t nco_inc;
+    int64_t nco_delta; // variação do incremento por amostra (varreduras)
+    int32_t nco_gain;  // amplitude em Q15
+    double poly_t0;    // fase do símbolo em voltas e seus coeficientes (motor SIMD)
+    double poly_c0;
+    double poly_c1;
+    float poly_gain;
+    float amp_f32;     // amplitude do símbolo, para a saída float32
+} SynthCursor;
+
+// Modos SSTV: geometria, cabeçalho VIS e o programa de uma linha transmitida.
+// O formato clássico deste encoder (RGB sequencial com a flag embutida) continua
+// sendo o padrão; os demais seguem os tempos publicados de cada modo.
+#define SSTV_MAX_LINE_ELEMENTS 16
+#define SSTV_MAX_MODE_WIDTH 640
+
+#define SSTV_VIS_LEADER_FREQ 1900.0
+#define SSTV_VIS_LEADER_DURATION 0.3
+#define SSTV_VIS_BREAK_DURATION 0.01
+#define SSTV_VIS_BIT_DURATION 0.03
+#define SSTV_VIS_BIT_ONE_FREQ 1100.0
+#define SSTV_VIS_BIT_ZERO_FREQ 1300.0
+
+typedef enum {
+    SSTV_COLOR_RGB,   // canais lidos direto da imagem
+    SSTV_COLOR_YCBCR  // linha convertida para Y, R-Y e B-Y antes da varredura
+} SstvColorSpace;
+
+typedef enum {
+    CH_R, CH_G, CH_B,
+    CH_Y,           // luminância da primeira linha da imagem
+    CH_Y2,          // luminância da segunda linha (PD: duas linhas por transmissão)
+    CH_CR, CH_CB,   // crominância (média das linhas transmitidas juntas)
+    CH_CHROMA_ALT,  // R-Y nas linhas pares, B-Y nas ímpares (Robot 36)
+    CH_COUNT
+} SstvChannel;
+
+typedef enum {
+    LINE_TONE,      // tom fixo
+    LINE_TONE_ALT,  // tom que depende da paridade da linha
+    LINE_SCAN,      // varredura de um canal na largura do modo
+    LINE_FLAG       // segmento da flag (só nas linhas que a contêm)
+} LineElementKind;
+
+typedef struct {
+    LineElementKind kind;
+    SstvChannel chan;  // LINE_SCAN
+    double freq;       // LINE_TONE; em LINE_TONE_ALT, linhas pares
+    double freq_alt;   // LINE_TONE_ALT, linhas ímpares
+    double duration;   // duração do tom ou da varredura inteira
+    PcmSegment segment;
+} SstvLineElement;
+
+typedef struct {
+    const char* name;
+    const char* description;
+    int vis_code;             // -1: cabeçalho VIS próprio do formato clássico
+    int width, height;
+    int rows_per_line;        // linhas da imagem por linha transmitida
+    SstvColorSpace color;
+    int scan_edges;           // meio pixel no primeiro/último valor em volta das rampas
+    int has_flag;
+    double start_sync;        // pulso de sincronismo antes da primeira linha (Scottie)
+    int program_len;
+    SstvLineElement program[SSTV_MAX_LINE_ELEMENTS];
+} SstvMode;
+
+// Tempos de um modo a uma taxa, em passos do relógio de amostras, calculados uma
+// vez por quadro. Como todas as linhas somam os mesmos passos (mais os da flag
+// nas linhas que a têm), o relógio no início de qualquer linha sai em forma
+// fechada, e o gerador pode começar numa linha qualquer com as mesmas fronteiras.
+typedef struct {
+    const SstvMode* mode;
+    int samplerate;
+    uint64_t start_sync;                       // 0: modo sem pulso inicial
+    uint64_t element[SSTV_MAX_LINE_ELEMENTS];  // tom; em LINE_SCAN, um pixel
+    uint64_t flag_pad;
+    uint64_t flag_pixel;
+    uint64_t line;                             // linha transmitida sem a flag
+    uint64_t flag_line;                        // acréscimo nas linhas com a flag
+} SstvTiming;
+
+// Depois da ingestão a capa já está na resolução do modo, em RGB, e a flag em
+// 16x16; nos modos YCbCr os planos convertidos vêm junto.
+typedef struct {
+    uint8_t* cover;
+    int cover_w, cover_h, cover_channels;
+    uint8_t* ycbcr;               // planos Y, Y2, Cr, Cb por linha transmitida (ou NULL)
+    const SstvMode* ycbcr_mode;   // modo para o qual os planos foram gerados
+    uint8_t* flag; // escala de cinza
+    int flag_w, flag_h;
+} SstvImages;
+
+// Reenvio incremental: o PCM de cada linha transmitida fica guardado junto com a
+// componente em quadratura (a mesma linha com fase +pi/2, sintetizada na mesma
+// passada pelos símbolos). Como a fase inicial de uma linha depende de tudo o que
+// veio antes, ela não entra na chave: uma linha igual é reaproveitada em qualquer
+// fase girando o par (seno, cosseno), e só as linhas cujo conteúdo mudou são
+// sintetizadas de novo. Cada linha guarda as LINE_CACHE_WAYS versões usadas mais
+// recentemente, então quadros que se alternam (a, b, a) também acertam.
+#define LINE_CACHE_MAX_BYTES (64u << 20)
+#define LINE_CACHE_WAYS 2
+
+typedef struct {
+    uint64_t hash;       // 0: vazio
+    int length;
+    int capacity;
+    long long used;      // quadro em que a entrada foi usada por último
+    double start_phase;  // fase em que pcm foi sintetizado
+    double advance;      // avanço de fase ao longo da linha
+    int16_t* pcm;        // sin(theta + start_phase)
+    int16_t* quad;       // cos(theta + start_phase)
+} LineCacheEntry;
+
+typedef struct {
+    const SstvMode* mode;
+    const SynthConfig* cfg;
+    LineCacheEntry* lines; // LINE_CACHE_WAYS entradas por linha transmitida do modo
+    int nlines;
+    long long frame;
+    size_t bytes;
+    long long hits;
+    long long misses;
+} LineCache;
+
+// Saída em tempo real (--realtime): blocos pequenos para stdout ou FIFO, com
+// ritmo opcional pelo relógio. Os campos de medição são preenchidos na volta.
+typedef struct {
+    const char* target;        // NULL: stdout
+    int raw;                   // PCM cru, sem cabeçalho WAV
+    int pace;                  // segura cada bloco até perto da hora de tocar
+    int block_samples;
+    double lead_seconds;       // adiantamento mantido sobre o relógio com pace
+    struct timespec origin;    // referência do tempo até a primeira amostra
+    double first_sample_seconds;
+    double worst_block_seconds; // pior tempo de produção de um bloco
+    long long late_blocks;      // blocos prontos depois da hora de tocar
+} RealtimeOptions;
+
+// Imagem recuperada pelo decodificador de verificação (sstvdec.c).
+typedef struct {
+    const SstvMode* mode;
+    int vis_code;              // -1: cabeçalho clássico
+    int vis_found;
+    uint8_t* rgb;              // mode->width x mode->height, RGB
+    uint8_t flag[FLAG_IMG_WIDTH * FLAG_IMG_HEIGHT];
+    int syncs_expected;
+    int syncs_found;
+    double slant;              // amostras medidas / nominais entre sincronismos
+} SstvDecoded;
+
+typedef struct {
+    double psnr;               // dB, capa inteira nos três canais
+    double flag_psnr;          // dB, só nos modos com flag
+    double mean_abs_err;
+    int max_err;
+} SstvDecodeScore;
+
+// Instrumentação
+void stats_init(SstvStats* st);
+void stats_mark(StatsMark* mark);
+void stats_add_time(SstvStats* st, StatsStage stage, const StatsMark* mark);
+void stats_add_alloc(SstvStats* st, long long bytes);
+void print_stats(FILE* out, const SstvStats* st, int json);
+
+// Síntese
+void synth_config_init(SynthConfig* cfg, SynthEngine engine, int samplerate_local);
+int synth_config_force_isa(SynthConfig* cfg, const char* isa);
+int parse_synth_engine(const char* name, SynthEngine* engine);
+const char* synth_engine_name(SynthEngine engine);
+long long schedule_total_samples(const SymbolSchedule* sched);
+SymbolSource schedule_source(ScheduleSource* ss, const SymbolSchedule* sched);
+SymbolSource chain_source(ChainSource* cs, const SymbolSource* parts, int count);
+void synth_cursor_init_source(SynthCursor* cur, SymbolSource source, const SynthConfig* cfg);
+void synth_cursor_init(SynthCursor* cur, const SymbolSchedule* sched, const SynthConfig* cfg);
+int synth_render(SynthCursor* cur, int16_t* out, int max_samples);
+int synth_render_format(SynthCursor* cur, void* out, int max_samples);
+int pcm_cache_init(PcmCache* cache, const SynthConfig* cfg);
+void pcm_cache_free(PcmCache* cache);
+int16_t* generate_wav(const SymbolSchedule* sched, const SynthConfig* cfg, int* wav_length);
+long long stream_wav_source(SymbolSource source, const SynthConfig* cfg, PcmCache* cache, SampleSink* sink);
+long long stream_wav(const SymbolSchedule* sched, const SynthConfig* cfg, SampleSink* sink);
+int measure_engine_error(const SymbolSchedule* sched, const SynthConfig* cfg,
+                         double* snr_db, int* max_abs_err);
+
+// Execução paralela
+int default_thread_count(void);
+int run_parallel_jobs(int njobs, int nthreads, void (*fn)(void* ctx, int job, int worker), void* ctx);
+int render_schedule_parallel(const SymbolSchedule* sched, const SynthConfig* cfg, int nthreads, int16_t* wav);
+int16_t* generate_wav_parallel(const SymbolSchedule* sched, const SynthConfig* cfg, int nthreads, int* wav_length);
+
+// Modos, imagens e cronogramas
+const SstvMode* find_sstv_mode(const char* name);
+const SstvMode* sstv_mode_at(int index); // NULL depois do último modo
+const SstvMode* find_sstv_mode_by_vis(int vis_code); // -1: clássico
+void print_sstv_modes(FILE* out);
+int probe_image_size(const char* filename, int* width, int* height);
+int load_cover_image(const char* cover_image_filename, const SstvMode* mode, SstvImages* img);
+int load_cover_memory(const void* data, size_t size, const SstvMode* mode, SstvImages* img);
+int load_flag_image(const char* flag_image_filename, SstvImages* img);
+void free_cover_image(SstvImages* img);
+void free_flag_image(SstvImages* img);
+int load_sstv_images(const SstvMode* mode, const char* cover_image_filename, const char* flag_image_filename,
+                     SstvImages* img);
+void free_sstv_images(SstvImages* img);
+int image_data_symbol_count(const SstvMode* mode);
+long long image_data_total_samples(const SstvMode* mode, int samplerate_local);
+void sstv_timing_init(SstvTiming* t, const SstvMode* mode, int samplerate_local);
+uint64_t sstv_line_clock(const SstvTiming* t, int line);
+long long sstv_line_offset(const SstvTiming* t, int line); // amostras do corpo antes da linha
+int generate_vox_signal(SymbolSchedule* sched);
+int generate_vis_signal(SymbolSchedule* sched, const SstvMode* mode);
+int generate_eof_signal(SymbolSchedule* sched);
+int generate_image_data_symbols(const SstvMode* mode, const SstvImages* img, SymbolSchedule* sched);
+int generate_header_schedule(const SstvMode* mode, SymbolSchedule* sched, int samplerate_local);
+int generate_trailer_schedule(SymbolSchedule* sched, int samplerate_local);
+int build_sstv_schedule(const SstvMode* mode, const SstvImages* img, SymbolSchedule* sched, int samplerate_local,
+                        SstvStats* stats);
+
+// Saída WAV
+const SampleFormatInfo* sample_format_info(SampleFormat format);
+int parse_sample_format(const char* name, SampleFormat* format);
+long long wav_stream_bytes(SampleFormat format, long long length, int raw);
+int build_wav_header(uint8_t* buf, int samplerate_local, SampleFormat format, int channels, long long length,
+                     int rf64);
+int save_wav_file(const char* filename, int samplerate_local, SampleFormat format, int num_channels,
+                  int16_t* data, int length);
+
+// Decodificação de verificação (sstvdec.c)
+int sstv_decode(const int16_t* pcm, long long count, int samplerate_local, const SstvMode* mode_hint,
+                SstvDecoded* out);
+void sstv_decoded_free(SstvDecoded* dec);
+void sstv_decode_score(const SstvDecoded* dec, const SstvImages* img, SstvDecodeScore* score);
+void sstv_decode_compare(const SstvDecoded* dec, const SstvDecoded* ref, SstvDecodeScore* score);
+int16_t* read_wav_samples(const char* filename, int channel, int* samplerate_local, long long* count);
+int write_decoded_ppm(const char* filename, const SstvDecoded* dec);
+
+// Cronograma compilado (.ssts): cabeçalho + registros de 16 bytes no layout do
+// host, lidos direto do arquivo mapeado. Durações em amostras inteiras (as do
+// cronograma), frequências em Q16.16 Hz e amplitude em Q15; varreduras
+// que não mudam de frequência viram tons e tons iguais vizinhos viram um só.
+#define PACKED_SCHEDULE_MAGIC "SSTS"
+#define PACKED_SCHEDULE_VERSION 1
+#define PACKED_BYTE_ORDER_MARK 0x01020304u
+#define PACKED_FREQ_SCALE 65536.0
+#define PACKED_AMPLITUDE_SCALE 32767.0
+
+typedef struct {
+    char magic[4];
+    uint32_t byte_order;    // PACKED_BYTE_ORDER_MARK como o host que gravou o viu
+    uint16_t version;
+    uint16_t record_bytes;  // sizeof(PackedSymbol)
+    uint32_t samplerate;
+    uint64_t count;         // registros
+    uint64_t total_samples;
+    char mode[16];          // SstvMode.name
+} PackedScheduleHeader;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t freq_start;    // Hz em Q16.16; tons e silêncio usam só este
+    uint32_t freq_end;
+    int16_t amplitude;      // Q15
+    uint8_t type;           // AudioSymbolType
+    uint8_t segment;        // PcmSegment
+} PackedSymbol;
+
+_Static_assert(sizeof(PackedScheduleHeader) == 48, "cabeçalho .ssts deve ter 48 bytes");
+_Static_assert(sizeof(PackedSymbol) == 16, "registro .ssts deve ter 16 bytes");
+
+typedef struct {
+    const PackedScheduleHeader* header;
+    const PackedSymbol* syms;
+    const SstvMode* mode;
+    void* map;
+    size_t map_size;
+} PackedSchedule;
+
+typedef struct {
+    const PackedSymbol* syms;
+    uint64_t count;
+    uint64_t idx;
+} PackedScheduleSource;
+
+long long compile_packed_schedule(const char* filename, SymbolSource source, const SstvMode* mode,
+                                  int samplerate_local, long long* symbols_in, long long* records_out);
+int map_packed_schedule(const char* filename, PackedSchedule* ps);
+void unmap_packed_schedule(PackedSchedule* ps);
+SymbolSource packed_schedule_source(PackedScheduleSource* pss, const PackedSchedule* ps);
+
+// Quadros completos
+long long compile_frame_schedule(const SstvMode* mode, const SstvImages* img, int samplerate_local,
+                                 const char* filename, SstvStats* stats, long long* symbols_in, long long* records_out);
+long long render_packed_schedule(const PackedSchedule* ps, const SynthConfig* cfg, PcmCache* cache,
+                                 const char* target);
+long long sstv_frame_samples(const SstvMode* mode, int samplerate_local);
+int16_t* render_frame_reference(const SstvMode* mode, const SstvImages* img, int samplerate_local, long long* count);
+long long encode_frame(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg, PcmCache* cache, const char* target);
+long long encode_frame_fd(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg, PcmCache* cache,
+                          int fd, int raw);
+long long encode_frames_multichannel(const SstvMode* mode, const SstvImages* imgs, int count, const SynthConfig* cfg,
+                                     PcmCache* cache, const char* const* targets, int split);
+int line_cache_init(LineCache* lc, const SstvMode* mode, const SynthConfig* cfg);
+void line_cache_free(LineCache* lc);
+long long encode_frame_realtime(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg,
+                                RealtimeOptions* rt);
+long long encode_frame_incremental(const SstvMode* mode, const SstvImages* img, const SynthConfig* cfg,
+                                   PcmCache* cache, LineCache* lc, const char* target);
+
+#endif
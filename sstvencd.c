@@ -0,0 +1,502 @@
+// sstvencd: daemon local de codificação. Escuta num socket UNIX e atende cada
+// conexão num pool fixo de workers, com fila limitada: quando ela enche, o laço
+// de aceitação para e os clientes esperam no backlog do socket. Cada worker
+// mantém aquecidos a configuração de síntese, o buffer de recepção e, para as
+// requisições com SSTVD_FLAG_PCM_CACHE, o cache de PCM dos trechos constantes
+// (VOX/VIS, sincronismos, porches); a flag é decodificada uma vez na partida e
+// compartilhada. Protocolo em sstvencd.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "sstvenc_internal.h"
+#include "sstvencd.h"
+
+#define DAEMON_FLAG_FILENAME "input2.png"
+#define DAEMON_QUEUE_PER_WORKER 2
+#define DAEMON_IO_TIMEOUT_S 5        // cliente parado no meio da requisição
+#define DAEMON_SEND_TIMEOUT_S 60     // cliente que parou de ler; consumidores no ritmo do áudio bloqueiam bem menos
+#define DAEMON_LATENCY_BUCKETS 24    // histograma em potências de 2 de milissegundos
+#define DAEMON_STATS_BYTES 1024
+
+typedef struct {
+    int fd;
+    SstvdRequest req;    // lido pelo worker
+    struct timespec arrived;
+} DaemonJob;
+
+// Fila limitada entre o laço de aceitação e os workers.
+typedef struct {
+    DaemonJob* jobs;
+    int capacity;
+    int head;
+    int count;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} DaemonQueue;
+
+typedef struct {
+    atomic_llong accepted;
+    atomic_llong completed;
+    atomic_llong failed;
+    atomic_llong queue_full_waits;   // conexões que esperaram vaga na fila
+    atomic_llong in_flight;
+    atomic_llong samples;
+    atomic_llong bytes;
+    atomic_llong latency_ns_sum;     // chegada -> último byte
+    atomic_llong latency_ns_max;
+    atomic_llong setup_ns_sum;       // chegada -> primeira amostra (fila + imagem)
+    atomic_llong latency_hist[DAEMON_LATENCY_BUCKETS];
+    struct timespec started;
+} DaemonCounters;
+
+typedef struct Daemon Daemon;
+
+typedef struct {
+    Daemon* d;
+    pthread_t thread;
+    SynthConfig cfg;     // última combinação motor/taxa atendida
+    int cfg_ready;
+    PcmCache cache;      // vale para cfg; criado no primeiro pedido que o usa, refeito quando ela muda
+    int cache_ready;
+    uint8_t* body;       // imagem recebida; cresce e é reaproveitado
+    size_t body_cap;
+} DaemonWorker;
+
+struct Daemon {
+    DaemonQueue queue;
+    DaemonCounters counters;
+    SstvImages flag;
+    SynthEngine engine;
+    int samplerate;
+    int nworkers;
+    DaemonWorker* workers;
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static long long elapsed_ns(const struct timespec* a, const struct timespec* b) {
+    return (long long)(b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+static int read_full(int fd, void* buf, size_t n) {
+    uint8_t* p = (uint8_t*)buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void* buf, size_t n) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int send_response(int fd, int32_t status, uint64_t bytes) {
+    SstvdResponse resp;
+    memcpy(resp.magic, SSTVD_RESPONSE_MAGIC, 4);
+    resp.status = status;
+    resp.bytes = bytes;
+    return write_full(fd, &resp, sizeof(resp));
+}
+
+static void send_error(int fd, const char* message) {
+    size_t len = strlen(message);
+    if (send_response(fd, -1, len) == 0) write_full(fd, message, len);
+}
+
+static void reject(Daemon* d, int fd, const char* message) {
+    fprintf(stderr, "sstvencd: requisição recusada: %s\n", message);
+    send_error(fd, message);
+    atomic_fetch_add(&d->counters.failed, 1);
+}
+
+static int queue_init(DaemonQueue* q, int capacity) {
+    q->jobs = (DaemonJob*)calloc((size_t)capacity, sizeof(DaemonJob));
+    if (!q->jobs) { perror("calloc fila"); return -1; }
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    q->stopping = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+static void queue_free(DaemonQueue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->jobs);
+}
+
+// Bloqueia enquanto a fila estiver cheia: é a contrapressão sobre quem conecta.
+static void queue_push(Daemon* d, const DaemonJob* job) {
+    DaemonQueue* q = &d->queue;
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) atomic_fetch_add(&d->counters.queue_full_waits, 1);
+    while (q->count == q->capacity) pthread_cond_wait(&q->not_full, &q->lock);
+    q->jobs[(q->head + q->count) % q->capacity] = *job;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// 0 quando a fila foi encerrada e esvaziada.
+static int queue_pop(DaemonQueue* q, DaemonJob* job) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->stopping) pthread_cond_wait(&q->not_empty, &q->lock);
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+    *job = q->jobs[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+static int queue_depth(DaemonQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    int n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+static void record_latency(DaemonCounters* c, long long ns) {
+    atomic_fetch_add(&c->latency_ns_sum, ns);
+    long long prev = atomic_load(&c->latency_ns_max);
+    while (ns > prev && !atomic_compare_exchange_weak(&c->latency_ns_max, &prev, ns)) {
+    }
+    int bucket = 0;
+    for (long long ms = ns / 1000000; ms > 0 && bucket < DAEMON_LATENCY_BUCKETS - 1; ms >>= 1) bucket++;
+    atomic_fetch_add(&c->latency_hist[bucket], 1);
+}
+
+// Percentil p (ms) do histograma, interpolado dentro do balde [2^(i-1), 2^i) e
+// limitado ao máximo medido: o balde sozinho dobraria o valor no pior caso.
+static double latency_percentile_ms(DaemonCounters* c, double p) {
+    long long total = 0, seen = 0;
+    long long counts[DAEMON_LATENCY_BUCKETS];
+    for (int i = 0; i < DAEMON_LATENCY_BUCKETS; ++i) total += counts[i] = atomic_load(&c->latency_hist[i]);
+    if (total == 0) return 0.0;
+    double max_ms = atomic_load(&c->latency_ns_max) / 1e6;
+    double rank = p * total;
+    for (int i = 0; i < DAEMON_LATENCY_BUCKETS; ++i) {
+        if (counts[i] == 0 || seen + counts[i] < rank) {
+            seen += counts[i];
+            continue;
+        }
+        double lo = i ? (double)(1LL << (i - 1)) : 0.0;
+        double hi = (double)(1LL << i);
+        double ms = lo + (hi - lo) * (rank - seen) / counts[i];
+        return ms < max_ms ? ms : max_ms;
+    }
+    return max_ms;
+}
+
+static void send_stats(Daemon* d, int fd) {
+    DaemonCounters* c = &d->counters;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double uptime = elapsed_ns(&c->started, &now) / 1e9;
+    long long completed = atomic_load(&c->completed);
+    long long samples = atomic_load(&c->samples);
+    char text[DAEMON_STATS_BYTES];
+    int len = snprintf(text, sizeof(text),
+        "{\"uptime_s\": %.3f, \"workers\": %d, \"queue_capacity\": %d, \"queued\": %d, \"in_flight\": %lld,"
+        " \"accepted\": %lld, \"completed\": %lld, \"failed\": %lld, \"queue_full_waits\": %lld,"
+        " \"samples\": %lld, \"bytes\": %lld, \"frames_per_s\": %.3f, \"samples_per_s\": %.1f,"
+        " \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}, \"setup_ms_mean\": %.3f}\n",
+        uptime, d->nworkers, d->queue.capacity, queue_depth(&d->queue), atomic_load(&c->in_flight),
+        atomic_load(&c->accepted), completed, atomic_load(&c->failed), atomic_load(&c->queue_full_waits),
+        samples, atomic_load(&c->bytes), uptime > 0.0 ? completed / uptime : 0.0,
+        uptime > 0.0 ? samples / uptime : 0.0,
+        completed ? atomic_load(&c->latency_ns_sum) / 1e6 / completed : 0.0,
+        latency_percentile_ms(c, 0.50), latency_percentile_ms(c, 0.99), atomic_load(&c->latency_ns_max) / 1e6,
+        completed ? atomic_load(&c->setup_ns_sum) / 1e6 / completed : 0.0);
+    if (send_response(fd, 0, (uint64_t)len) == 0) write_full(fd, text, (size_t)len);
+}
+
+// Garante que w->cfg (e, se pedido, o cache de PCM atrelado a ela) seja o do
+// motor e taxa pedidos; entre requisições iguais nada é refeito.
+static int worker_configure(DaemonWorker* w, SynthEngine engine, int samplerate, SampleFormat format, int use_cache) {
+    if (!w->cfg_ready || w->cfg.engine != engine || w->cfg.samplerate != samplerate) {
+        if (w->cache_ready) pcm_cache_free(&w->cache);
+        w->cache_ready = 0;
+        synth_config_init(&w->cfg, engine, samplerate);
+        w->cfg_ready = 1;
+    }
+    if (use_cache && !w->cache_ready) w->cache_ready = pcm_cache_init(&w->cache, &w->cfg) == 0;
+    w->cfg.format = format;
+    return 0;
+}
+
+static void worker_serve(DaemonWorker* w, DaemonJob* job) {
+    Daemon* d = w->d;
+    SstvdRequest* req = &job->req;
+    char name[sizeof(req->mode) + 1];
+    char engine_name[sizeof(req->engine) + 1];
+    char format_name[sizeof(req->format) + 1];
+    snprintf(name, sizeof(name), "%.*s", (int)sizeof(req->mode), req->mode[0] ? req->mode : "classico");
+    snprintf(engine_name, sizeof(engine_name), "%.*s", (int)sizeof(req->engine), req->engine);
+    snprintf(format_name, sizeof(format_name), "%.*s", (int)sizeof(req->format),
+             req->format[0] ? req->format : "int16");
+
+    // O corpo é lido antes de validar o resto: fechar com dados não lidos no
+    // socket descartaria a mensagem de erro no cliente.
+    if (req->image_bytes == 0 || req->image_bytes > SSTVD_MAX_IMAGE_BYTES) {
+        reject(d, job->fd, "tamanho de imagem inválido");
+        return;
+    }
+    if (req->image_bytes > w->body_cap) {
+        uint8_t* grown = (uint8_t*)realloc(w->body, req->image_bytes);
+        if (!grown) {
+            reject(d, job->fd, "sem memória para a imagem");
+            return;
+        }
+        w->body = grown;
+        w->body_cap = req->image_bytes;
+    }
+    if (read_full(job->fd, w->body, req->image_bytes) < 0) {
+        reject(d, job->fd, "imagem incompleta");
+        return;
+    }
+
+    const SstvMode* mode = find_sstv_mode(name);
+    SynthEngine engine = d->engine;
+    SampleFormat format;
+    int samplerate = req->samplerate ? (int)req->samplerate : d->samplerate;
+    SstvImages img = { 0 };
+    const char* problem = NULL;
+    if (!mode) problem = "modo SSTV desconhecido";
+    else if (engine_name[0] && parse_synth_engine(engine_name, &engine) < 0) problem = "motor desconhecido";
+    else if (parse_sample_format(format_name, &format) < 0) problem = "formato de amostra desconhecido";
+    else if (samplerate < 8000 || samplerate > 384000) problem = "taxa fora do intervalo 8000-384000 Hz";
+    else if (load_cover_memory(w->body, req->image_bytes, mode, &img) < 0) problem = "imagem não pôde ser decodificada";
+    if (problem) {
+        reject(d, job->fd, problem);
+        return;
+    }
+    img.flag = d->flag.flag;
+    img.flag_w = d->flag.flag_w;
+    img.flag_h = d->flag.flag_h;
+
+    int use_cache = (req->flags & SSTVD_FLAG_PCM_CACHE) != 0;
+    worker_configure(w, engine, samplerate, format, use_cache);
+    int raw = (req->flags & SSTVD_FLAG_RAW) != 0;
+    long long total = sstv_frame_samples(mode, samplerate);
+    long long bytes = wav_stream_bytes(format, total, raw);
+    struct timespec started, done;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    long long written = -1;
+    if (total > 0 && send_response(job->fd, 0, (uint64_t)bytes) == 0) {
+        written = encode_frame_fd(mode, &img, &w->cfg, use_cache && w->cache_ready ? &w->cache : NULL, job->fd, raw);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    free_cover_image(&img);
+
+    if (written != total) {
+        atomic_fetch_add(&d->counters.failed, 1);
+        return;
+    }
+    atomic_fetch_add(&d->counters.completed, 1);
+    atomic_fetch_add(&d->counters.samples, written);
+    atomic_fetch_add(&d->counters.bytes, bytes);
+    atomic_fetch_add(&d->counters.setup_ns_sum, elapsed_ns(&job->arrived, &started));
+    record_latency(&d->counters, elapsed_ns(&job->arrived, &done));
+}
+
+// O cabeçalho é lido aqui, não no laço de aceitação: um cliente lento para
+// mandá-lo prende só este worker (até DAEMON_IO_TIMEOUT_S), nunca o accept.
+static void worker_handle(DaemonWorker* w, DaemonJob* job) {
+    Daemon* d = w->d;
+    if (read_full(job->fd, &job->req, sizeof(job->req)) < 0 ||
+        memcmp(job->req.magic, SSTVD_REQUEST_MAGIC, 4) != 0) {
+        reject(d, job->fd, "requisição inválida");
+        return;
+    }
+    if (job->req.op == SSTVD_OP_STATS) {
+        send_stats(d, job->fd);
+        return;
+    }
+    if (job->req.op != SSTVD_OP_ENCODE) {
+        reject(d, job->fd, "operação desconhecida");
+        return;
+    }
+    atomic_fetch_add(&d->counters.accepted, 1);
+    atomic_fetch_add(&d->counters.in_flight, 1);
+    worker_serve(w, job);
+    atomic_fetch_sub(&d->counters.in_flight, 1);
+}
+
+static void* worker_main(void* arg) {
+    DaemonWorker* w = (DaemonWorker*)arg;
+    DaemonJob job;
+    while (queue_pop(&w->d->queue, &job)) {
+        worker_handle(w, &job);
+        close(job.fd);
+    }
+    return NULL;
+}
+
+static int open_listen_socket(const char* path, int backlog) {
+    struct sockaddr_un addr;
+    struct stat st;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERRO: Caminho de socket longo demais: %s\n", path);
+        return -1;
+    }
+    // Um socket que sobrou de uma execução anterior é removido; outro arquivo, não.
+    if (stat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "ERRO: %s existe e não é um socket.\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, backlog) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    const char* socket_path = SSTVD_DEFAULT_SOCKET;
+    const char* flag_path = DAEMON_FLAG_FILENAME;
+    int threads = default_thread_count();
+    int queue_capacity = 0;
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+    d.engine = SYNTH_ENGINE_SIMD;
+    d.samplerate = SAMPLERATE;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) socket_path = argv[++i];
+        else if (strcmp(argv[i], "--flag") == 0 && i + 1 < argc) flag_path = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) queue_capacity = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) d.samplerate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            if (parse_synth_engine(argv[++i], &d.engine) < 0) return 1;
+        } else {
+            fprintf(stderr, "Uso: %s [--socket caminho] [--threads N] [--queue N] [--flag arquivo]"
+                            " [--engine libm|nco|simd] [--rate Hz]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = default_thread_count();
+    if (threads > MAX_WORKER_THREADS) threads = MAX_WORKER_THREADS;
+    if (queue_capacity < 1) queue_capacity = threads * DAEMON_QUEUE_PER_WORKER;
+    if (d.samplerate < 8000 || d.samplerate > 384000) {
+        fprintf(stderr, "ERRO: Taxa de amostragem fora do intervalo 8000-384000 Hz: %d\n", d.samplerate);
+        return 1;
+    }
+
+    if (load_flag_image(flag_path, &d.flag) < 0) return 1;
+    if (queue_init(&d.queue, queue_capacity) < 0) return 1;
+    int listen_fd = open_listen_socket(socket_path, queue_capacity);
+    if (listen_fd < 0) return 1;
+
+    // Sem SA_RESTART: o accept volta com EINTR e o laço vê o pedido de parada.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    clock_gettime(CLOCK_MONOTONIC, &d.counters.started);
+    d.nworkers = threads;
+    d.workers = (DaemonWorker*)calloc((size_t)threads, sizeof(DaemonWorker));
+    if (!d.workers) { perror("calloc workers"); return 1; }
+    for (int i = 0; i < threads; ++i) {
+        d.workers[i].d = &d;
+        if (pthread_create(&d.workers[i].thread, NULL, worker_main, &d.workers[i]) != 0) {
+            fprintf(stderr, "ERRO: Não foi possível criar o worker %d.\n", i);
+            d.nworkers = i;
+            stop_requested = 1;
+            break;
+        }
+    }
+    fprintf(stderr, "sstvencd: %s, %d workers, fila de %d, motor %s, %d Hz\n", socket_path, d.nworkers,
+            queue_capacity, d.engine == SYNTH_ENGINE_SIMD ? "simd" : d.engine == SYNTH_ENGINE_NCO ? "nco" : "libm",
+            d.samplerate);
+
+    // O laço só aceita e enfileira; toda leitura do socket fica com os workers.
+    // Com a fila cheia ele espera vaga, e até os pedidos de estatística esperam.
+    struct timeval recv_timeout = { DAEMON_IO_TIMEOUT_S, 0 };
+    struct timeval send_timeout = { DAEMON_SEND_TIMEOUT_S, 0 };
+    while (!stop_requested) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        DaemonJob job;
+        memset(&job, 0, sizeof(job));
+        job.fd = fd;
+        clock_gettime(CLOCK_MONOTONIC, &job.arrived);
+        queue_push(&d, &job);
+    }
+
+    fprintf(stderr, "sstvencd: encerrando; terminando as requisições na fila...\n");
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&d.queue.lock);
+    d.queue.stopping = 1;
+    pthread_cond_broadcast(&d.queue.not_empty);
+    pthread_mutex_unlock(&d.queue.lock);
+    for (int i = 0; i < d.nworkers; ++i) {
+        pthread_join(d.workers[i].thread, NULL);
+        if (d.workers[i].cache_ready) pcm_cache_free(&d.workers[i].cache);
+        free(d.workers[i].body);
+    }
+    fprintf(stderr, "sstvencd: %lld concluídas, %lld falhas\n", atomic_load(&d.counters.completed),
+            atomic_load(&d.counters.failed));
+    free(d.workers);
+    queue_free(&d.queue);
+    free_flag_image(&d.flag);
+    return 0;
+}
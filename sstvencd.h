@@ -0,0 +1,44 @@
+// Protocolo do sstvencd sobre o socket UNIX: uma requisição por conexão.
+//
+// O cliente manda um SstvdRequest e, em SSTVD_OP_ENCODE, logo depois os
+// image_bytes do arquivo de imagem (PNG, JPEG, PPM...). O daemon responde com um
+// SstvdResponse e em seguida `bytes` bytes: o WAV (ou PCM cru com SSTVD_FLAG_RAW)
+// enviado conforme é sintetizado, ou, em erro e em SSTVD_OP_STATS, texto (a
+// mensagem ou os contadores em JSON). Inteiros na ordem de bytes do host: o
+// socket é local.
+#ifndef SSTVENCD_H
+#define SSTVENCD_H
+
+#include <stdint.h>
+
+#define SSTVD_DEFAULT_SOCKET "/tmp/sstvencd.sock"
+#define SSTVD_REQUEST_MAGIC "SSTQ"
+#define SSTVD_RESPONSE_MAGIC "SSTR"
+#define SSTVD_MAX_IMAGE_BYTES (64u << 20)
+
+typedef enum {
+    SSTVD_OP_ENCODE = 1,
+    SSTVD_OP_STATS = 2
+} SstvdOp;
+
+#define SSTVD_FLAG_RAW 1u       // só as amostras, sem cabeçalho WAV
+#define SSTVD_FLAG_PCM_CACHE 2u // usa o cache de PCM do worker (amostras mudam um pouco)
+
+typedef struct {
+    char magic[4];
+    uint32_t op;           // SstvdOp
+    uint32_t flags;
+    uint32_t samplerate;   // 0: padrão do daemon
+    char mode[16];         // "" : classico
+    char engine[8];        // "" : motor padrão do daemon
+    char format[8];        // "" : int16
+    uint64_t image_bytes;
+} SstvdRequest;
+
+typedef struct {
+    char magic[4];
+    int32_t status;        // 0 ok; -1 erro (o corpo traz a mensagem)
+    uint64_t bytes;
+} SstvdResponse;
+
+#endif
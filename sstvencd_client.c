@@ -0,0 +1,241 @@
+// Cliente de carga do sstvencd: C conexões simultâneas mandam a mesma imagem até
+// completar N requisições, lendo e descartando o áudio; ao final imprime
+// latência (média e percentis) e vazão. Com --stats só pede os contadores do
+// daemon. Só depende do protocolo em sstvencd.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sstvencd.h"
+
+#define CLIENT_DEFAULT_IMAGE "input1.png"
+#define CLIENT_READ_BYTES 65536
+#define CLIENT_MESSAGE_BYTES 2048 // erro ou contadores em JSON
+
+typedef struct {
+    const char* socket_path;
+    SstvdRequest req;
+    const uint8_t* image;
+    const char* out_path;    // corpo da primeira resposta bem-sucedida, se pedido
+    int requests;
+    atomic_int next;
+    atomic_int saved;
+    atomic_llong bytes;
+    atomic_int failed;
+    double* latencies;       // segundos, por requisição (< 0: falhou)
+} ClientCtx;
+
+static double now_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int read_full(int fd, void* buf, size_t n) {
+    uint8_t* p = (uint8_t*)buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void* buf, size_t n) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int connect_daemon(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Uma requisição completa. Retorna os bytes do corpo ou -1; em erro do daemon a
+// mensagem vai para stderr.
+static long long client_request(ClientCtx* ctx, FILE* out) {
+    int fd = connect_daemon(ctx->socket_path);
+    if (fd < 0) {
+        perror(ctx->socket_path);
+        return -1;
+    }
+    SstvdResponse resp;
+    long long body = -1;
+    if (write_full(fd, &ctx->req, sizeof(ctx->req)) == 0 &&
+        (ctx->req.op != SSTVD_OP_ENCODE || write_full(fd, ctx->image, ctx->req.image_bytes) == 0) &&
+        read_full(fd, &resp, sizeof(resp)) == 0 && memcmp(resp.magic, SSTVD_RESPONSE_MAGIC, 4) == 0) {
+        uint8_t buf[CLIENT_READ_BYTES];
+        uint64_t left = resp.bytes;
+        char message[CLIENT_MESSAGE_BYTES];
+        size_t msg_len = 0;
+        body = 0;
+        while (left > 0) {
+            size_t want = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+            ssize_t r = read(fd, buf, want);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) { body = -1; break; }
+            if (resp.status != 0 || ctx->req.op == SSTVD_OP_STATS) {
+                size_t n = (size_t)r < sizeof(message) - 1 - msg_len ? (size_t)r : sizeof(message) - 1 - msg_len;
+                memcpy(message + msg_len, buf, n);
+                msg_len += n;
+            } else if (out) {
+                fwrite(buf, 1, (size_t)r, out);
+            }
+            left -= (uint64_t)r;
+            body += r;
+        }
+        message[msg_len] = '\0';
+        if (ctx->req.op == SSTVD_OP_STATS) fputs(message, stdout);
+        if (resp.status != 0) {
+            fprintf(stderr, "ERRO: daemon: %s\n", message);
+            body = -1;
+        }
+    }
+    close(fd);
+    return body;
+}
+
+static void* client_thread(void* arg) {
+    ClientCtx* ctx = (ClientCtx*)arg;
+    for (;;) {
+        int i = atomic_fetch_add(&ctx->next, 1);
+        if (i >= ctx->requests) break;
+        FILE* out = NULL;
+        if (ctx->out_path && atomic_exchange(&ctx->saved, 1) == 0) out = fopen(ctx->out_path, "wb");
+        double t0 = now_seconds();
+        long long body = client_request(ctx, out);
+        ctx->latencies[i] = body < 0 ? -1.0 : now_seconds() - t0;
+        if (out) fclose(out);
+        if (body < 0) atomic_fetch_add(&ctx->failed, 1);
+        else atomic_fetch_add(&ctx->bytes, body);
+    }
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror(path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = n > 0 ? (uint8_t*)malloc((size_t)n) : NULL;
+    if (!data || fread(data, 1, (size_t)n, f) != (size_t)n) {
+        fprintf(stderr, "ERRO: Não foi possível ler %s.\n", path);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (size_t)n;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    const char* image_path = CLIENT_DEFAULT_IMAGE;
+    int concurrency = 4;
+    int stats_only = 0;
+    ClientCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.socket_path = SSTVD_DEFAULT_SOCKET;
+    ctx.requests = 16;
+    memcpy(ctx.req.magic, SSTVD_REQUEST_MAGIC, 4);
+    ctx.req.op = SSTVD_OP_ENCODE;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) ctx.socket_path = argv[++i];
+        else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) image_path = argv[++i];
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) ctx.requests = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) concurrency = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) ctx.out_path = argv[++i];
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) ctx.req.samplerate = (uint32_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            snprintf(ctx.req.mode, sizeof(ctx.req.mode), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            snprintf(ctx.req.engine, sizeof(ctx.req.engine), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            snprintf(ctx.req.format, sizeof(ctx.req.format), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--raw") == 0) ctx.req.flags |= SSTVD_FLAG_RAW;
+        else if (strcmp(argv[i], "--pcm-cache") == 0) ctx.req.flags |= SSTVD_FLAG_PCM_CACHE;
+        else if (strcmp(argv[i], "--stats") == 0) stats_only = 1;
+        else {
+            fprintf(stderr, "Uso: %s [--socket caminho] [--image arquivo] [--requests N] [--concurrency N]"
+                            " [--mode nome] [--rate Hz] [--engine libm|nco|simd] [--format int16|float32|u8|mulaw]"
+                            " [--raw] [--pcm-cache] [--out arquivo] [--stats]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (stats_only) {
+        ctx.req.op = SSTVD_OP_STATS;
+        return client_request(&ctx, NULL) < 0 ? 1 : 0;
+    }
+    if (ctx.requests < 1) ctx.requests = 1;
+    if (concurrency < 1) concurrency = 1;
+    if (concurrency > ctx.requests) concurrency = ctx.requests;
+
+    size_t image_size = 0;
+    uint8_t* image = read_file(image_path, &image_size);
+    if (!image) return 1;
+    ctx.image = image;
+    ctx.req.image_bytes = image_size;
+    ctx.latencies = (double*)calloc((size_t)ctx.requests, sizeof(double));
+    pthread_t* threads = (pthread_t*)calloc((size_t)concurrency, sizeof(pthread_t));
+    if (!ctx.latencies || !threads) { perror("calloc"); return 1; }
+
+    double t0 = now_seconds();
+    for (int t = 0; t < concurrency; ++t) pthread_create(&threads[t], NULL, client_thread, &ctx);
+    for (int t = 0; t < concurrency; ++t) pthread_join(threads[t], NULL);
+    double elapsed = now_seconds() - t0;
+
+    int ok = 0;
+    double sum = 0.0;
+    for (int i = 0; i < ctx.requests; ++i) {
+        if (ctx.latencies[i] >= 0.0) {
+            ctx.latencies[ok++] = ctx.latencies[i];
+            sum += ctx.latencies[i];
+        }
+    }
+    qsort(ctx.latencies, (size_t)ok, sizeof(double), compare_double);
+    printf("Requisições: %d ok, %d falhas, %d conexões simultâneas, %.3f s\n", ok, atomic_load(&ctx.failed),
+           concurrency, elapsed);
+    if (ok > 0) {
+        printf("Latência (ms): média %.1f, p50 %.1f, p90 %.1f, p99 %.1f, máx. %.1f\n", sum / ok * 1000.0,
+               ctx.latencies[ok / 2] * 1000.0, ctx.latencies[(int)(ok * 0.9)] * 1000.0,
+               ctx.latencies[(int)(ok * 0.99)] * 1000.0, ctx.latencies[ok - 1] * 1000.0);
+        printf("Vazão: %.2f quadros/s, %.1f MB/s\n", ok / elapsed, atomic_load(&ctx.bytes) / elapsed / 1e6);
+    }
+    free(threads);
+    free(ctx.latencies);
+    free(image);
+    return atomic_load(&ctx.failed) ? 1 : 0;
+}